@@ -1,10 +1,10 @@
-#version 450
-
-layout(location=0) in vec4 inColor;
-layout(location=0) out vec4 outColor;
-
-
-void main()
-{
-  outColor = inColor;
-}
+#version 450
+
+layout(location=0) in vec4 inColor;
+layout(location=0) out vec4 outColor;
+
+
+void main()
+{
+  outColor = inColor;
+}
@@ -1,40 +1,51 @@
-﻿#define WIN32_LEAN_AND_MEAN
-#include <windows.h>
-
-#include <vector>
-#include <array>
-#include <cassert>
-#include <sstream>
-#include <numeric>
-
-#include "CubeApp.h"
-
-#pragma comment(lib, "vulkan-1.lib")
-
-const int WindowWidth = 640, WindowHeight = 480;
-const char* AppTitle = "TexturedCube";
-
-int __stdcall wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLine, int nCmdShow)
-{
-  UNREFERENCED_PARAMETER(hPrevInstance);
-  UNREFERENCED_PARAMETER(lpCmdLine);
-  glfwInit();
-  glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-  glfwWindowHint(GLFW_RESIZABLE, 0);
-  auto window = glfwCreateWindow(WindowWidth, WindowHeight, AppTitle, nullptr, nullptr);
-
-  // Vulkan 初期化
-  CubeApp theApp;
-  theApp.initialize(window, AppTitle);
-
-  while (glfwWindowShouldClose(window) == GLFW_FALSE)
-  {
-    glfwPollEvents();
-    theApp.render();
-  }
-
-  // Vulkan 終了
-  theApp.terminate();
-  glfwTerminate();
-  return 0;
-}
+﻿#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include <vector>
+#include <array>
+#include <cassert>
+#include <sstream>
+#include <numeric>
+#include <algorithm>
+
+#include "CubeApp.h"
+
+#pragma comment(lib, "vulkan-1.lib")
+
+const int WindowWidth = 640, WindowHeight = 480;
+const char* AppTitle = "TexturedCube";
+
+int __stdcall wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLine, int nCmdShow)
+{
+  UNREFERENCED_PARAMETER(hPrevInstance);
+  // -instances N でキューブを N 個インスタンス描画する.
+  uint32_t instanceCount = 1;
+  if (auto option = wcsstr(lpCmdLine, L"-instances"))
+  {
+    instanceCount = uint32_t((std::max)(_wtoi(option + wcslen(L"-instances")), 1));
+  }
+  glfwInit();
+  glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+  glfwWindowHint(GLFW_RESIZABLE, 0);
+  auto window = glfwCreateWindow(WindowWidth, WindowHeight, AppTitle, nullptr, nullptr);
+
+  // Vulkan 初期化
+  CubeApp theApp(instanceCount);
+  // -staging でホストからの直接コピーを使わずテクスチャを転送する (転送方式の比較用).
+  if (wcsstr(lpCmdLine, L"-staging") != nullptr)
+  {
+    theApp.setPreferHostImageCopy(false);
+  }
+  theApp.initialize(window, AppTitle);
+
+  while (glfwWindowShouldClose(window) == GLFW_FALSE)
+  {
+    glfwPollEvents();
+    theApp.render();
+  }
+
+  // Vulkan 終了
+  theApp.terminate();
+  glfwTerminate();
+  return 0;
+}
@@ -1,739 +1,2197 @@
-﻿#include "ModelApp.h"
-
-#include <fstream>
-#include <array>
-#include <glm/gtc/matrix_transform.hpp>
-
-#define STB_IMAGE_IMPLEMENTATION
-#include "../common/stb_image.h"
-
-#include "streamreader.h"
-
-using namespace glm;
-using namespace std;
-
-void ModelApp::prepare()
-{
-  // モデルデータの読み込み
-  auto modelFilePath = experimental::filesystem::path("alicia-solid.vrm");
-  if (modelFilePath.is_relative())
-  {
-    auto current = experimental::filesystem::current_path();
-    current /= modelFilePath;
-    current.swap(modelFilePath);
-  }
-
-  auto reader = make_unique<StreamReader>(modelFilePath.parent_path());
-  auto glbStream = reader->GetInputStream(modelFilePath.filename().u8string());
-  auto glbResourceReader = make_shared<Microsoft::glTF::GLBResourceReader>(std::move(reader), std::move(glbStream));
-  auto document = Microsoft::glTF::Deserialize(glbResourceReader->GetJson());
-
-  makeModelGeometry(document, glbResourceReader);
-  makeModelMaterial(document, glbResourceReader);
-
-  prepareUniformBuffers();
-  prepareDescriptorSetLayout();
-  prepareDescriptorPool();
- 
-  m_sampler = createSampler();
-  prepareDescriptorSet();
-
-  // 頂点の入力設定
-  VkVertexInputBindingDescription inputBinding{
-    0,                          // binding
-    sizeof(Vertex),         // stride
-    VK_VERTEX_INPUT_RATE_VERTEX // inputRate
-  };
-  array<VkVertexInputAttributeDescription, 3> inputAttribs{
-    {
-      { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, pos)},
-      { 1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color)},
-      { 2, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, uv)},
-    }
-  };
-  VkPipelineVertexInputStateCreateInfo vertexInputCI{};
-  vertexInputCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-  vertexInputCI.vertexBindingDescriptionCount = 1;
-  vertexInputCI.pVertexBindingDescriptions = &inputBinding;
-  vertexInputCI.vertexAttributeDescriptionCount = uint32_t(inputAttribs.size());
-  vertexInputCI.pVertexAttributeDescriptions = inputAttribs.data();
-
-
-  // ビューポートの設定
-  VkViewport viewport;
-  {
-    viewport.x = 0.0f;
-    viewport.y = float(m_swapchainExtent.height);
-    viewport.width = float(m_swapchainExtent.width);
-    viewport.height = -1.0f * float(m_swapchainExtent.height);
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-  }
-  VkRect2D scissor = {
-    { 0,0},// offset
-    m_swapchainExtent
-  };
-  VkPipelineViewportStateCreateInfo viewportCI{};
-  viewportCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-  viewportCI.viewportCount = 1;
-  viewportCI.pViewports = &viewport;
-  viewportCI.scissorCount = 1;
-  viewportCI.pScissors = &scissor;
-
-  // プリミティブトポロジー設定
-  VkPipelineInputAssemblyStateCreateInfo inputAssemblyCI{};
-  inputAssemblyCI.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-  inputAssemblyCI.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-
-
-  // ラスタライザーステート設定
-  VkPipelineRasterizationStateCreateInfo rasterizerCI{};
-  rasterizerCI.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-  rasterizerCI.polygonMode = VK_POLYGON_MODE_FILL;
-  rasterizerCI.cullMode = VK_CULL_MODE_NONE;
-  rasterizerCI.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-  rasterizerCI.lineWidth = 1.0f;
-
-  // マルチサンプル設定
-  VkPipelineMultisampleStateCreateInfo multisampleCI{};
-  multisampleCI.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-  multisampleCI.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-  // パイプラインレイアウト
-  VkPipelineLayoutCreateInfo pipelineLayoutCI{};
-  pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-  pipelineLayoutCI.setLayoutCount = 1;
-  pipelineLayoutCI.pSetLayouts = &m_descriptorSetLayout;
-  vkCreatePipelineLayout(m_device, &pipelineLayoutCI, nullptr, &m_pipelineLayout);
-
-  // 不透明用: パイプラインの構築
-  {
-    // ブレンディングの設定
-    const auto colorWriteAll = \
-      VK_COLOR_COMPONENT_R_BIT | \
-      VK_COLOR_COMPONENT_G_BIT | \
-      VK_COLOR_COMPONENT_B_BIT | \
-      VK_COLOR_COMPONENT_A_BIT;
-    VkPipelineColorBlendAttachmentState blendAttachment{};
-    blendAttachment.blendEnable = VK_TRUE;
-    blendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
-    blendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
-    blendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-    blendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-    blendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-    blendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-    blendAttachment.colorWriteMask = colorWriteAll;
-    VkPipelineColorBlendStateCreateInfo cbCI{};
-    cbCI.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    cbCI.attachmentCount = 1;
-    cbCI.pAttachments = &blendAttachment;
-
-    // デプスステンシルステート設定
-    VkPipelineDepthStencilStateCreateInfo depthStencilCI{};
-    depthStencilCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-    depthStencilCI.depthTestEnable = VK_TRUE;
-    depthStencilCI.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-    depthStencilCI.depthWriteEnable = VK_TRUE;
-    depthStencilCI.stencilTestEnable = VK_FALSE;
-
-    // シェーダーバイナリの読み込み
-    vector<VkPipelineShaderStageCreateInfo> shaderStages
-    {
-      loadShaderModule("shader.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
-      loadShaderModule("shaderOpaque.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
-    };
-    // パイプラインの構築
-    VkGraphicsPipelineCreateInfo ci{};
-    ci.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    ci.stageCount = uint32_t(shaderStages.size());
-    ci.pStages = shaderStages.data();
-    ci.pInputAssemblyState = &inputAssemblyCI;
-    ci.pVertexInputState = &vertexInputCI;
-    ci.pRasterizationState = &rasterizerCI;
-    ci.pDepthStencilState = &depthStencilCI;
-    ci.pMultisampleState = &multisampleCI;
-    ci.pViewportState = &viewportCI;
-    ci.pColorBlendState = &cbCI;
-    ci.renderPass = m_renderPass;
-    ci.layout = m_pipelineLayout;
-    vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &ci, nullptr, &m_pipelineOpaque);
-
-    // ShaderModule はもう不要のため破棄
-    for (const auto& v : shaderStages)
-    {
-      vkDestroyShaderModule(m_device, v.module, nullptr);
-    }
-  }
-
-  // 半透明用: パイプラインの構築
-  {
-    // ブレンディングの設定
-    const auto colorWriteAll = \
-      VK_COLOR_COMPONENT_R_BIT | \
-      VK_COLOR_COMPONENT_G_BIT | \
-      VK_COLOR_COMPONENT_B_BIT | \
-      VK_COLOR_COMPONENT_A_BIT;
-    VkPipelineColorBlendAttachmentState blendAttachment{};
-    blendAttachment.blendEnable = VK_TRUE;
-    blendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-    blendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-    blendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-    blendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-    blendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-    blendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-    blendAttachment.colorWriteMask = colorWriteAll;
-    VkPipelineColorBlendStateCreateInfo cbCI{};
-    cbCI.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    cbCI.attachmentCount = 1;
-    cbCI.pAttachments = &blendAttachment;
-
-    // デプスステンシルステート設定
-    VkPipelineDepthStencilStateCreateInfo depthStencilCI{};
-    depthStencilCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-    depthStencilCI.depthTestEnable = VK_TRUE;
-    depthStencilCI.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-    depthStencilCI.depthWriteEnable = VK_FALSE;
-    depthStencilCI.stencilTestEnable = VK_FALSE;
-
-    // シェーダーバイナリの読み込み
-    vector<VkPipelineShaderStageCreateInfo> shaderStages
-    {
-      loadShaderModule("shader.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
-      loadShaderModule("shaderAlpha.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT)
-    };
-    // パイプラインの構築
-    VkGraphicsPipelineCreateInfo ci{};
-    ci.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    ci.stageCount = uint32_t(shaderStages.size());
-    ci.pStages = shaderStages.data();
-    ci.pInputAssemblyState = &inputAssemblyCI;
-    ci.pVertexInputState = &vertexInputCI;
-    ci.pRasterizationState = &rasterizerCI;
-    ci.pDepthStencilState = &depthStencilCI;
-    ci.pMultisampleState = &multisampleCI;
-    ci.pViewportState = &viewportCI;
-    ci.pColorBlendState = &cbCI;
-    ci.renderPass = m_renderPass;
-    ci.layout = m_pipelineLayout;
-    vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &ci, nullptr, &m_pipelineAlpha);
-
-    // ShaderModule はもう不要のため破棄
-    for (const auto& v : shaderStages)
-    {
-      vkDestroyShaderModule(m_device, v.module, nullptr);
-    }
-  }
-}
-void ModelApp::cleanup()
-{
-  for (auto& v : m_uniformBuffers)
-  {
-    vkDestroyBuffer(m_device, v.buffer, nullptr);
-    vkFreeMemory(m_device, v.memory, nullptr);
-  }
-  vkDestroySampler(m_device, m_sampler, nullptr);
-
-  vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
-  vkDestroyPipeline(m_device, m_pipelineOpaque, nullptr);
-  vkDestroyPipeline(m_device, m_pipelineAlpha, nullptr);
-
-  for (auto& mesh : m_model.meshes)
-  {
-    vkFreeMemory(m_device, mesh.vertexBuffer.memory, nullptr);
-    vkFreeMemory(m_device, mesh.indexBuffer.memory, nullptr);
-    vkDestroyBuffer(m_device, mesh.vertexBuffer.buffer, nullptr);
-    vkDestroyBuffer(m_device, mesh.indexBuffer.buffer, nullptr);
-    uint32_t count = uint32_t(mesh.descriptorSet.size());
-    mesh.descriptorSet.clear();
-  }
-  for (auto& material : m_model.materials)
-  {
-    vkFreeMemory(m_device, material.texture.memory, nullptr);
-    vkDestroyImage(m_device, material.texture.image, nullptr);
-    vkDestroyImageView(m_device, material.texture.view, nullptr);
-  }
-  vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
-  vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, nullptr);
-}
-
-void ModelApp::makeCommand(VkCommandBuffer command)
-{
-  using namespace Microsoft::glTF;
-
-  // ユニフォームバッファの中身を更新する.
-  ShaderParameters shaderParam{};
-  shaderParam.mtxWorld = glm::identity<glm::mat4>();
-  shaderParam.mtxView = lookAtRH(vec3(0.0f, 1.5f, -1.0f), vec3(0.0f, 1.25f, 0.0f), vec3(0.0f, 1.0f, 0.0f));
-  shaderParam.mtxProj = perspective(glm::radians(45.0f), 640.0f / 480, 0.01f, 100.0f);
-  {
-    auto memory = m_uniformBuffers[m_imageIndex].memory;
-    void* p;
-    vkMapMemory(m_device, memory, 0, VK_WHOLE_SIZE, 0, &p);
-    memcpy(p, &shaderParam, sizeof(shaderParam));
-    vkUnmapMemory(m_device, memory);
-  }
-
-  for (auto mode : { ALPHA_OPAQUE, ALPHA_MASK, ALPHA_BLEND })
-  {
-    for (const auto& mesh : m_model.meshes)
-    {
-      // 対応するポリゴンメッシュのみを描画する.
-      if (m_model.materials[mesh.materialIndex].alphaMode != mode)
-      {
-        continue;
-      }
-
-      // モードに応じて使用するパイプラインを変える.
-      switch (mode)
-      {
-      case ALPHA_OPAQUE:
-        vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineOpaque);
-        break;
-      case ALPHA_MASK:
-        vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineOpaque);
-        break;
-      case ALPHA_BLEND:
-        vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineAlpha);
-        break;
-      }
-
-      // 各バッファオブジェクトのセット
-      VkDeviceSize offset = 0;
-      vkCmdBindVertexBuffers(command, 0, 1, &mesh.vertexBuffer.buffer, &offset);
-      vkCmdBindIndexBuffer(command, mesh.indexBuffer.buffer, offset, VK_INDEX_TYPE_UINT32);
-
-      // ディスクリプタセットをセット
-      VkDescriptorSet descriptorSets[] = {
-        mesh.descriptorSet[m_imageIndex]
-      };
-      vkCmdBindDescriptorSets(command, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, descriptorSets, 0, nullptr);
-
-      // このメッシュを描画
-      vkCmdDrawIndexed(command, mesh.indexCount, 1, 0, 0, 0);
-    }
-  }
-}
-
-void ModelApp::makeModelGeometry(const Microsoft::glTF::Document& doc, std::shared_ptr<Microsoft::glTF::GLTFResourceReader> reader )
-{
-  using namespace Microsoft::glTF;
-  for (const auto& mesh : doc.meshes.Elements())
-  {
-    for (const auto& meshPrimitive : mesh.primitives)
-    {
-      std::vector<Vertex> vertices;
-      std::vector<uint32_t> indices;
-
-      // 頂点位置情報アクセッサの取得
-      auto& idPos = meshPrimitive.GetAttributeAccessorId(ACCESSOR_POSITION);
-      auto& accPos = doc.accessors.Get(idPos);
-      // 法線情報アクセッサの取得
-      auto& idNrm = meshPrimitive.GetAttributeAccessorId(ACCESSOR_NORMAL);
-      auto& accNrm = doc.accessors.Get(idNrm);
-      // テクスチャ座標情報アクセッサの取得
-      auto& idUV = meshPrimitive.GetAttributeAccessorId(ACCESSOR_TEXCOORD_0);
-      auto& accUV = doc.accessors.Get(idUV);
-      // 頂点インデックス用アクセッサの取得
-      auto& idIndex = meshPrimitive.indicesAccessorId;
-      auto& accIndex = doc.accessors.Get(idIndex);
-
-      // アクセッサからデータ列を取得
-      auto vertPos = reader->ReadBinaryData<float>(doc, accPos);
-      auto vertNrm = reader->ReadBinaryData<float>(doc, accNrm);
-      auto vertUV = reader->ReadBinaryData<float>(doc, accUV);
-
-      auto vertexCount = accPos.count;
-      for (uint32_t i = 0; i < vertexCount; ++i)
-      {
-        // 頂点データの構築
-        int vid0 = 3*i, vid1 = 3*i+1, vid2 = 3*i+2;
-        int tid0 = 2*i, tid1 = 2*i+1;
-        vertices.emplace_back(
-          Vertex{
-            vec3(vertPos[vid0], vertPos[vid1],vertPos[vid2]),
-            vec3(vertNrm[vid0], vertNrm[vid1],vertNrm[vid2]),
-            vec2(vertUV[tid0],vertUV[tid1])
-          }
-        );
-      }
-      // インデックスデータ
-      indices = reader->ReadBinaryData<uint32_t>(doc, accIndex);
-
-      auto vbSize = UINT(sizeof(Vertex)*vertices.size());
-      auto ibSize = UINT(sizeof(uint32_t)*indices.size());
-      ModelMesh modelMesh;
-      modelMesh.vertexBuffer = createBuffer(vbSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, vertices.data());
-      modelMesh.indexBuffer = createBuffer(ibSize,VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, indices.data());
-      modelMesh.vertexCount = UINT(vertices.size());
-      modelMesh.indexCount = UINT(indices.size());
-      modelMesh.materialIndex = int(doc.materials.GetIndex(meshPrimitive.materialId));
-      m_model.meshes.push_back(modelMesh);
-    }
-  }
-}
-void ModelApp::makeModelMaterial(const Microsoft::glTF::Document& doc, std::shared_ptr<Microsoft::glTF::GLTFResourceReader> reader)
-{
-  for (auto& m : doc.materials.Elements())
-  {
-    auto textureId = m.metallicRoughness.baseColorTexture.textureId;
-    if (textureId.empty())
-    {
-      textureId = m.normalTexture.textureId;
-    }
-    auto& texture = doc.textures.Get(textureId);
-    auto& image = doc.images.Get(texture.imageId);
-    auto imageBufferView = doc.bufferViews.Get(image.bufferViewId);
-    auto imageData = reader->ReadBinaryData<char>(doc, imageBufferView);
-
-    // imageData が画像データ.
-    Material material{};
-    material.alphaMode = m.alphaMode;
-    material.texture = createTextureFromMemory(imageData);
-    m_model.materials.push_back(material);
-  }
-}
-
-void ModelApp::prepareUniformBuffers()
-{
-  m_uniformBuffers.resize(m_swapchainViews.size());
-  for (auto& v : m_uniformBuffers)
-  {
-    VkMemoryPropertyFlags uboFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-    v = createBuffer(sizeof(ShaderParameters), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, uboFlags, nullptr );
-  }
-}
-void ModelApp::prepareDescriptorSetLayout()
-{
-  vector<VkDescriptorSetLayoutBinding> bindings;
-  VkDescriptorSetLayoutBinding bindingUBO{}, bindingTex{};
-  bindingUBO.binding = 0;
-  bindingUBO.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  bindingUBO.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-  bindingUBO.descriptorCount = 1;
-  bindings.push_back(bindingUBO);
-  
-  bindingTex.binding = 1;
-  bindingTex.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-  bindingTex.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-  bindingTex.descriptorCount = 1;
-  bindings.push_back(bindingTex);
-
-  VkDescriptorSetLayoutCreateInfo ci{};
-  ci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-  ci.bindingCount = uint32_t(bindings.size());
-  ci.pBindings = bindings.data();
-  vkCreateDescriptorSetLayout(m_device, &ci, nullptr, &m_descriptorSetLayout);
-}
-
-void ModelApp::prepareDescriptorPool()
-{
-  const uint32_t count = 100;
-  array<VkDescriptorPoolSize, 2> descPoolSize;
-  descPoolSize[0].descriptorCount = count;
-  descPoolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  descPoolSize[1].descriptorCount = count;
-  descPoolSize[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-
-  uint32_t maxDescriptorCount = uint32_t(m_swapchainImages.size() * m_model.meshes.size());
-  VkDescriptorPoolCreateInfo ci{};
-  ci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-  ci.maxSets = maxDescriptorCount;
-  ci.poolSizeCount = uint32_t(descPoolSize.size());
-  ci.pPoolSizes = descPoolSize.data();
-  vkCreateDescriptorPool(m_device, &ci, nullptr, &m_descriptorPool);
-}
-
-void ModelApp::prepareDescriptorSet()
-{
-  vector<VkDescriptorSetLayout> layouts;
-  for (int i = 0; i<int(m_uniformBuffers.size()); ++i)
-  {
-    layouts.push_back(m_descriptorSetLayout);
-  }
-
-  for (auto& mesh : m_model.meshes)
-  {
-    // ディスクリプタセットの確保
-    VkDescriptorSetAllocateInfo ai{};
-    ai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    ai.descriptorPool = m_descriptorPool;
-    ai.descriptorSetCount = uint32_t(m_uniformBuffers.size());
-    ai.pSetLayouts = layouts.data();
-    mesh.descriptorSet.resize(m_uniformBuffers.size());
-    vkAllocateDescriptorSets(m_device, &ai, mesh.descriptorSet.data());
-
-    // ディスクリプタセットへ書き込み.
-    auto material = m_model.materials[mesh.materialIndex];
-    for (int i = 0; i<int(m_uniformBuffers.size()); ++i)
-    {
-      VkDescriptorBufferInfo descUBO{};
-      descUBO.buffer = m_uniformBuffers[i].buffer;
-      descUBO.offset = 0;
-      descUBO.range = VK_WHOLE_SIZE;
-
-      VkDescriptorImageInfo  descImage{};
-      descImage.imageView = material.texture.view;
-      descImage.sampler = m_sampler;
-      descImage.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-      VkWriteDescriptorSet ubo{};
-      ubo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-      ubo.dstBinding = 0;
-      ubo.descriptorCount = 1;
-      ubo.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-      ubo.pBufferInfo = &descUBO;
-      ubo.dstSet = mesh.descriptorSet[i];
-
-      VkWriteDescriptorSet tex{};
-      tex.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-      tex.dstBinding = 1;
-      tex.descriptorCount = 1;
-      tex.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-      tex.pImageInfo = &descImage;
-      tex.dstSet = mesh.descriptorSet[i];
-
-      vector<VkWriteDescriptorSet> writeSets = {
-        ubo, tex
-      };
-      vkUpdateDescriptorSets(m_device, uint32_t(writeSets.size()), writeSets.data(), 0, nullptr);
-    }
-  }
-}
-
-ModelApp::BufferObject ModelApp::createBuffer(uint32_t size, VkBufferUsageFlags usage, VkMemoryPropertyFlags flags, const void* initialData)
-{
-  BufferObject obj;
-  VkBufferCreateInfo ci{};
-  ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-  ci.usage = usage;
-  ci.size = size;
-  auto result = vkCreateBuffer(m_device, &ci, nullptr, &obj.buffer);
-  checkResult(result);
-
-  // メモリ量の算出
-  VkMemoryRequirements reqs;
-  vkGetBufferMemoryRequirements(m_device, obj.buffer, &reqs);
-  VkMemoryAllocateInfo info{};
-  info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  info.allocationSize = reqs.size;
-  // メモリタイプの判定
-  info.memoryTypeIndex = getMemoryTypeIndex(reqs.memoryTypeBits, flags);
-  // メモリの確保
-  vkAllocateMemory(m_device, &info, nullptr, &obj.memory);
-
-  // メモリのバインド
-  vkBindBufferMemory(m_device, obj.buffer, obj.memory, 0);
-
-  if ((flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0 &&
-    initialData != nullptr)
-  {
-    void* p;
-    vkMapMemory(m_device, obj.memory, 0, VK_WHOLE_SIZE, 0, &p);
-    memcpy(p, initialData, size);
-    vkUnmapMemory(m_device, obj.memory);
-  }
-  return obj;
-}
-
-VkPipelineShaderStageCreateInfo ModelApp::loadShaderModule(const char* fileName, VkShaderStageFlagBits stage)
-{
-  ifstream infile(fileName, std::ios::binary);
-  if (!infile)
-  {
-    OutputDebugStringA("file not found.\n");
-    DebugBreak();
-  }
-  vector<char> filedata;
-  filedata.resize(uint32_t(infile.seekg(0, ifstream::end).tellg()));
-  infile.seekg(0, ifstream::beg).read(filedata.data(), filedata.size());
-
-  VkShaderModule shaderModule;
-  VkShaderModuleCreateInfo ci{};
-  ci.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-  ci.pCode = reinterpret_cast<uint32_t*>(filedata.data());
-  ci.codeSize = filedata.size();
-  vkCreateShaderModule(m_device, &ci, nullptr, &shaderModule);
-
-  VkPipelineShaderStageCreateInfo shaderStageCI{};
-  shaderStageCI.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-  shaderStageCI.stage = stage;
-  shaderStageCI.module = shaderModule;
-  shaderStageCI.pName = "main";
-  return shaderStageCI;
-}
-
-VkSampler ModelApp::createSampler()
-{
-  VkSampler sampler;
-  VkSamplerCreateInfo ci{};
-  ci.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-  ci.minFilter = VK_FILTER_LINEAR;
-  ci.magFilter = VK_FILTER_LINEAR;
-  ci.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-  ci.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-  ci.maxAnisotropy = 1.0f;
-  ci.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-  vkCreateSampler(m_device, &ci, nullptr, &sampler);
-  return sampler;
-}
-
-ModelApp::TextureObject ModelApp::createTextureFromMemory(const std::vector<char>& imageData)
-{
-  BufferObject stagingBuffer;
-  TextureObject texture{};
-  int width, height, channels;
-  auto* pImage = stbi_load_from_memory(
-    reinterpret_cast<const uint8_t*>(imageData.data()),
-    int(imageData.size()),
-    &width, &height, &channels, 0);
-
-  auto format = VK_FORMAT_R8G8B8A8_UNORM;
-
-  {
-    // テクスチャのVkImage を生成
-    VkImageCreateInfo ci{};
-    ci.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-    ci.extent = { uint32_t(width), uint32_t(height), 1 };
-    ci.format = format;
-    ci.imageType = VK_IMAGE_TYPE_2D;
-    ci.arrayLayers = 1;
-    ci.mipLevels = 1;
-    ci.samples = VK_SAMPLE_COUNT_1_BIT;
-    ci.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-    vkCreateImage(m_device, &ci, nullptr, &texture.image);
-
-    // メモリ量の算出
-    VkMemoryRequirements reqs;
-    vkGetImageMemoryRequirements(m_device, texture.image, &reqs);
-    VkMemoryAllocateInfo info{};
-    info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    info.allocationSize = reqs.size;
-    // メモリタイプの判定
-    info.memoryTypeIndex = getMemoryTypeIndex(reqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    // メモリの確保
-    vkAllocateMemory(m_device, &info, nullptr, &texture.memory);
-    // メモリのバインド
-    vkBindImageMemory(m_device, texture.image, texture.memory, 0);
-  }
-
-  {
-    uint32_t imageSize = width * height * sizeof(uint32_t);
-    // ステージングバッファを用意.
-    stagingBuffer = createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, pImage);
-  }
-
-  VkBufferImageCopy copyRegion{};
-  copyRegion.imageExtent = { uint32_t(width), uint32_t(height), 1 };
-  copyRegion.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
-  VkCommandBuffer command;
-  {
-    VkCommandBufferAllocateInfo ai{};
-    ai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    ai.commandBufferCount = 1;
-    ai.commandPool = m_commandPool;
-    ai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    vkAllocateCommandBuffers(m_device, &ai, &command);
-  }
-
-  VkCommandBufferBeginInfo commandBI{};
-  commandBI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  vkBeginCommandBuffer(command, &commandBI);
-  setImageMemoryBarrier(command, texture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-  vkCmdCopyBufferToImage(command, stagingBuffer.buffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
-
-  setImageMemoryBarrier(command, texture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-  vkEndCommandBuffer(command);
-
-  VkSubmitInfo submitInfo{};
-  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &command;
-  vkQueueSubmit(m_deviceQueue, 1, &submitInfo, VK_NULL_HANDLE);
-  {
-    // テクスチャ参照用のビューを生成
-    VkImageViewCreateInfo ci{};
-    ci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-    ci.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    ci.image = texture.image;
-    ci.format = format;
-    ci.components = {
-      VK_COMPONENT_SWIZZLE_R,
-      VK_COMPONENT_SWIZZLE_G,
-      VK_COMPONENT_SWIZZLE_B,
-      VK_COMPONENT_SWIZZLE_A,
-    };
-    ci.subresourceRange = {
-      VK_IMAGE_ASPECT_COLOR_BIT,0,1,0,1
-    };
-    vkCreateImageView(m_device, &ci, nullptr, &texture.view);
-  }
-
-  vkDeviceWaitIdle(m_device);
-  vkFreeCommandBuffers(m_device, m_commandPool, 1, &command);
-
-  // ステージングバッファ解放.
-  vkFreeMemory(m_device, stagingBuffer.memory, nullptr);
-  vkDestroyBuffer(m_device, stagingBuffer.buffer, nullptr);
-
-  return texture;
-}
-
-void ModelApp::setImageMemoryBarrier(
-  VkCommandBuffer command,
-  VkImage image,
-  VkImageLayout oldLayout, VkImageLayout newLayout)
-{
-  VkImageMemoryBarrier imb{};
-  imb.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-  imb.oldLayout = oldLayout;
-  imb.newLayout = newLayout;
-  imb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  imb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  imb.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-  imb.image = image;
-
-  VkPipelineStageFlags srcStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
-  VkPipelineStageFlags dstStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
-
-  switch (oldLayout)
-  {
-  case VK_IMAGE_LAYOUT_UNDEFINED:
-    imb.srcAccessMask = 0;
-    break;
-  case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
-    imb.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    srcStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    break;
-  }
-
-  switch (newLayout)
-  {
-  case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
-    imb.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-    dstStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    break;
-  case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
-    imb.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    dstStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    break;
-  case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
-    imb.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-    dstStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    break;
-  }
-
-  //srcStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;  // パイプライン中でリソースへの書込み最終のステージ.
-  //dstStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;  // パイプライン中で次にリソースに書き込むステージ.
-
-  vkCmdPipelineBarrier(
-    command,
-    srcStage,
-    dstStage,
-    0,
-    0,  // memoryBarrierCount
-    nullptr,
-    0,  // bufferMemoryBarrierCount
-    nullptr,
-    1,  // imageMemoryBarrierCount
-    &imb);
-}
+﻿#include "ModelApp.h"
+
+#include <fstream>
+#include <array>
+#include <chrono>
+#include <sstream>
+#include <cfloat>
+#include <algorithm>
+#include <future>
+#include <iomanip>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include "../common/projection.h"
+
+#include "streamreader.h"
+
+using namespace glm;
+using namespace std;
+
+// 調理済みデータはそのまま頂点/メッシュレットのバッファにする.
+static_assert(sizeof(ModelApp::Vertex) == sizeof(CookedVertex), "Vertex layout must match the cooked model");
+static_assert(sizeof(ModelApp::CompactVertex) == sizeof(CookedCompactVertex), "CompactVertex layout must match the cooked model");
+
+void ModelApp::prepare()
+{
+  m_loadStart = chrono::steady_clock::now();
+
+  // インスタンス描画ではモデル全体を複数配置するため, メッシュ単位の LOD やカリングは行わない.
+  if (!m_instances.empty() && (m_compactVertices || m_gpuDriven || m_occlusionCulling))
+  {
+    OutputDebugStringA("Instancing is disabled with compact vertices or GPU driven rendering\n");
+    m_instances.clear();
+  }
+  if (!m_instances.empty())
+  {
+    m_instanceCount = uint32_t(m_instances.size());
+    m_meshletCulling = false;
+    m_generateLods = false;
+    m_frustumCulling = false;
+    m_occlusionQueries = false;
+  }
+
+  // モデルデータの読み込み
+  auto modelFilePath = experimental::filesystem::path("alicia-solid.vrm");
+  if (modelFilePath.is_relative())
+  {
+    auto current = experimental::filesystem::current_path();
+    current /= modelFilePath;
+    current.swap(modelFilePath);
+  }
+
+  const auto modelFileName = modelFilePath.wstring();
+
+  // 非同期読み込みでは読み込み中のメッシュを描かずに済む CPU 側の描画だけを使う.
+  // メッシュやメッシュレットがすべて揃っている前提の GPU 側のカリングとは併用しない.
+  if (m_asyncLoading && (m_gpuDriven || m_occlusionCulling || m_meshletCulling || m_occlusionQueries))
+  {
+    OutputDebugStringA("Async loading is disabled with GPU driven rendering, meshlet culling or occlusion culling\n");
+    m_asyncLoading = false;
+  }
+
+  prepareUniformBuffers();
+  prepareDescriptorSetLayout();
+  m_sampler = createSampler();
+  if (!m_instances.empty())
+  {
+    m_instanceBuffer = createBuffer(uint32_t(sizeof(InstanceData) * m_instances.size()),
+      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, MemoryUsage::GpuOnly, MemoryCategory::Mesh, m_instances.data());
+  }
+
+  if (m_asyncLoading)
+  {
+    // 調理 (またはキャッシュの検証) はワーカースレッドで行い, 結果は updateLoading() で受け取る.
+    // テクスチャが届くまでは 1x1 の灰色のテクスチャで描く.
+    const uint32_t placeholderPixel = 0xFF808080;
+    m_placeholderTexture = createTexture(1, 1, &placeholderPixel);
+    m_loadStage = LoadStage::Cooking;
+    m_loadTask = async(launch::async, [this, modelFileName]() { return acquireCookedModel(modelFileName); });
+  }
+  else
+  {
+    auto cooked = acquireCookedModel(modelFileName);
+    if (cooked == nullptr)
+    {
+      OutputDebugStringA("Failed to load the model\n");
+      DebugBreak();
+    }
+
+    // ジオメトリとテクスチャの転送はまとめて 1 回で送信する.
+    // キャッシュのマップ領域をデバイスに取り込めれば, そこから直接転送する.
+    beginUploadBatch();
+    if (m_cacheFile.isOpen())
+    {
+      importHostMemory(m_cacheFile.data(), m_cacheFile.size());
+    }
+    loadCookedModel(reinterpret_cast<const uint8_t*>(cooked), *cooked, false);
+    auto uploadTicket = endUploadBatch();
+
+    prepareDescriptorPool();
+    prepareDescriptorSet();
+    if (m_meshletCulling)
+    {
+      prepareMeshletCulling();
+    }
+
+    // 転送完了までを読み込み時間として計測
+    waitUpload(uploadTicket);
+    finishLoading();
+  }
+
+  // 頂点の入力設定
+  VkVertexInputBindingDescription inputBinding{
+    0,                          // binding
+    sizeof(Vertex),         // stride
+    VK_VERTEX_INPUT_RATE_VERTEX // inputRate
+  };
+  array<VkVertexInputAttributeDescription, 3> inputAttribs{
+    {
+      { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, pos)},
+      { 1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color)},
+      { 2, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, uv)},
+    }
+  };
+  if (m_compactVertices)
+  {
+    // 量子化した頂点はシェーダーで復元する.
+    inputBinding.stride = sizeof(CompactVertex);
+    inputAttribs = {
+      {
+        { 0, 0, VK_FORMAT_R16G16B16A16_UNORM, offsetof(CompactVertex, pos)},
+        { 1, 0, VK_FORMAT_R16G16_SNORM, offsetof(CompactVertex, normal)},
+        { 2, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(CompactVertex, uv)},
+      }
+    };
+  }
+  const char* vertexShaderFile = m_compactVertices ? "shaderCompact.vert.spv" : "shader.vert.spv";
+  const char* opaqueShaderFile = "shaderOpaque.frag.spv";
+  const char* alphaShaderFile = "shaderAlpha.frag.spv";
+  vector<VkVertexInputBindingDescription> inputBindings{ inputBinding };
+  vector<VkVertexInputAttributeDescription> attribs(inputAttribs.begin(), inputAttribs.end());
+  if (!m_instances.empty())
+  {
+    // インスタンスごとのデータはバインディング 1 から読む.
+    inputBindings.push_back(GetInstanceBinding(1));
+    AppendInstanceAttributes(attribs, 1, 3);
+    vertexShaderFile = "shaderInstanced.vert.spv";
+    opaqueShaderFile = "shaderOpaqueInstanced.frag.spv";
+    alphaShaderFile = "shaderAlphaInstanced.frag.spv";
+  }
+  VkPipelineVertexInputStateCreateInfo vertexInputCI{};
+  vertexInputCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  vertexInputCI.vertexBindingDescriptionCount = uint32_t(inputBindings.size());
+  vertexInputCI.pVertexBindingDescriptions = inputBindings.data();
+  vertexInputCI.vertexAttributeDescriptionCount = uint32_t(attribs.size());
+  vertexInputCI.pVertexAttributeDescriptions = attribs.data();
+
+
+  // ビューポートの設定
+  VkViewport viewport;
+  {
+    viewport.x = 0.0f;
+    viewport.y = float(m_swapchainExtent.height);
+    viewport.width = float(m_swapchainExtent.width);
+    viewport.height = -1.0f * float(m_swapchainExtent.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+  }
+  VkRect2D scissor = {
+    { 0,0},// offset
+    m_swapchainExtent
+  };
+  VkPipelineViewportStateCreateInfo viewportCI{};
+  viewportCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  viewportCI.viewportCount = 1;
+  viewportCI.pViewports = &viewport;
+  viewportCI.scissorCount = 1;
+  viewportCI.pScissors = &scissor;
+
+  // プリミティブトポロジー設定
+  VkPipelineInputAssemblyStateCreateInfo inputAssemblyCI{};
+  inputAssemblyCI.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+  inputAssemblyCI.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+
+  // ラスタライザーステート設定
+  VkPipelineRasterizationStateCreateInfo rasterizerCI{};
+  rasterizerCI.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+  rasterizerCI.polygonMode = VK_POLYGON_MODE_FILL;
+  rasterizerCI.cullMode = VK_CULL_MODE_NONE;
+  rasterizerCI.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+  rasterizerCI.lineWidth = 1.0f;
+
+  // マルチサンプル設定
+  VkPipelineMultisampleStateCreateInfo multisampleCI{};
+  multisampleCI.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+  multisampleCI.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+  // パイプラインレイアウト
+  VkPipelineLayoutCreateInfo pipelineLayoutCI{};
+  pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutCI.setLayoutCount = 1;
+  pipelineLayoutCI.pSetLayouts = &m_descriptorSetLayout;
+  VkPushConstantRange pushConstantRange{ VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshBounds) };
+  if (m_compactVertices)
+  {
+    pipelineLayoutCI.pushConstantRangeCount = 1;
+    pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+  }
+  vkCreatePipelineLayout(m_device, &pipelineLayoutCI, nullptr, &m_pipelineLayout);
+
+  // 不透明用: パイプラインの構築
+  {
+    // ブレンディングの設定
+    const auto colorWriteAll = \
+      VK_COLOR_COMPONENT_R_BIT | \
+      VK_COLOR_COMPONENT_G_BIT | \
+      VK_COLOR_COMPONENT_B_BIT | \
+      VK_COLOR_COMPONENT_A_BIT;
+    VkPipelineColorBlendAttachmentState blendAttachment{};
+    blendAttachment.blendEnable = VK_TRUE;
+    blendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    blendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+    blendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    blendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    blendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+    blendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+    blendAttachment.colorWriteMask = colorWriteAll;
+    VkPipelineColorBlendStateCreateInfo cbCI{};
+    cbCI.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    cbCI.attachmentCount = 1;
+    cbCI.pAttachments = &blendAttachment;
+
+    // デプスステンシルステート設定
+    VkPipelineDepthStencilStateCreateInfo depthStencilCI{};
+    depthStencilCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencilCI.depthTestEnable = VK_TRUE;
+    depthStencilCI.depthCompareOp = getDepthCompareOp();
+    depthStencilCI.depthWriteEnable = VK_TRUE;
+    depthStencilCI.stencilTestEnable = VK_FALSE;
+
+    // シェーダーバイナリの読み込み
+    vector<VkPipelineShaderStageCreateInfo> shaderStages
+    {
+      loadShaderModule(vertexShaderFile, VK_SHADER_STAGE_VERTEX_BIT),
+      loadShaderModule(opaqueShaderFile, VK_SHADER_STAGE_FRAGMENT_BIT)
+    };
+    // パイプラインの構築
+    VkGraphicsPipelineCreateInfo ci{};
+    ci.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    ci.stageCount = uint32_t(shaderStages.size());
+    ci.pStages = shaderStages.data();
+    ci.pInputAssemblyState = &inputAssemblyCI;
+    ci.pVertexInputState = &vertexInputCI;
+    ci.pRasterizationState = &rasterizerCI;
+    ci.pDepthStencilState = &depthStencilCI;
+    ci.pMultisampleState = &multisampleCI;
+    ci.pViewportState = &viewportCI;
+    ci.pColorBlendState = &cbCI;
+    ci.renderPass = m_renderPass;
+    ci.layout = m_pipelineLayout;
+    vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &ci, nullptr, &m_pipelineOpaque);
+
+    // ShaderModule はもう不要のため破棄
+    for (const auto& v : shaderStages)
+    {
+      vkDestroyShaderModule(m_device, v.module, nullptr);
+    }
+  }
+
+  // 半透明用: パイプラインの構築
+  {
+    // ブレンディングの設定
+    const auto colorWriteAll = \
+      VK_COLOR_COMPONENT_R_BIT | \
+      VK_COLOR_COMPONENT_G_BIT | \
+      VK_COLOR_COMPONENT_B_BIT | \
+      VK_COLOR_COMPONENT_A_BIT;
+    VkPipelineColorBlendAttachmentState blendAttachment{};
+    blendAttachment.blendEnable = VK_TRUE;
+    blendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    blendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    blendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    blendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    blendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+    blendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+    blendAttachment.colorWriteMask = colorWriteAll;
+    VkPipelineColorBlendStateCreateInfo cbCI{};
+    cbCI.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    cbCI.attachmentCount = 1;
+    cbCI.pAttachments = &blendAttachment;
+
+    // デプスステンシルステート設定
+    VkPipelineDepthStencilStateCreateInfo depthStencilCI{};
+    depthStencilCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencilCI.depthTestEnable = VK_TRUE;
+    depthStencilCI.depthCompareOp = getDepthCompareOp();
+    depthStencilCI.depthWriteEnable = VK_FALSE;
+    depthStencilCI.stencilTestEnable = VK_FALSE;
+
+    // シェーダーバイナリの読み込み
+    vector<VkPipelineShaderStageCreateInfo> shaderStages
+    {
+      loadShaderModule(vertexShaderFile, VK_SHADER_STAGE_VERTEX_BIT),
+      loadShaderModule(alphaShaderFile, VK_SHADER_STAGE_FRAGMENT_BIT)
+    };
+    // パイプラインの構築
+    VkGraphicsPipelineCreateInfo ci{};
+    ci.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    ci.stageCount = uint32_t(shaderStages.size());
+    ci.pStages = shaderStages.data();
+    ci.pInputAssemblyState = &inputAssemblyCI;
+    ci.pVertexInputState = &vertexInputCI;
+    ci.pRasterizationState = &rasterizerCI;
+    ci.pDepthStencilState = &depthStencilCI;
+    ci.pMultisampleState = &multisampleCI;
+    ci.pViewportState = &viewportCI;
+    ci.pColorBlendState = &cbCI;
+    ci.renderPass = m_renderPass;
+    ci.layout = m_pipelineLayout;
+    vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &ci, nullptr, &m_pipelineAlpha);
+
+    // ShaderModule はもう不要のため破棄
+    for (const auto& v : shaderStages)
+    {
+      vkDestroyShaderModule(m_device, v.module, nullptr);
+    }
+  }
+
+  // GPU 駆動描画はメッシュごとのプッシュ定数を渡せないため, 量子化した頂点とは併用しない.
+  if (m_gpuDriven && m_compactVertices)
+  {
+    OutputDebugStringA("GPU driven rendering is disabled with compact vertices\n");
+    m_gpuDriven = false;
+  }
+  if (m_gpuDriven)
+  {
+    prepareGpuDrivenRendering();
+  }
+
+  // 遮蔽クエリは GPU 駆動描画では使わない (描画コマンド自体を GPU で作るため).
+  if (m_occlusionQueries && (m_gpuDriven || !m_vkCmdBeginConditionalRendering))
+  {
+    OutputDebugStringA("Occlusion queries are disabled (GPU driven rendering or no conditional rendering)\n");
+    m_occlusionQueries = false;
+  }
+  if (m_occlusionQueries)
+  {
+    // 代理ボックス用: 深度テストのみ行い, カラー/デプスは書き込まない.
+    VkPushConstantRange proxyPushConstantRange{ VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ProxyBounds) };
+    VkPipelineLayoutCreateInfo proxyLayoutCI{};
+    proxyLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    proxyLayoutCI.setLayoutCount = 1;
+    proxyLayoutCI.pSetLayouts = &m_descriptorSetLayout;
+    proxyLayoutCI.pushConstantRangeCount = 1;
+    proxyLayoutCI.pPushConstantRanges = &proxyPushConstantRange;
+    vkCreatePipelineLayout(m_device, &proxyLayoutCI, nullptr, &m_proxyPipelineLayout);
+
+    VkPipelineVertexInputStateCreateInfo proxyInputCI{};
+    proxyInputCI.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    VkPipelineColorBlendAttachmentState blendAttachment{};
+    blendAttachment.colorWriteMask = 0;
+    VkPipelineColorBlendStateCreateInfo cbCI{};
+    cbCI.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    cbCI.attachmentCount = 1;
+    cbCI.pAttachments = &blendAttachment;
+    VkPipelineDepthStencilStateCreateInfo depthStencilCI{};
+    depthStencilCI.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencilCI.depthTestEnable = VK_TRUE;
+    depthStencilCI.depthCompareOp = getDepthCompareOp();
+    depthStencilCI.depthWriteEnable = VK_FALSE;
+
+    // フラグメントシェーダーは不要 (深度テストを通ったサンプル数だけを数える)
+    auto shaderStage = loadShaderModule("shaderProxy.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
+    VkGraphicsPipelineCreateInfo ci{};
+    ci.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    ci.stageCount = 1;
+    ci.pStages = &shaderStage;
+    ci.pInputAssemblyState = &inputAssemblyCI;
+    ci.pVertexInputState = &proxyInputCI;
+    ci.pRasterizationState = &rasterizerCI;
+    ci.pDepthStencilState = &depthStencilCI;
+    ci.pMultisampleState = &multisampleCI;
+    ci.pViewportState = &viewportCI;
+    ci.pColorBlendState = &cbCI;
+    ci.renderPass = m_renderPass;
+    ci.layout = m_proxyPipelineLayout;
+    vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &ci, nullptr, &m_proxyPipeline);
+    // カメラがボックス内にある場合は, 必ず見えるように深度テストを行わない.
+    depthStencilCI.depthTestEnable = VK_FALSE;
+    vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &ci, nullptr, &m_proxyPipelineNoDepth);
+    vkDestroyShaderModule(m_device, shaderStage.module, nullptr);
+
+    prepareOcclusionQueries();
+  }
+}
+void ModelApp::cleanup()
+{
+  // 調理中のワーカースレッドを待つ. 転送し終えていないキャッシュの取り込みも解放する.
+  if (m_loadTask.valid())
+  {
+    m_loadTask.wait();
+  }
+  if (m_cacheFile.isOpen())
+  {
+    releaseHostMemory(m_cacheFile.data());
+    m_cacheFile.close();
+  }
+
+  for (auto& v : m_uniformBuffers)
+  {
+    vkDestroyBuffer(m_device, v.buffer, nullptr);
+    freeMemory(v.memory);
+  }
+  vkDestroySampler(m_device, m_sampler, nullptr);
+
+  vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+  vkDestroyPipeline(m_device, m_pipelineOpaque, nullptr);
+  vkDestroyPipeline(m_device, m_pipelineAlpha, nullptr);
+
+  if (m_instanceBuffer.buffer != VK_NULL_HANDLE)
+  {
+    vkDestroyBuffer(m_device, m_instanceBuffer.buffer, nullptr);
+    freeMemory(m_instanceBuffer.memory);
+  }
+
+  if (m_meshletCulling)
+  {
+    for (auto& v : m_indirectBuffers)
+    {
+      vkDestroyBuffer(m_device, v.buffer, nullptr);
+      freeMemory(v.memory);
+    }
+    destroyComputePass(m_meshletCullPass);
+  }
+  if (m_gpuDriven)
+  {
+    for (auto* buffers : { &m_drawCommandBuffers, &m_drawCountBuffers })
+    {
+      for (auto& v : *buffers)
+      {
+        vkDestroyBuffer(m_device, v.buffer, nullptr);
+        freeMemory(v.memory);
+      }
+    }
+    vkDestroyBuffer(m_device, m_drawDataBuffer.buffer, nullptr);
+    freeMemory(m_drawDataBuffer.memory);
+    destroyComputePass(m_gpuCullPass);
+  }
+  if (m_occlusionQueries)
+  {
+    reportOcclusionQueries();
+    for (auto& v : m_predicateBuffers)
+    {
+      vkDestroyBuffer(m_device, v.buffer, nullptr);
+      freeMemory(v.memory);
+    }
+    vkDestroyQueryPool(m_device, m_queryPool, nullptr);
+    vkDestroyPipeline(m_device, m_proxyPipeline, nullptr);
+    vkDestroyPipeline(m_device, m_proxyPipelineNoDepth, nullptr);
+    vkDestroyPipelineLayout(m_device, m_proxyPipelineLayout, nullptr);
+  }
+  if (m_occlusionCulling)
+  {
+    for (auto* buffers : { &m_earlyCommandBuffers, &m_earlyCountBuffers, &m_occlusionStatsBuffers })
+    {
+      for (auto& v : *buffers)
+      {
+        vkDestroyBuffer(m_device, v.buffer, nullptr);
+        freeMemory(v.memory);
+      }
+    }
+    vkDestroyBuffer(m_device, m_visibilityBuffer.buffer, nullptr);
+    freeMemory(m_visibilityBuffer.memory);
+    destroyComputePass(m_hizCullPass);
+    destroyComputePass(m_pyramidPass);
+    for (auto& v : m_pyramidLevelViews)
+    {
+      vkDestroyImageView(m_device, v, nullptr);
+    }
+    vkDestroyImageView(m_device, m_depthPyramid.view, nullptr);
+    vkDestroyImage(m_device, m_depthPyramid.image, nullptr);
+    freeMemory(m_depthPyramid.memory);
+    vkDestroySampler(m_device, m_pyramidSampler, nullptr);
+    vkDestroyRenderPass(m_device, m_earlyRenderPass, nullptr);
+  }
+
+  for (auto* v : { &m_geometry.vertexBuffer, &m_geometry.indexBuffer16, &m_geometry.indexBuffer32, &m_geometry.meshletBuffer })
+  {
+    freeMemory(v->memory);
+    vkDestroyBuffer(m_device, v->buffer, nullptr);
+  }
+  for (auto& mesh : m_model.meshes)
+  {
+    mesh.descriptorSet.clear();
+  }
+  for (auto& material : m_model.materials)
+  {
+    freeMemory(material.texture.memory);
+    vkDestroyImage(m_device, material.texture.image, nullptr);
+    vkDestroyImageView(m_device, material.texture.view, nullptr);
+  }
+  freeMemory(m_placeholderTexture.memory);
+  vkDestroyImage(m_device, m_placeholderTexture.image, nullptr);
+  vkDestroyImageView(m_device, m_placeholderTexture.view, nullptr);
+  vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
+  vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, nullptr);
+}
+
+void ModelApp::makeCommandBeforeRenderPass(VkCommandBuffer command)
+{
+  if (m_loadStage == LoadStage::Cooking || m_loadStage == LoadStage::Streaming)
+  {
+    updateLoading();
+  }
+
+  // ユニフォームバッファの中身を更新する.
+  auto& shaderParam = m_sceneParameters;
+  shaderParam.mtxWorld = glm::identity<glm::mat4>();
+  shaderParam.mtxView = lookAtRH(vec3(0.0f, 1.5f, -1.0f), vec3(0.0f, 1.25f, 0.0f), vec3(0.0f, 1.0f, 0.0f));
+  shaderParam.mtxProj = MakePerspective(glm::radians(45.0f), 640.0f / 480, 0.01f, 100.0f, m_reversedZ);
+  {
+    auto memory = m_uniformBuffers[m_imageIndex].memory;
+    void* p;
+    vkMapMemory(m_device, memory, 0, VK_WHOLE_SIZE, 0, &p);
+    memcpy(p, &shaderParam, sizeof(shaderParam));
+    vkUnmapMemory(m_device, memory);
+  }
+
+  // モデル空間での視錐台平面
+  auto pvw = shaderParam.mtxProj * shaderParam.mtxView * shaderParam.mtxWorld;
+  auto frustum = ExtractFrustumPlanes(&pvw[0][0]);
+  // メッシュ単位の視錐台カリング
+  if (m_frustumCulling)
+  {
+    m_visibleMeshCount = m_meshBoxes.cull(frustum, m_meshVisible.data());
+  }
+
+  if (m_meshletCulling && !m_geometry.meshlets.empty())
+  {
+    recordMeshletCulling(command, frustum);
+  }
+  if (m_occlusionCulling)
+  {
+    recordOcclusionCulling(command, frustum);
+  }
+  else if (m_gpuDriven)
+  {
+    recordGpuCulling(command, frustum);
+  }
+  if (m_occlusionQueries)
+  {
+    resolveOcclusionQueries(command);
+  }
+}
+
+void ModelApp::makeCommand(VkCommandBuffer command)
+{
+  using namespace Microsoft::glTF;
+
+  // 一定フレームごとに平均フレーム時間を出力する.
+  const uint32_t FrameTimeInterval = 300;
+  auto now = chrono::steady_clock::now();
+  if (m_frameCount == 0)
+  {
+    m_frameTimeStart = now;
+  }
+  if (++m_frameCount > FrameTimeInterval)
+  {
+    auto elapsed = chrono::duration<double, milli>(now - m_frameTimeStart);
+    stringstream ss;
+    ss << "Frame time: " << elapsed.count() / FrameTimeInterval << " ms";
+    // 直前に計測できたフレームの値
+    ss << " (CPU " << m_cpuFrameTime << " ms, GPU " << m_gpuFrameTime << " ms)";
+    if (!m_instances.empty())
+    {
+      ss << ", instances " << m_instanceCount;
+    }
+    if (!m_gpuDriven)
+    {
+      ss << ", binds " << m_bindCount << " (saved " << m_bindSkipped << ")";
+    }
+    if (m_frustumCulling)
+    {
+      ss << ", visible meshes " << m_visibleMeshCount << "/" << m_model.meshes.size();
+    }
+    if (m_occlusionCulling)
+    {
+      // 直前に読み戻したフレームの値
+      ss << ", draws early " << m_occlusionStats[OcclusionDrawnEarly]
+        << " late " << m_occlusionStats[OcclusionDrawnLate]
+        << " occluded " << m_occlusionStats[OcclusionOccluded]
+        << " outside frustum " << m_occlusionStats[OcclusionOutsideFrustum];
+    }
+    if (m_occlusionQueries)
+    {
+      ss << ", occluded heavy meshes " << m_queryOccludedCount << "/" << m_queryMeshes.size();
+    }
+    ss << endl;
+    OutputDebugStringA(ss.str().c_str());
+    m_frameTimeStart = now;
+    m_frameCount = 1;
+  }
+
+  // 非同期読み込みでまだ調理が終わっていない (または失敗した) 場合は何も描かない.
+  if (m_geometry.vertexBuffer.buffer == VK_NULL_HANDLE)
+  {
+    return;
+  }
+
+  // 全メッシュ共通のバッファを一度だけセット
+  // インデックスバッファは型が切り替わるときのみセットし直す.
+  VkDeviceSize offset = 0;
+  vkCmdBindVertexBuffers(command, 0, 1, &m_geometry.vertexBuffer.buffer, &offset);
+  if (!m_instances.empty())
+  {
+    vkCmdBindVertexBuffers(command, 1, 1, &m_instanceBuffer.buffer, &offset);
+  }
+  if (m_gpuDriven)
+  {
+    drawGpuDriven(command, m_drawCommandBuffers[m_imageIndex].buffer, m_drawCountBuffers[m_imageIndex].buffer);
+    return;
+  }
+
+  // 描画するメッシュをキューに積んで状態ごとにまとめる.
+  // パスは従来と同じく 不透明 -> アルファテスト -> 半透明 の順.
+  m_renderQueue.clear();
+  auto viewWorld = m_sceneParameters.mtxView * m_sceneParameters.mtxWorld;
+  for (size_t meshIndex = 0; meshIndex < m_model.meshes.size(); ++meshIndex)
+  {
+    const auto& mesh = m_model.meshes[meshIndex];
+    // ジオメトリをまだ転送していないメッシュと, 視錐台の外にあるメッシュは描画しない.
+    if (!mesh.resident || (m_frustumCulling && !m_meshVisible[meshIndex]))
+    {
+      continue;
+    }
+    uint32_t pass = 0;
+    switch (m_model.materials[mesh.materialIndex].alphaMode)
+    {
+    case ALPHA_OPAQUE:
+      pass = 0;
+      break;
+    case ALPHA_MASK:
+      pass = 1;
+      break;
+    case ALPHA_BLEND:
+      pass = 2;
+      break;
+    default:
+      continue;
+    }
+    // パイプライン番号: 0 = m_pipelineOpaque, 1 = m_pipelineAlpha
+    uint32_t pipeline = pass == 2 ? 1 : 0;
+    auto center = (mesh.boundsMin + mesh.boundsMax) * 0.5f;
+    auto depth = length(vec3(viewWorld * vec4(center, 1.0f)));
+    auto key = MakeSortKey(pass, pipeline, uint32_t(mesh.materialIndex), depth, pass == 2);
+    m_renderQueue.push(key, uint32_t(meshIndex));
+  }
+  m_renderQueue.sort();
+
+  // 直前の描画と同じ状態のバインドは省く.
+  auto boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+  VkPipeline boundPipeline = VK_NULL_HANDLE;
+  VkDescriptorSet boundDescriptorSet = VK_NULL_HANDLE;
+  m_bindCount = 0;
+  m_bindSkipped = 0;
+  for (const auto& packet : m_renderQueue.packets())
+  {
+    auto meshIndex = packet.index;
+    const auto& mesh = m_model.meshes[meshIndex];
+
+    // モードに応じて使用するパイプラインを変える.
+    auto pipeline = m_model.materials[mesh.materialIndex].alphaMode == ALPHA_BLEND ? m_pipelineAlpha : m_pipelineOpaque;
+    if (pipeline != boundPipeline)
+    {
+      vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+      boundPipeline = pipeline;
+      ++m_bindCount;
+    }
+    else
+    {
+      ++m_bindSkipped;
+    }
+
+    if (mesh.indexType != boundIndexType)
+    {
+      auto& indexBuffer = mesh.indexType == VK_INDEX_TYPE_UINT16 ? m_geometry.indexBuffer16 : m_geometry.indexBuffer32;
+      vkCmdBindIndexBuffer(command, indexBuffer.buffer, 0, mesh.indexType);
+      boundIndexType = mesh.indexType;
+      ++m_bindCount;
+    }
+    else
+    {
+      ++m_bindSkipped;
+    }
+
+    // ディスクリプタセットをセット (同じマテリアルのメッシュで共有している)
+    auto descriptorSet = mesh.descriptorSet[m_imageIndex];
+    if (descriptorSet != boundDescriptorSet)
+    {
+      vkCmdBindDescriptorSets(command, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+      boundDescriptorSet = descriptorSet;
+      ++m_bindCount;
+    }
+    else
+    {
+      ++m_bindSkipped;
+    }
+    if (m_compactVertices)
+    {
+      MeshBounds bounds{};
+      bounds.boundsMin = vec4(mesh.boundsMin, 0.0f);
+      bounds.boundsScale = vec4(mesh.boundsMax - mesh.boundsMin, 0.0f);
+      vkCmdPushConstants(command, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(bounds), &bounds);
+    }
+
+    // クエリ対象のメッシュは, 前のフレームでボックスが見えていた場合のみ GPU 側で描画する.
+    // 前回視錐台外で判定していないものは常に描く.
+    auto querySlot = m_occlusionQueries ? m_meshQuerySlots[meshIndex] : -1;
+    bool conditional = querySlot >= 0 && m_queryTested[querySlot];
+    if (conditional)
+    {
+      VkConditionalRenderingBeginInfoEXT conditionalBI{};
+      conditionalBI.sType = VK_STRUCTURE_TYPE_CONDITIONAL_RENDERING_BEGIN_INFO_EXT;
+      conditionalBI.buffer = m_predicateBuffers[m_imageIndex].buffer;
+      conditionalBI.offset = VkDeviceSize(querySlot) * sizeof(uint32_t);
+      m_vkCmdBeginConditionalRendering(command, &conditionalBI);
+    }
+    drawMesh(command, mesh);
+    if (conditional)
+    {
+      m_vkCmdEndConditionalRendering(command);
+    }
+  }
+
+  if (m_occlusionQueries)
+  {
+    drawOcclusionProxies(command);
+  }
+}
+
+void ModelApp::drawMesh(VkCommandBuffer command, const ModelMesh& mesh)
+{
+  // 画面上で十分小さければ簡略化したレベルを描画する.
+  auto lodLevel = selectLod(mesh);
+  if (lodLevel > 0)
+  {
+    const auto& lod = mesh.lods[lodLevel - 1];
+    vkCmdDrawIndexed(command, lod.indexCount, m_instanceCount, lod.firstIndex, mesh.vertexOffset, 0);
+    return;
+  }
+
+  if (m_meshletCulling && mesh.meshletCount > 0)
+  {
+    // カリング結果の間接描画コマンドでメッシュレットごとに描画
+    auto indirectBuffer = m_indirectBuffers[m_imageIndex].buffer;
+    const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    VkDeviceSize indirectOffset = VkDeviceSize(mesh.firstMeshlet) * stride;
+    if (m_enabledFeatures.multiDrawIndirect)
+    {
+      vkCmdDrawIndexedIndirect(command, indirectBuffer, indirectOffset, mesh.meshletCount, stride);
+    }
+    else
+    {
+      for (uint32_t i = 0; i < mesh.meshletCount; ++i)
+      {
+        vkCmdDrawIndexedIndirect(command, indirectBuffer, indirectOffset + i * stride, 1, stride);
+      }
+    }
+    return;
+  }
+
+  // このメッシュを描画 (プール内のオフセットを指定)
+  vkCmdDrawIndexed(command, mesh.indexCount, m_instanceCount, mesh.firstIndex, mesh.vertexOffset, 0);
+}
+
+CookSettings ModelApp::getCookSettings() const
+{
+  // キャッシュの内容が変わる設定. プリミティブの最適化は全スレッドで並列に行う.
+  return CookSettings{ m_compactVertices, m_optimizeMeshes, m_meshletCulling, m_generateLods, 0 };
+}
+
+bool ModelApp::cookModel(const wchar_t* modelFileName, CookedModelWriter& writer, const CookSettings& settings)
+{
+  CookStats stats{};
+  string error;
+  if (!CookModel(modelFileName, writer, settings, &stats, &error))
+  {
+    OutputDebugStringA(("Failed to cook the model: " + error + "\n").c_str());
+    return false;
+  }
+  stringstream ss;
+  ss << stats.report << fixed << setprecision(1)
+    << "Cooked in " << stats.parseTime + stats.geometryTime + stats.textureTime + stats.writeTime << " ms (parse " << stats.parseTime
+    << ", geometry " << stats.geometryTime << ", textures " << stats.textureTime << ", write " << stats.writeTime << ")" << endl;
+  OutputDebugStringA(ss.str().c_str());
+  return true;
+}
+
+const CookedModelHeader* ModelApp::openModelCache(const wchar_t* cacheFileName, uint64_t sourceHash, uint32_t options)
+{
+  if (!m_cacheFile.open(cacheFileName))
+  {
+    return nullptr;
+  }
+  auto cooked = ValidateCookedModel(m_cacheFile.data(), m_cacheFile.size(), sourceHash, options);
+  auto vertexStride = m_compactVertices ? sizeof(CompactVertex) : sizeof(Vertex);
+  if (cooked && (cooked->vertexStride != vertexStride || cooked->meshletStride != sizeof(MeshletInfo)))
+  {
+    cooked = nullptr;
+  }
+  if (cooked == nullptr)
+  {
+    m_cacheFile.close();
+  }
+  return cooked;
+}
+
+const CookedModelHeader* ModelApp::acquireCookedModel(const std::wstring& modelFileName)
+{
+  // モデルは調理済みの形式 (modelcooker.h) にしてから転送する.
+  // 元ファイルの内容のハッシュと設定が一致するキャッシュがあれば, 解析や最適化を省いてそのまま使う.
+  // 無い場合や古い場合は調理してキャッシュへ書き出し, それをマップして使う.
+  // ワーカースレッドから呼ばれる場合があるため, Vulkan のオブジェクトや描画で使うメンバーには触れない.
+  const auto cookSettings = getCookSettings();
+  const auto cacheFileName = GetCookedCacheFileName(modelFileName, cookSettings.options());
+  uint64_t sourceHash = 0;
+  HashSourceFile(modelFileName.c_str(), &sourceHash);
+  const CookedModelHeader* cooked = nullptr;
+  m_cookedFrom = "from cache";
+  if (m_useModelCache)
+  {
+    cooked = openModelCache(cacheFileName.c_str(), sourceHash, cookSettings.options());
+    if (cooked == nullptr && m_cookWriter.open(cacheFileName.c_str()) && cookModel(modelFileName.c_str(), m_cookWriter, cookSettings))
+    {
+      cooked = openModelCache(cacheFileName.c_str(), sourceHash, cookSettings.options());
+      m_cookedFrom = "cooked";
+    }
+  }
+  if (cooked == nullptr)
+  {
+    // キャッシュを使わない (書き出せない) 場合は, メモリ上で調理したものを使う.
+    if (m_cookWriter.openMemory() && cookModel(modelFileName.c_str(), m_cookWriter, cookSettings))
+    {
+      cooked = ValidateCookedModel(m_cookWriter.data(), size_t(m_cookWriter.size()), sourceHash, cookSettings.options());
+    }
+    m_cookedFrom = m_useModelCache ? "cooked in memory" : "cache disabled";
+  }
+  return cooked;
+}
+
+void ModelApp::loadCookedModel(const uint8_t* data, const CookedModelHeader& header, bool streaming)
+{
+  using namespace Microsoft::glTF;
+  static_assert(sizeof(MeshletInfo) == sizeof(CookedMeshlet), "MeshletInfo layout must match the cooked model");
+
+  // 頂点/インデックス/テクスチャは調理済みのデータから直接転送する.
+  // 分けて転送する場合は領域だけを確保し, 中身は streamModel() でメッシュごとに転送する.
+  const VkBufferUsageFlags streamingUsage = streaming ? VK_BUFFER_USAGE_TRANSFER_DST_BIT : 0;
+  m_geometry.vertexCount = uint32_t(header.vertices.size / header.vertexStride);
+  m_geometry.vertexBuffer = createBuffer(uint32_t(header.vertices.size), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | streamingUsage,
+    MemoryUsage::GpuOnly, MemoryCategory::Mesh, streaming ? nullptr : GetCookedBlock<void>(data, header.vertices));
+  for (auto* v : { &m_geometry.indexBuffer16, &m_geometry.indexBuffer32 })
+  {
+    const auto& block = v == &m_geometry.indexBuffer16 ? header.indices16 : header.indices32;
+    *v = BufferObject{};
+    if (block.size > 0)
+    {
+      *v = createBuffer(uint32_t(block.size), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | streamingUsage,
+        MemoryUsage::GpuOnly, MemoryCategory::Mesh, streaming ? nullptr : GetCookedBlock<void>(data, block));
+    }
+  }
+  // メッシュレットはカリングの準備でも参照するため CPU 側にも持つ.
+  const auto* meshlets = GetCookedBlock<MeshletInfo>(data, header.meshlets);
+  m_geometry.meshlets.assign(meshlets, meshlets + header.meshlets.size / sizeof(MeshletInfo));
+  m_geometry.meshletBuffer = BufferObject{};
+  if (!m_geometry.meshlets.empty())
+  {
+    m_geometry.meshletBuffer = createBuffer(uint32_t(header.meshlets.size), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      MemoryUsage::GpuOnly, MemoryCategory::Mesh, meshlets);
+  }
+
+  const auto* lods = GetCookedBlock<CookedLod>(data, header.lods);
+  const auto* meshes = GetCookedBlock<CookedMesh>(data, header.meshes);
+  const auto meshCount = header.meshes.size / sizeof(CookedMesh);
+  for (size_t i = 0; i < meshCount; ++i)
+  {
+    const auto& src = meshes[i];
+    ModelMesh mesh;
+    mesh.indexType = src.indexType == 0 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+    mesh.firstIndex = src.firstIndex;
+    mesh.vertexOffset = src.vertexOffset;
+    mesh.vertexCount = src.vertexCount;
+    mesh.indexCount = src.indexCount;
+    mesh.boundsMin = vec3(src.boundsMin[0], src.boundsMin[1], src.boundsMin[2]);
+    mesh.boundsMax = vec3(src.boundsMax[0], src.boundsMax[1], src.boundsMax[2]);
+    mesh.firstMeshlet = src.firstMeshlet;
+    mesh.meshletCount = src.meshletCount;
+    for (uint32_t l = 0; l < src.lodCount; ++l)
+    {
+      const auto& lod = lods[src.firstLod + l];
+      mesh.lods.push_back(MeshLod{ lod.firstIndex, lod.indexCount, lod.error });
+    }
+    mesh.materialIndex = src.materialIndex;
+    mesh.resident = !streaming;
+    m_meshBoxes.add(&mesh.boundsMin.x, &mesh.boundsMax.x);
+    m_meshVisible.push_back(1);
+    m_model.meshes.push_back(mesh);
+  }
+
+  const auto* materials = GetCookedBlock<CookedMaterial>(data, header.materials);
+  const auto materialCount = header.materials.size / sizeof(CookedMaterial);
+  for (size_t i = 0; i < materialCount; ++i)
+  {
+    const auto& src = materials[i];
+    Material material{};
+    material.alphaMode = AlphaMode(src.alphaMode);
+    if (!streaming)
+    {
+      material.texture = createTexture(src.width, src.height, data + header.textures.offset + src.textureOffset);
+    }
+    m_model.materials.push_back(material);
+  }
+  if (!streaming)
+  {
+    m_residentMeshCount = uint32_t(m_model.meshes.size());
+    m_residentTextureCount = uint32_t(m_model.materials.size());
+  }
+}
+
+void ModelApp::updateLoading()
+{
+  if (m_loadStage == LoadStage::Cooking)
+  {
+    // 調理が終わるまではフレームを止めずに待つ.
+    if (m_loadTask.wait_for(chrono::seconds(0)) != future_status::ready)
+    {
+      return;
+    }
+    m_cookedHeader = m_loadTask.get();
+    if (m_cookedHeader == nullptr)
+    {
+      OutputDebugStringA("Failed to load the model\n");
+      m_loadStage = LoadStage::Failed;
+      return;
+    }
+    {
+      auto elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - m_loadStart);
+      stringstream ss;
+      ss << "Model cooked in background: " << elapsed.count() << " ms (" << m_cookedFrom << ")" << endl;
+      OutputDebugStringA(ss.str().c_str());
+    }
+
+    // バッファとメッシュの情報だけを作る. ディスクリプタセットは代わりのテクスチャを指した状態で用意する.
+    if (m_cacheFile.isOpen())
+    {
+      importHostMemory(m_cacheFile.data(), m_cacheFile.size());
+    }
+    loadCookedModel(reinterpret_cast<const uint8_t*>(m_cookedHeader), *m_cookedHeader, true);
+    prepareDescriptorPool();
+    prepareDescriptorSet();
+    m_loadStage = LoadStage::Streaming;
+  }
+
+  streamModel();
+  // すべての転送が完了し, 全画像のディスクリプタセットが本来のテクスチャを指したら読み込み完了.
+  bool descriptorsResident = refreshMaterialDescriptors();
+  if (descriptorsResident && m_residentMeshCount == m_model.meshes.size() &&
+    m_residentTextureCount == m_model.materials.size() && isUploadCompleted(m_streamTicket))
+  {
+    finishLoading();
+  }
+}
+
+void ModelApp::streamModel()
+{
+  if (m_residentMeshCount == m_model.meshes.size() && m_residentTextureCount == m_model.materials.size())
+  {
+    return;
+  }
+  // 1 フレームで転送する量は m_streamingBudget バイトまで (最低 1 つは転送する).
+  // 転送は描画と同じキューへ先に送信されるため, 完了を待たずにこのフレームから描画に使える.
+  const auto* data = reinterpret_cast<const uint8_t*>(m_cookedHeader);
+  const auto& header = *m_cookedHeader;
+  VkDeviceSize uploaded = 0;
+  auto hasBudget = [&]() { return uploaded == 0 || uploaded < m_streamingBudget; };
+  beginUploadBatch();
+
+  // 先にジオメトリを転送する. メッシュ単位で描画できるようになる.
+  while (m_residentMeshCount < m_model.meshes.size() && hasBudget())
+  {
+    auto& mesh = m_model.meshes[m_residentMeshCount];
+    const VkDeviceSize vertexStride = header.vertexStride;
+    const VkDeviceSize vertexOffset = vertexStride * uint32_t(mesh.vertexOffset);
+    const VkDeviceSize vertexSize = vertexStride * mesh.vertexCount;
+    if (vertexSize > 0)
+    {
+      uploadBuffer(m_geometry.vertexBuffer.buffer, vertexOffset, data + header.vertices.offset + vertexOffset, vertexSize);
+      uploaded += vertexSize;
+    }
+    // 簡略化レベルのインデックスも同じプールにある.
+    const bool index16 = mesh.indexType == VK_INDEX_TYPE_UINT16;
+    const VkDeviceSize indexStride = index16 ? sizeof(uint16_t) : sizeof(uint32_t);
+    const auto& indexBlock = index16 ? header.indices16 : header.indices32;
+    auto indexBuffer = index16 ? m_geometry.indexBuffer16.buffer : m_geometry.indexBuffer32.buffer;
+    auto uploadIndices = [&](uint32_t firstIndex, uint32_t indexCount) {
+      const VkDeviceSize offset = indexStride * firstIndex;
+      const VkDeviceSize size = indexStride * indexCount;
+      if (size > 0)
+      {
+        uploadBuffer(indexBuffer, offset, data + indexBlock.offset + offset, size);
+        uploaded += size;
+      }
+    };
+    uploadIndices(mesh.firstIndex, mesh.indexCount);
+    for (const auto& lod : mesh.lods)
+    {
+      uploadIndices(lod.firstIndex, lod.indexCount);
+    }
+    mesh.resident = true;
+    ++m_residentMeshCount;
+  }
+
+  // ジオメトリがすべて揃ってからテクスチャを転送する.
+  const auto* materials = GetCookedBlock<CookedMaterial>(data, header.materials);
+  while (m_residentMeshCount == m_model.meshes.size() && m_residentTextureCount < m_model.materials.size() && hasBudget())
+  {
+    const auto& src = materials[m_residentTextureCount];
+    auto& material = m_model.materials[m_residentTextureCount];
+    material.texture = createTexture(src.width, src.height, data + header.textures.offset + src.textureOffset);
+    uploaded += src.textureSize;
+    ++m_residentTextureCount;
+  }
+  m_streamTicket = endUploadBatch();
+}
+
+bool ModelApp::refreshMaterialDescriptors()
+{
+  // 届いたテクスチャをディスクリプタセットへ反映する.
+  // 書き換えるのは今回のスワップチェイン画像のセットのみ (前回これを使ったコマンドの完了は待ち済み).
+  for (const auto& mesh : m_model.meshes)
+  {
+    auto& material = m_model.materials[mesh.materialIndex];
+    if (material.texture.view != VK_NULL_HANDLE && !material.descriptorResident[m_imageIndex])
+    {
+      writeTextureDescriptor(mesh.descriptorSet[m_imageIndex], material.texture.view);
+      material.descriptorResident[m_imageIndex] = 1;
+    }
+  }
+  // 全画像のセットが反映済みか
+  for (const auto& material : m_model.materials)
+  {
+    if (find(material.descriptorResident.begin(), material.descriptorResident.end(), uint8_t(0)) != material.descriptorResident.end())
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+void ModelApp::writeTextureDescriptor(VkDescriptorSet descriptorSet, VkImageView view)
+{
+  VkDescriptorImageInfo  descImage{};
+  descImage.imageView = view;
+  descImage.sampler = m_sampler;
+  descImage.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+  VkWriteDescriptorSet tex{};
+  tex.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  tex.dstBinding = 1;
+  tex.descriptorCount = 1;
+  tex.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  tex.pImageInfo = &descImage;
+  tex.dstSet = descriptorSet;
+  vkUpdateDescriptorSets(m_device, 1, &tex, 0, nullptr);
+}
+
+void ModelApp::finishLoading()
+{
+  // 転送元のキャッシュと調理結果はもう不要.
+  if (m_cacheFile.isOpen())
+  {
+    releaseHostMemory(m_cacheFile.data());
+    m_cacheFile.close();
+  }
+  m_cookWriter.cancel();
+  m_cookedHeader = nullptr;
+  m_loadStage = LoadStage::Completed;
+
+  auto elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - m_loadStart);
+  stringstream ss;
+  // キャッシュの有無による起動時間の比較用
+  ss << "Model load time: " << elapsed.count() << " ms ("
+    << m_cookedFrom << (m_asyncLoading ? ", async" : "") << ")" << endl;
+  OutputDebugStringA(ss.str().c_str());
+  // テクスチャ転送方式による違いの比較用
+  reportTextureUpload();
+}
+
+void ModelApp::prepareUniformBuffers()
+{
+  m_uniformBuffers.resize(m_swapchainViews.size());
+  for (auto& v : m_uniformBuffers)
+  {
+    v = createBuffer(sizeof(ShaderParameters), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, MemoryUsage::Streaming, MemoryCategory::Uniform, nullptr );
+  }
+}
+void ModelApp::prepareDescriptorSetLayout()
+{
+  vector<VkDescriptorSetLayoutBinding> bindings;
+  VkDescriptorSetLayoutBinding bindingUBO{}, bindingTex{};
+  bindingUBO.binding = 0;
+  bindingUBO.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  bindingUBO.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  bindingUBO.descriptorCount = 1;
+  bindings.push_back(bindingUBO);
+  
+  bindingTex.binding = 1;
+  bindingTex.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  bindingTex.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+  bindingTex.descriptorCount = 1;
+  bindings.push_back(bindingTex);
+
+  VkDescriptorSetLayoutCreateInfo ci{};
+  ci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  ci.bindingCount = uint32_t(bindings.size());
+  ci.pBindings = bindings.data();
+  vkCreateDescriptorSetLayout(m_device, &ci, nullptr, &m_descriptorSetLayout);
+}
+
+void ModelApp::prepareDescriptorPool()
+{
+  const uint32_t count = 100;
+  array<VkDescriptorPoolSize, 2> descPoolSize;
+  descPoolSize[0].descriptorCount = count;
+  descPoolSize[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  descPoolSize[1].descriptorCount = count;
+  descPoolSize[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+  uint32_t maxDescriptorCount = uint32_t(m_swapchainImages.size() * m_model.meshes.size());
+  VkDescriptorPoolCreateInfo ci{};
+  ci.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  ci.maxSets = maxDescriptorCount;
+  ci.poolSizeCount = uint32_t(descPoolSize.size());
+  ci.pPoolSizes = descPoolSize.data();
+  vkCreateDescriptorPool(m_device, &ci, nullptr, &m_descriptorPool);
+}
+
+void ModelApp::prepareDescriptorSet()
+{
+  vector<VkDescriptorSetLayout> layouts;
+  for (int i = 0; i<int(m_uniformBuffers.size()); ++i)
+  {
+    layouts.push_back(m_descriptorSetLayout);
+  }
+
+  // ディスクリプタセットの内容はマテリアルで決まるため, 同じマテリアルのメッシュで共有する.
+  // (描画キューでマテリアルごとにまとめた際にバインドを省けるようにする)
+  vector<const ModelMesh*> materialOwners(m_model.materials.size(), nullptr);
+  for (auto& mesh : m_model.meshes)
+  {
+    auto& owner = materialOwners[mesh.materialIndex];
+    if (owner != nullptr)
+    {
+      mesh.descriptorSet = owner->descriptorSet;
+      continue;
+    }
+    owner = &mesh;
+
+    // ディスクリプタセットの確保
+    VkDescriptorSetAllocateInfo ai{};
+    ai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    ai.descriptorPool = m_descriptorPool;
+    ai.descriptorSetCount = uint32_t(m_uniformBuffers.size());
+    ai.pSetLayouts = layouts.data();
+    mesh.descriptorSet.resize(m_uniformBuffers.size());
+    vkAllocateDescriptorSets(m_device, &ai, mesh.descriptorSet.data());
+
+    // ディスクリプタセットへ書き込み.
+    // テクスチャがまだ届いていなければ代わりのテクスチャを指しておく.
+    auto& material = m_model.materials[mesh.materialIndex];
+    auto textureView = material.texture.view != VK_NULL_HANDLE ? material.texture.view : m_placeholderTexture.view;
+    material.descriptorResident.assign(m_uniformBuffers.size(), material.texture.view != VK_NULL_HANDLE ? 1 : 0);
+    for (int i = 0; i<int(m_uniformBuffers.size()); ++i)
+    {
+      VkDescriptorBufferInfo descUBO{};
+      descUBO.buffer = m_uniformBuffers[i].buffer;
+      descUBO.offset = 0;
+      descUBO.range = VK_WHOLE_SIZE;
+
+      VkDescriptorImageInfo  descImage{};
+      descImage.imageView = textureView;
+      descImage.sampler = m_sampler;
+      descImage.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+      VkWriteDescriptorSet ubo{};
+      ubo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      ubo.dstBinding = 0;
+      ubo.descriptorCount = 1;
+      ubo.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+      ubo.pBufferInfo = &descUBO;
+      ubo.dstSet = mesh.descriptorSet[i];
+
+      VkWriteDescriptorSet tex{};
+      tex.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      tex.dstBinding = 1;
+      tex.descriptorCount = 1;
+      tex.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+      tex.pImageInfo = &descImage;
+      tex.dstSet = mesh.descriptorSet[i];
+
+      vector<VkWriteDescriptorSet> writeSets = {
+        ubo, tex
+      };
+      vkUpdateDescriptorSets(m_device, uint32_t(writeSets.size()), writeSets.data(), 0, nullptr);
+    }
+  }
+}
+
+uint32_t ModelApp::selectLod(const ModelMesh& mesh) const
+{
+  if (mesh.lods.empty())
+  {
+    return 0;
+  }
+  const auto& world = m_sceneParameters.mtxWorld;
+  auto scale = (std::max)({ length(vec3(world[0])), length(vec3(world[1])), length(vec3(world[2])) });
+  auto center = (mesh.boundsMin + mesh.boundsMax) * 0.5f;
+  auto radius = length(mesh.boundsMax - mesh.boundsMin) * 0.5f * scale;
+  auto viewPos = m_sceneParameters.mtxView * world * vec4(center, 1.0f);
+  auto distance = length(vec3(viewPos)) - radius;
+  if (distance <= 0.0f || radius <= 0.0f)
+  {
+    return 0;   // カメラが境界球の中にある
+  }
+  // 境界球の投影半径 (ピクセル)
+  auto screenRadius = radius * m_sceneParameters.mtxProj[1][1] * 0.5f * float(m_swapchainExtent.height) / distance;
+  // 誤差を画面上の大きさに換算し, 許容範囲内で最も粗いレベルを選ぶ.
+  uint32_t level = 0;
+  for (uint32_t i = 0; i < uint32_t(mesh.lods.size()); ++i)
+  {
+    if (mesh.lods[i].error * scale / radius * screenRadius <= m_lodPixelError)
+    {
+      level = i + 1;
+    }
+  }
+  return level;
+}
+
+void ModelApp::prepareMeshletCulling()
+{
+  // カリング結果を書き込む間接描画コマンドのバッファ
+  const auto meshletCount = uint32_t(m_geometry.meshlets.size());
+  const auto indirectSize = uint32_t(sizeof(VkDrawIndexedIndirectCommand) * (std::max)(meshletCount, 1u));
+  m_indirectBuffers.resize(m_swapchainViews.size());
+  for (auto& v : m_indirectBuffers)
+  {
+    v = createBuffer(indirectSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, MemoryUsage::GpuOnly, MemoryCategory::Mesh, nullptr);
+  }
+
+  // 入力: メッシュレット情報, 出力: 間接描画コマンド
+  m_meshletCullPass = createComputePass("meshletCull.comp.spv", 2, sizeof(CullParameters));
+  for (uint32_t i = 0; i < uint32_t(m_indirectBuffers.size()); ++i)
+  {
+    updateComputeDescriptors(m_meshletCullPass, i, { m_geometry.meshletBuffer.buffer, m_indirectBuffers[i].buffer });
+  }
+
+  stringstream ss;
+  ss << "Meshlet culling: " << meshletCount << " meshlets"
+    << (m_enabledFeatures.multiDrawIndirect ? "" : " (multiDrawIndirect unsupported, one draw per meshlet)") << endl;
+  OutputDebugStringA(ss.str().c_str());
+}
+
+void ModelApp::prepareGpuDrivenRendering()
+{
+  using namespace Microsoft::glTF;
+
+  // 描画をバケットにまとめる. 不透明はパイプライン/マテリアル/インデックス型ごと,
+  // 半透明は描画順を保つため同じ組み合わせが連続する範囲ごとにまとめる.
+  vector<DrawData> draws;
+  vector<vector<uint32_t>> bucketMeshes;
+  for (auto mode : { ALPHA_OPAQUE, ALPHA_MASK, ALPHA_BLEND })
+  {
+    auto pipeline = mode == ALPHA_BLEND ? m_pipelineAlpha : m_pipelineOpaque;
+    for (uint32_t meshIndex = 0; meshIndex < uint32_t(m_model.meshes.size()); ++meshIndex)
+    {
+      const auto& mesh = m_model.meshes[meshIndex];
+      if (m_model.materials[mesh.materialIndex].alphaMode != mode)
+      {
+        continue;
+      }
+      auto sameBucket = [&](const DrawBucket& b) {
+        return b.pipeline == pipeline && b.indexType == mesh.indexType
+          && m_model.meshes[b.meshIndex].materialIndex == mesh.materialIndex;
+      };
+      size_t bucket = m_drawBuckets.size();
+      if (mode == ALPHA_BLEND)
+      {
+        if (!m_drawBuckets.empty() && sameBucket(m_drawBuckets.back()))
+        {
+          bucket = m_drawBuckets.size() - 1;
+        }
+      }
+      else
+      {
+        bucket = size_t(find_if(m_drawBuckets.begin(), m_drawBuckets.end(), sameBucket) - m_drawBuckets.begin());
+      }
+      if (bucket == m_drawBuckets.size())
+      {
+        m_drawBuckets.push_back(DrawBucket{ pipeline, mesh.indexType, meshIndex, 0, 0 });
+        bucketMeshes.emplace_back();
+      }
+      bucketMeshes[bucket].push_back(meshIndex);
+    }
+  }
+  uint32_t commandCount = 0;
+  for (size_t b = 0; b < m_drawBuckets.size(); ++b)
+  {
+    auto& bucket = m_drawBuckets[b];
+    bucket.firstCommand = commandCount;
+    bucket.capacity = uint32_t(bucketMeshes[b].size());
+    commandCount += bucket.capacity;
+    for (uint32_t slot = 0; slot < bucket.capacity; ++slot)
+    {
+      const auto& mesh = m_model.meshes[bucketMeshes[b][slot]];
+      DrawData draw{};
+      draw.boundsMin = vec4(mesh.boundsMin, 0.0f);
+      draw.boundsMax = vec4(mesh.boundsMax, 0.0f);
+      draw.firstIndex = mesh.firstIndex;
+      draw.indexCount = mesh.indexCount;
+      draw.vertexOffset = mesh.vertexOffset;
+      draw.materialIndex = uint32_t(mesh.materialIndex);
+      draw.bucket = uint32_t(b);
+      draw.commandBase = bucket.firstCommand;
+      draw.slot = slot;
+      draw.ordered = bucket.pipeline == m_pipelineAlpha ? 1 : 0;
+      draws.push_back(draw);
+    }
+  }
+  m_drawCount = uint32_t(draws.size());
+
+  // 描画データは転送して固定, コマンドと描画数は毎フレーム GPU で書き込む.
+  m_drawDataBuffer = createBuffer(uint32_t(sizeof(DrawData) * (std::max)(draws.size(), size_t(1))),
+    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::GpuOnly, MemoryCategory::Mesh, draws.empty() ? nullptr : draws.data());
+  const auto imageCount = m_swapchainViews.size();
+  m_drawCommandBuffers.resize(imageCount);
+  m_drawCountBuffers.resize(imageCount);
+  for (size_t i = 0; i < imageCount; ++i)
+  {
+    m_drawCommandBuffers[i] = createBuffer(uint32_t(sizeof(VkDrawIndexedIndirectCommand) * (std::max)(commandCount, 1u)),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, MemoryUsage::GpuOnly, MemoryCategory::Mesh, nullptr);
+    m_drawCountBuffers[i] = createBuffer(uint32_t(sizeof(uint32_t) * (std::max)(m_drawBuckets.size(), size_t(1))),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      MemoryUsage::GpuOnly, MemoryCategory::Mesh, nullptr);
+  }
+
+  if (m_occlusionCulling)
+  {
+    prepareOcclusionCulling(commandCount);
+  }
+  else
+  {
+    // 入力: 描画データ, 出力: 描画コマンドとバケットごとの描画数
+    m_gpuCullPass = createComputePass("gpuCull.comp.spv", 3, sizeof(GpuCullParameters));
+    for (uint32_t i = 0; i < uint32_t(imageCount); ++i)
+    {
+      updateComputeDescriptors(m_gpuCullPass, i, { m_drawDataBuffer.buffer, m_drawCommandBuffers[i].buffer, m_drawCountBuffers[i].buffer });
+    }
+  }
+
+  stringstream ss;
+  ss << "GPU driven rendering: " << m_drawCount << " draws in " << m_drawBuckets.size() << " buckets, "
+    << (m_vkCmdDrawIndexedIndirectCount ? "indirect count" : "fixed count indirect") << endl;
+  OutputDebugStringA(ss.str().c_str());
+}
+
+void ModelApp::recordMeshletCulling(VkCommandBuffer command, const FrustumPlanes& frustum)
+{
+  CullParameters cullParam{};
+  for (int i = 0; i < 6; ++i)
+  {
+    cullParam.frustumPlanes[i] = make_vec4(frustum.planes[i]);
+  }
+  cullParam.cameraPosition = inverse(m_sceneParameters.mtxView * m_sceneParameters.mtxWorld)[3];
+  cullParam.meshletCount = uint32_t(m_geometry.meshlets.size());
+
+  auto& pass = m_meshletCullPass;
+  vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_COMPUTE, pass.pipeline);
+  vkCmdBindDescriptorSets(command, VK_PIPELINE_BIND_POINT_COMPUTE, pass.pipelineLayout, 0, 1, &pass.descriptorSets[m_imageIndex], 0, nullptr);
+  vkCmdPushConstants(command, pass.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cullParam), &cullParam);
+  vkCmdDispatch(command, (cullParam.meshletCount + 63) / 64, 1, 1);
+
+  // 書き込んだ間接描画コマンドを描画で読めるようにする.
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+  vkCmdPipelineBarrier(command,
+    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+    0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void ModelApp::recordGpuCulling(VkCommandBuffer command, const FrustumPlanes& frustum)
+{
+  GpuCullParameters cullParam{};
+  for (int i = 0; i < 6; ++i)
+  {
+    cullParam.frustumPlanes[i] = make_vec4(frustum.planes[i]);
+  }
+  cullParam.drawCount = m_drawCount;
+  // 描画数を GPU から取れない場合は, 全描画を固定位置に書き込み見えないものはインスタンス数 0 とする.
+  cullParam.compact = m_vkCmdDrawIndexedIndirectCount ? 1 : 0;
+
+  // 描画数をクリアしてからカリングを実行
+  auto countBuffer = m_drawCountBuffers[m_imageIndex].buffer;
+  vkCmdFillBuffer(command, countBuffer, 0, VK_WHOLE_SIZE, 0);
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(command,
+    VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+    0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+  auto& pass = m_gpuCullPass;
+  vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_COMPUTE, pass.pipeline);
+  vkCmdBindDescriptorSets(command, VK_PIPELINE_BIND_POINT_COMPUTE, pass.pipelineLayout, 0, 1, &pass.descriptorSets[m_imageIndex], 0, nullptr);
+  vkCmdPushConstants(command, pass.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cullParam), &cullParam);
+  vkCmdDispatch(command, (m_drawCount + 63) / 64, 1, 1);
+
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+  vkCmdPipelineBarrier(command,
+    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+    0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void ModelApp::drawGpuDriven(VkCommandBuffer command, VkBuffer commandBuffer, VkBuffer countBuffer)
+{
+  const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+  VkPipeline boundPipeline = VK_NULL_HANDLE;
+  auto boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+  for (size_t b = 0; b < m_drawBuckets.size(); ++b)
+  {
+    const auto& bucket = m_drawBuckets[b];
+    if (bucket.pipeline != boundPipeline)
+    {
+      vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_GRAPHICS, bucket.pipeline);
+      boundPipeline = bucket.pipeline;
+    }
+    if (bucket.indexType != boundIndexType)
+    {
+      auto& indexBuffer = bucket.indexType == VK_INDEX_TYPE_UINT16 ? m_geometry.indexBuffer16 : m_geometry.indexBuffer32;
+      vkCmdBindIndexBuffer(command, indexBuffer.buffer, 0, bucket.indexType);
+      boundIndexType = bucket.indexType;
+    }
+    // 同じバケットのメッシュはマテリアルが同じなので, ディスクリプタセットも共通で使える.
+    vkCmdBindDescriptorSets(command, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1,
+      &m_model.meshes[bucket.meshIndex].descriptorSet[m_imageIndex], 0, nullptr);
+
+    VkDeviceSize offset = VkDeviceSize(bucket.firstCommand) * stride;
+    if (m_vkCmdDrawIndexedIndirectCount)
+    {
+      m_vkCmdDrawIndexedIndirectCount(command, commandBuffer, offset, countBuffer, sizeof(uint32_t) * b, bucket.capacity, stride);
+    }
+    else if (m_enabledFeatures.multiDrawIndirect)
+    {
+      vkCmdDrawIndexedIndirect(command, commandBuffer, offset, bucket.capacity, stride);
+    }
+    else
+    {
+      for (uint32_t i = 0; i < bucket.capacity; ++i)
+      {
+        vkCmdDrawIndexedIndirect(command, commandBuffer, offset + i * stride, 1, stride);
+      }
+    }
+  }
+}
+
+void ModelApp::prepareOcclusionCulling(uint32_t commandCount)
+{
+  const auto imageCount = uint32_t(m_swapchainViews.size());
+
+  // 前半のパス. 本来のパスと互換で, カラー/デプスをクリアして次のパスへ残す.
+  {
+    array<VkAttachmentDescription, 2> attachments{};
+    attachments[0].format = m_surfaceFormat.format;
+    attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+    attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    attachments[1] = attachments[0];
+    attachments[1].format = m_depthFormat;
+    attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference colorReference{ 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+    VkAttachmentReference depthReference{ 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+    VkSubpassDescription subpassDesc{};
+    subpassDesc.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpassDesc.colorAttachmentCount = 1;
+    subpassDesc.pColorAttachments = &colorReference;
+    subpassDesc.pDepthStencilAttachment = &depthReference;
+
+    VkRenderPassCreateInfo ci{};
+    ci.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    ci.attachmentCount = uint32_t(attachments.size());
+    ci.pAttachments = attachments.data();
+    ci.subpassCount = 1;
+    ci.pSubpasses = &subpassDesc;
+    auto result = vkCreateRenderPass(m_device, &ci, nullptr, &m_earlyRenderPass);
+    checkResult(result);
+  }
+
+  // 深度ピラミッド (レベル 0 はデプスバッファの半分)
+  m_pyramidExtent.width = (std::max)(m_swapchainExtent.width / 2, 1u);
+  m_pyramidExtent.height = (std::max)(m_swapchainExtent.height / 2, 1u);
+  m_pyramidLevels = 1;
+  while (((std::max)(m_pyramidExtent.width, m_pyramidExtent.height) >> m_pyramidLevels) > 0)
+  {
+    ++m_pyramidLevels;
+  }
+  {
+    VkImageCreateInfo ci{};
+    ci.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    ci.imageType = VK_IMAGE_TYPE_2D;
+    ci.format = VK_FORMAT_R32_SFLOAT;
+    ci.extent = { m_pyramidExtent.width, m_pyramidExtent.height, 1 };
+    ci.mipLevels = m_pyramidLevels;
+    ci.arrayLayers = 1;
+    ci.samples = VK_SAMPLE_COUNT_1_BIT;
+    ci.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    auto result = vkCreateImage(m_device, &ci, nullptr, &m_depthPyramid.image);
+    checkResult(result);
+
+    VkMemoryRequirements reqs;
+    vkGetImageMemoryRequirements(m_device, m_depthPyramid.image, &reqs);
+    result = allocateMemory(reqs, MemoryUsage::GpuOnly, MemoryCategory::DepthBuffer, &m_depthPyramid.memory);
+    checkResult(result);
+    vkBindImageMemory(m_device, m_depthPyramid.image, m_depthPyramid.memory, 0);
+
+    VkImageViewCreateInfo viewCI{};
+    viewCI.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewCI.format = ci.format;
+    viewCI.image = m_depthPyramid.image;
+    viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, m_pyramidLevels, 0, 1 };
+    vkCreateImageView(m_device, &viewCI, nullptr, &m_depthPyramid.view);
+    m_pyramidLevelViews.resize(m_pyramidLevels);
+    for (uint32_t level = 0; level < m_pyramidLevels; ++level)
+    {
+      viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+      vkCreateImageView(m_device, &viewCI, nullptr, &m_pyramidLevelViews[level]);
+    }
+  }
+  {
+    VkSamplerCreateInfo ci{};
+    ci.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    ci.minFilter = VK_FILTER_NEAREST;
+    ci.magFilter = VK_FILTER_NEAREST;
+    ci.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    ci.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    ci.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    ci.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    ci.maxAnisotropy = 1.0f;
+    ci.maxLod = float(m_pyramidLevels);
+    vkCreateSampler(m_device, &ci, nullptr, &m_pyramidSampler);
+  }
+
+  // ピラミッドの縮小. 入力は 1 つ上のレベル (レベル 0 はデプスバッファ), 出力は各レベル.
+  m_pyramidPass = createComputePass("hizDownsample.comp.spv",
+    { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE }, m_pyramidLevels, sizeof(PyramidParameters));
+  for (uint32_t level = 0; level < m_pyramidLevels; ++level)
+  {
+    VkDescriptorImageInfo src{ m_pyramidSampler, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL };
+    if (level == 0)
+    {
+      src.imageView = m_depthSampledView;
+      src.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    }
+    else
+    {
+      src.imageView = m_pyramidLevelViews[level - 1];
+    }
+    VkDescriptorImageInfo dst{ VK_NULL_HANDLE, m_pyramidLevelViews[level], VK_IMAGE_LAYOUT_GENERAL };
+    array<VkWriteDescriptorSet, 2> writeSets{};
+    for (uint32_t i = 0; i < uint32_t(writeSets.size()); ++i)
+    {
+      writeSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      writeSets[i].dstSet = m_pyramidPass.descriptorSets[level];
+      writeSets[i].dstBinding = i;
+      writeSets[i].descriptorCount = 1;
+    }
+    writeSets[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writeSets[0].pImageInfo = &src;
+    writeSets[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writeSets[1].pImageInfo = &dst;
+    vkUpdateDescriptorSets(m_device, uint32_t(writeSets.size()), writeSets.data(), 0, nullptr);
+  }
+
+  // 前のフレームでの可視状態. 最初のフレームは全て見えていたものとして前半で描く.
+  vector<uint32_t> visibility((std::max)(m_drawCount, 1u), 1);
+  m_visibilityBuffer = createBuffer(uint32_t(sizeof(uint32_t) * visibility.size()),
+    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryUsage::GpuOnly, MemoryCategory::Mesh, visibility.data());
+
+  // 前半のパスの描画コマンドと描画数, 統計の読み戻し先. 後半は GPU 駆動描画のものを使う.
+  m_earlyCommandBuffers.resize(imageCount);
+  m_earlyCountBuffers.resize(imageCount);
+  m_occlusionStatsBuffers.resize(imageCount);
+  const uint32_t zeroStats[OcclusionStatCount] = {};
+  for (uint32_t i = 0; i < imageCount; ++i)
+  {
+    m_earlyCommandBuffers[i] = createBuffer(uint32_t(sizeof(VkDrawIndexedIndirectCommand) * (std::max)(commandCount, 1u)),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, MemoryUsage::GpuOnly, MemoryCategory::Mesh, nullptr);
+    m_earlyCountBuffers[i] = createBuffer(uint32_t(sizeof(uint32_t) * (std::max)(m_drawBuckets.size(), size_t(1))),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      MemoryUsage::GpuOnly, MemoryCategory::Mesh, nullptr);
+    m_occlusionStatsBuffers[i] = createBuffer(sizeof(zeroStats),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::Readback, MemoryCategory::Other, zeroStats);
+  }
+
+  // 入力: 描画データ, 行列, 深度ピラミッド, 出力: 描画コマンド, 描画数, 可視状態, 統計.
+  // ディスクリプタセットは画像ごとに前半 (2i) と後半 (2i+1).
+  m_hizCullPass = createComputePass("hizCull.comp.spv", {
+      VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+      VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+      VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+    }, imageCount * 2, sizeof(HiZCullParameters));
+  for (uint32_t i = 0; i < imageCount * 2; ++i)
+  {
+    auto image = i / 2;
+    bool early = (i % 2) == 0;
+    array<VkDescriptorBufferInfo, 6> buffers = { {
+      { m_drawDataBuffer.buffer, 0, VK_WHOLE_SIZE },
+      { early ? m_earlyCommandBuffers[image].buffer : m_drawCommandBuffers[image].buffer, 0, VK_WHOLE_SIZE },
+      { early ? m_earlyCountBuffers[image].buffer : m_drawCountBuffers[image].buffer, 0, VK_WHOLE_SIZE },
+      { m_uniformBuffers[image].buffer, 0, VK_WHOLE_SIZE },
+      { m_visibilityBuffer.buffer, 0, VK_WHOLE_SIZE },
+      { m_occlusionStatsBuffers[image].buffer, 0, VK_WHOLE_SIZE },
+    } };
+    VkDescriptorImageInfo pyramid{ m_pyramidSampler, m_depthPyramid.view, VK_IMAGE_LAYOUT_GENERAL };
+    array<VkWriteDescriptorSet, 7> writeSets{};
+    for (uint32_t b = 0; b < uint32_t(writeSets.size()); ++b)
+    {
+      writeSets[b].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      writeSets[b].dstSet = m_hizCullPass.descriptorSets[i];
+      writeSets[b].dstBinding = b;
+      writeSets[b].descriptorCount = 1;
+      if (b < buffers.size())
+      {
+        writeSets[b].descriptorType = b == 3 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writeSets[b].pBufferInfo = &buffers[b];
+      }
+      else
+      {
+        writeSets[b].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writeSets[b].pImageInfo = &pyramid;
+      }
+    }
+    vkUpdateDescriptorSets(m_device, uint32_t(writeSets.size()), writeSets.data(), 0, nullptr);
+  }
+
+  stringstream ss;
+  ss << "Occlusion culling: depth pyramid " << m_pyramidExtent.width << "x" << m_pyramidExtent.height
+    << ", " << m_pyramidLevels << " levels" << endl;
+  OutputDebugStringA(ss.str().c_str());
+}
+
+void ModelApp::recordOcclusionCulling(VkCommandBuffer command, const FrustumPlanes& frustum)
+{
+  // このスワップチェイン画像の前回の統計を読み戻す (フェンスで完了を待っている).
+  {
+    auto memory = m_occlusionStatsBuffers[m_imageIndex].memory;
+    void* p;
+    vkMapMemory(m_device, memory, 0, VK_WHOLE_SIZE, 0, &p);
+    VkMappedMemoryRange range{ VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, memory, 0, VK_WHOLE_SIZE };
+    vkInvalidateMappedMemoryRanges(m_device, 1, &range);
+    memcpy(m_occlusionStats, p, sizeof(m_occlusionStats));
+    vkUnmapMemory(m_device, memory);
+  }
+
+  // 描画数と統計をクリアする. 前のフレームで書いた可視状態もここで読めるようにする.
+  vkCmdFillBuffer(command, m_earlyCountBuffers[m_imageIndex].buffer, 0, VK_WHOLE_SIZE, 0);
+  vkCmdFillBuffer(command, m_drawCountBuffers[m_imageIndex].buffer, 0, VK_WHOLE_SIZE, 0);
+  vkCmdFillBuffer(command, m_occlusionStatsBuffers[m_imageIndex].buffer, 0, VK_WHOLE_SIZE, 0);
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(command,
+    VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+    0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+  // 前半: 前のフレームで見えていたものを描き, デプスを作る.
+  dispatchHiZCulling(command, frustum, 1);
+
+  array<VkClearValue, 2> clearValue;
+  getClearValues(clearValue.data());
+  VkRenderPassBeginInfo renderPassBI{};
+  renderPassBI.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+  renderPassBI.renderPass = m_earlyRenderPass;
+  renderPassBI.framebuffer = m_framebuffers[m_imageIndex];
+  renderPassBI.renderArea.extent = m_swapchainExtent;
+  renderPassBI.pClearValues = clearValue.data();
+  renderPassBI.clearValueCount = uint32_t(clearValue.size());
+  vkCmdBeginRenderPass(command, &renderPassBI, VK_SUBPASS_CONTENTS_INLINE);
+  VkDeviceSize offset = 0;
+  vkCmdBindVertexBuffers(command, 0, 1, &m_geometry.vertexBuffer.buffer, &offset);
+  drawGpuDriven(command, m_earlyCommandBuffers[m_imageIndex].buffer, m_earlyCountBuffers[m_imageIndex].buffer);
+  vkCmdEndRenderPass(command);
+
+  // 後半: 前半のデプスから作ったピラミッドで判定し, 新たに見えたものを本来のパスで描く.
+  buildDepthPyramid(command);
+  dispatchHiZCulling(command, frustum, 2);
+
+  // 統計は次にこの画像を使うときに CPU で読む.
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  vkCmdPipelineBarrier(command,
+    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+    0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void ModelApp::dispatchHiZCulling(VkCommandBuffer command, const FrustumPlanes& frustum, uint32_t phase)
+{
+  HiZCullParameters cullParam{};
+  for (int i = 0; i < 6; ++i)
+  {
+    cullParam.frustumPlanes[i] = make_vec4(frustum.planes[i]);
+  }
+  cullParam.drawCount = m_drawCount;
+  cullParam.compact = m_vkCmdDrawIndexedIndirectCount ? 1 : 0;
+  cullParam.phase = phase;
+  cullParam.reversedZ = m_reversedZ ? 1 : 0;
+  cullParam.pyramidSize = vec2(float(m_pyramidExtent.width), float(m_pyramidExtent.height));
+  cullParam.pyramidLevels = m_pyramidLevels;
+
+  auto& pass = m_hizCullPass;
+  auto setIndex = m_imageIndex * 2 + (phase - 1);
+  vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_COMPUTE, pass.pipeline);
+  vkCmdBindDescriptorSets(command, VK_PIPELINE_BIND_POINT_COMPUTE, pass.pipelineLayout, 0, 1, &pass.descriptorSets[setIndex], 0, nullptr);
+  vkCmdPushConstants(command, pass.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cullParam), &cullParam);
+  vkCmdDispatch(command, (m_drawCount + 63) / 64, 1, 1);
+
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(command,
+    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+    0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void ModelApp::buildDepthPyramid(VkCommandBuffer command)
+{
+  // デプスはシェーダーから読めるレイアウトへ. ピラミッドは前のフレームの参照が終わってから書き込む.
+  array<VkImageMemoryBarrier, 2> barriers{};
+  auto& depthBarrier = barriers[0];
+  depthBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  depthBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  depthBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+  depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  depthBarrier.image = m_depthBuffer;
+  depthBarrier.subresourceRange = { getDepthAspect(), 0, 1, 0, 1 };
+  auto& pyramidBarrier = barriers[1];
+  pyramidBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  pyramidBarrier.srcAccessMask = 0;
+  pyramidBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  pyramidBarrier.oldLayout = m_pyramidInitialized ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_UNDEFINED;
+  pyramidBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+  pyramidBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  pyramidBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  pyramidBarrier.image = m_depthPyramid.image;
+  pyramidBarrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, m_pyramidLevels, 0, 1 };
+  vkCmdPipelineBarrier(command,
+    VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+    0, 0, nullptr, 0, nullptr, uint32_t(barriers.size()), barriers.data());
+  m_pyramidInitialized = true;
+
+  auto& pass = m_pyramidPass;
+  vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_COMPUTE, pass.pipeline);
+  PyramidParameters param{};
+  param.srcSize = ivec2(m_swapchainExtent.width, m_swapchainExtent.height);
+  param.reversedZ = m_reversedZ ? 1 : 0;
+  for (uint32_t level = 0; level < m_pyramidLevels; ++level)
+  {
+    param.dstSize = ivec2((std::max)(m_pyramidExtent.width >> level, 1u), (std::max)(m_pyramidExtent.height >> level, 1u));
+    vkCmdBindDescriptorSets(command, VK_PIPELINE_BIND_POINT_COMPUTE, pass.pipelineLayout, 0, 1, &pass.descriptorSets[level], 0, nullptr);
+    vkCmdPushConstants(command, pass.pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(param), &param);
+    vkCmdDispatch(command, (param.dstSize.x + 7) / 8, (param.dstSize.y + 7) / 8, 1);
+
+    // 書き込んだレベルを次のレベルとカリングで読めるようにする.
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(command,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      0, 1, &barrier, 0, nullptr, 0, nullptr);
+    param.srcSize = param.dstSize;
+  }
+
+  // デプスを本来のパスで続けて使えるように戻す.
+  depthBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  depthBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+  depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  vkCmdPipelineBarrier(command,
+    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+    0, 0, nullptr, 0, nullptr, 1, &depthBarrier);
+}
+
+void ModelApp::prepareOcclusionQueries()
+{
+  // 三角形数がしきい値以上のメッシュをクエリの対象とする.
+  m_meshQuerySlots.assign(m_model.meshes.size(), -1);
+  for (uint32_t meshIndex = 0; meshIndex < uint32_t(m_model.meshes.size()); ++meshIndex)
+  {
+    if (m_model.meshes[meshIndex].indexCount / 3 >= m_occlusionQueryMinTriangles)
+    {
+      m_meshQuerySlots[meshIndex] = int32_t(m_queryMeshes.size());
+      m_queryMeshes.push_back(meshIndex);
+    }
+  }
+  const auto queryCount = (std::max)(uint32_t(m_queryMeshes.size()), 1u);
+  m_queryTested.assign(queryCount, 0);
+  m_meshQueryStats.assign(m_queryMeshes.size(), MeshQueryStats{});
+  for (size_t slot = 0; slot < m_queryMeshes.size(); ++slot)
+  {
+    m_meshQueryStats[slot].meshIndex = m_queryMeshes[slot];
+  }
+
+  VkQueryPoolCreateInfo ci{};
+  ci.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  ci.queryType = VK_QUERY_TYPE_OCCLUSION;
+  ci.queryCount = queryCount;
+  vkCreateQueryPool(m_device, &ci, nullptr, &m_queryPool);
+
+  // 結果が届くまでは全て描画する.
+  const auto imageCount = m_swapchainViews.size();
+  vector<uint32_t> initialPredicates(queryCount, 1);
+  m_predicateBuffers.resize(imageCount);
+  m_predicateTested.resize(imageCount);
+  for (auto& v : m_predicateBuffers)
+  {
+    v = createBuffer(uint32_t(sizeof(uint32_t) * queryCount),
+      VK_BUFFER_USAGE_CONDITIONAL_RENDERING_BIT_EXT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      MemoryUsage::Readback, MemoryCategory::Other, initialPredicates.data());
+  }
+
+  stringstream ss;
+  ss << "Occlusion queries: " << m_queryMeshes.size() << "/" << m_model.meshes.size()
+    << " meshes with " << m_occlusionQueryMinTriangles << " or more triangles" << endl;
+  OutputDebugStringA(ss.str().c_str());
+}
+
+void ModelApp::resolveOcclusionQueries(VkCommandBuffer command)
+{
+  // このスワップチェイン画像へ前回コピーした結果は, フェンスで完了を待っているので待たずに読める.
+  auto& predicate = m_predicateBuffers[m_imageIndex];
+  auto& tested = m_predicateTested[m_imageIndex];
+  if (!tested.empty())
+  {
+    void* p;
+    vkMapMemory(m_device, predicate.memory, 0, VK_WHOLE_SIZE, 0, &p);
+    VkMappedMemoryRange range{ VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, predicate.memory, 0, VK_WHOLE_SIZE };
+    vkInvalidateMappedMemoryRanges(m_device, 1, &range);
+    auto results = static_cast<const uint32_t*>(p);
+    m_queryOccludedCount = 0;
+    for (size_t slot = 0; slot < m_queryMeshes.size(); ++slot)
+    {
+      if (!tested[slot])
+      {
+        continue;
+      }
+      auto& stats = m_meshQueryStats[slot];
+      stats.testedFrames++;
+      if (results[slot] == 0)
+      {
+        stats.occludedFrames++;
+        m_queryOccludedCount++;
+      }
+    }
+    vkUnmapMemory(m_device, predicate.memory);
+  }
+  if (m_queryMeshes.empty())
+  {
+    return;
+  }
+
+  // 前のフレームのクエリ結果を条件として使うバッファへコピーする.
+  // 待ちは GPU 側で行い, CPU では結果を待たない.
+  const auto queryCount = uint32_t(m_queryMeshes.size());
+  if (m_queriesIssued)
+  {
+    vkCmdCopyQueryPoolResults(command, m_queryPool, 0, queryCount, predicate.buffer, 0, sizeof(uint32_t), VK_QUERY_RESULT_WAIT_BIT);
+    tested = m_queryTested;
+
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_CONDITIONAL_RENDERING_READ_BIT_EXT | VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(command,
+      VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_CONDITIONAL_RENDERING_BIT_EXT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+      0, 1, &barrier, 0, nullptr, 0, nullptr);
+  }
+  // コピーの後で, このフレームのクエリのためにリセットする.
+  vkCmdResetQueryPool(command, m_queryPool, 0, queryCount);
+}
+
+void ModelApp::drawOcclusionProxies(VkCommandBuffer command)
+{
+  // 不透明/半透明を描いた後のデプスに対してバウンディングボックスを判定する.
+  auto cameraPosition = vec3(inverse(m_sceneParameters.mtxView * m_sceneParameters.mtxWorld)[3]);
+  VkPipeline boundPipeline = VK_NULL_HANDLE;
+  for (uint32_t slot = 0; slot < uint32_t(m_queryMeshes.size()); ++slot)
+  {
+    auto meshIndex = m_queryMeshes[slot];
+    const auto& mesh = m_model.meshes[meshIndex];
+    // 視錐台外のものは判定しない (次のフレームは条件なしで描く).
+    // コピー時に結果を待つため, クエリ自体は必ず発行する.
+    m_queryTested[slot] = !m_frustumCulling || m_meshVisible[meshIndex];
+
+    // ニアクリップで欠けないよう少し広げた範囲にカメラがあれば, 深度テストなしで必ず可視とする.
+    const float margin = 0.02f;
+    bool inside = all(greaterThanEqual(cameraPosition, mesh.boundsMin - margin))
+      && all(lessThanEqual(cameraPosition, mesh.boundsMax + margin));
+    auto pipeline = inside ? m_proxyPipelineNoDepth : m_proxyPipeline;
+    if (pipeline != boundPipeline)
+    {
+      vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+      boundPipeline = pipeline;
+    }
+    vkCmdBindDescriptorSets(command, VK_PIPELINE_BIND_POINT_GRAPHICS, m_proxyPipelineLayout, 0, 1, &mesh.descriptorSet[m_imageIndex], 0, nullptr);
+    ProxyBounds bounds{ vec4(mesh.boundsMin, 0.0f), vec4(mesh.boundsMax, 0.0f) };
+    vkCmdPushConstants(command, m_proxyPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(bounds), &bounds);
+
+    vkCmdBeginQuery(command, m_queryPool, slot, 0);
+    vkCmdDraw(command, 36, 1, 0, 0);
+    vkCmdEndQuery(command, m_queryPool, slot);
+  }
+  m_queriesIssued = !m_queryMeshes.empty();
+}
+
+void ModelApp::reportOcclusionQueries() const
+{
+  // メッシュごとに, 判定したフレームのうち隠れていた割合を出力する.
+  stringstream ss;
+  ss << "Occlusion query statistics:" << endl;
+  for (size_t slot = 0; slot < m_queryMeshes.size(); ++slot)
+  {
+    const auto& stats = m_meshQueryStats[slot];
+    const auto& mesh = m_model.meshes[stats.meshIndex];
+    ss << "  mesh " << stats.meshIndex << " (" << mesh.indexCount / 3 << " triangles): occluded "
+      << stats.occludedFrames << "/" << stats.testedFrames << " frames" << endl;
+  }
+  OutputDebugStringA(ss.str().c_str());
+}
+
+ModelApp::ComputePass ModelApp::createComputePass(const char* shaderFile, uint32_t bufferCount, uint32_t pushConstantSize)
+{
+  // ストレージバッファのみを使い, ディスクリプタセットはスワップチェイン画像ごと.
+  vector<VkDescriptorType> bindingTypes(bufferCount, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  return createComputePass(shaderFile, bindingTypes, uint32_t(m_swapchainViews.size()), pushConstantSize);
+}
+
+ModelApp::ComputePass ModelApp::createComputePass(const char* shaderFile, const std::vector<VkDescriptorType>& bindingTypes, uint32_t setCount, uint32_t pushConstantSize)
+{
+  ComputePass pass{};
+  vector<VkDescriptorSetLayoutBinding> bindings(bindingTypes.size());
+  vector<VkDescriptorPoolSize> poolSizes;
+  for (uint32_t i = 0; i < uint32_t(bindings.size()); ++i)
+  {
+    bindings[i].binding = i;
+    bindings[i].descriptorType = bindingTypes[i];
+    bindings[i].descriptorCount = 1;
+    bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    auto poolSize = find_if(poolSizes.begin(), poolSizes.end(), [&](const VkDescriptorPoolSize& v) { return v.type == bindingTypes[i]; });
+    if (poolSize == poolSizes.end())
+    {
+      poolSizes.push_back(VkDescriptorPoolSize{ bindingTypes[i], 0 });
+      poolSize = poolSizes.end() - 1;
+    }
+    poolSize->descriptorCount += setCount;
+  }
+  VkDescriptorSetLayoutCreateInfo layoutCI{};
+  layoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutCI.bindingCount = uint32_t(bindings.size());
+  layoutCI.pBindings = bindings.data();
+  vkCreateDescriptorSetLayout(m_device, &layoutCI, nullptr, &pass.setLayout);
+
+  VkDescriptorPoolCreateInfo poolCI{};
+  poolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolCI.maxSets = setCount;
+  poolCI.poolSizeCount = uint32_t(poolSizes.size());
+  poolCI.pPoolSizes = poolSizes.data();
+  vkCreateDescriptorPool(m_device, &poolCI, nullptr, &pass.descriptorPool);
+
+  vector<VkDescriptorSetLayout> layouts(setCount, pass.setLayout);
+  VkDescriptorSetAllocateInfo ai{};
+  ai.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  ai.descriptorPool = pass.descriptorPool;
+  ai.descriptorSetCount = setCount;
+  ai.pSetLayouts = layouts.data();
+  pass.descriptorSets.resize(setCount);
+  vkAllocateDescriptorSets(m_device, &ai, pass.descriptorSets.data());
+
+  VkPushConstantRange pushConstantRange{ VK_SHADER_STAGE_COMPUTE_BIT, 0, pushConstantSize };
+  VkPipelineLayoutCreateInfo pipelineLayoutCI{};
+  pipelineLayoutCI.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutCI.setLayoutCount = 1;
+  pipelineLayoutCI.pSetLayouts = &pass.setLayout;
+  pipelineLayoutCI.pushConstantRangeCount = pushConstantSize > 0 ? 1 : 0;
+  pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+  vkCreatePipelineLayout(m_device, &pipelineLayoutCI, nullptr, &pass.pipelineLayout);
+
+  VkComputePipelineCreateInfo ci{};
+  ci.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  ci.stage = loadShaderModule(shaderFile, VK_SHADER_STAGE_COMPUTE_BIT);
+  ci.layout = pass.pipelineLayout;
+  vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &ci, nullptr, &pass.pipeline);
+  vkDestroyShaderModule(m_device, ci.stage.module, nullptr);
+  return pass;
+}
+
+void ModelApp::updateComputeDescriptors(ComputePass& pass, uint32_t setIndex, const std::vector<VkBuffer>& buffers)
+{
+  vector<VkDescriptorBufferInfo> bufferInfos;
+  for (auto buffer : buffers)
+  {
+    bufferInfos.push_back(VkDescriptorBufferInfo{ buffer, 0, VK_WHOLE_SIZE });
+  }
+  vector<VkWriteDescriptorSet> writeSets(buffers.size());
+  for (uint32_t i = 0; i < uint32_t(writeSets.size()); ++i)
+  {
+    writeSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writeSets[i].dstSet = pass.descriptorSets[setIndex];
+    writeSets[i].dstBinding = i;
+    writeSets[i].descriptorCount = 1;
+    writeSets[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writeSets[i].pBufferInfo = &bufferInfos[i];
+  }
+  vkUpdateDescriptorSets(m_device, uint32_t(writeSets.size()), writeSets.data(), 0, nullptr);
+}
+
+void ModelApp::destroyComputePass(ComputePass& pass)
+{
+  vkDestroyPipeline(m_device, pass.pipeline, nullptr);
+  vkDestroyPipelineLayout(m_device, pass.pipelineLayout, nullptr);
+  vkDestroyDescriptorPool(m_device, pass.descriptorPool, nullptr);
+  vkDestroyDescriptorSetLayout(m_device, pass.setLayout, nullptr);
+  pass = ComputePass{};
+}
+
+ModelApp::BufferObject ModelApp::createBuffer(uint32_t size, VkBufferUsageFlags usage, MemoryUsage memUsage, MemoryCategory category, const void* initialData)
+{
+  BufferObject obj;
+  VkBufferCreateInfo ci{};
+  ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  ci.usage = usage;
+  ci.size = size;
+  if (memUsage == MemoryUsage::GpuOnly && initialData != nullptr)
+  {
+    // 初期データはステージングバッファから転送する.
+    ci.usage |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  }
+  auto result = vkCreateBuffer(m_device, &ci, nullptr, &obj.buffer);
+  checkResult(result);
+
+  // メモリ量の算出
+  VkMemoryRequirements reqs;
+  vkGetBufferMemoryRequirements(m_device, obj.buffer, &reqs);
+  // 用途に合ったメモリタイプでメモリを確保
+  result = allocateMemory(reqs, memUsage, category, &obj.memory);
+  checkResult(result);
+
+  // メモリのバインド
+  vkBindBufferMemory(m_device, obj.buffer, obj.memory, 0);
+
+  if (initialData != nullptr)
+  {
+    if (memUsage == MemoryUsage::GpuOnly)
+    {
+      uploadBuffer(obj.buffer, 0, initialData, size);
+    }
+    else
+    {
+      void* p;
+      vkMapMemory(m_device, obj.memory, 0, VK_WHOLE_SIZE, 0, &p);
+      memcpy(p, initialData, size);
+      // Readback は HOST_COHERENT でないメモリタイプを選ぶことがあるため, 書き込みを GPU へ見せる.
+      VkMappedMemoryRange range{ VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, obj.memory, 0, VK_WHOLE_SIZE };
+      vkFlushMappedMemoryRanges(m_device, 1, &range);
+      vkUnmapMemory(m_device, obj.memory);
+    }
+  }
+  return obj;
+}
+
+VkPipelineShaderStageCreateInfo ModelApp::loadShaderModule(const char* fileName, VkShaderStageFlagBits stage)
+{
+  ifstream infile(fileName, std::ios::binary);
+  if (!infile)
+  {
+    OutputDebugStringA("file not found.\n");
+    DebugBreak();
+  }
+  vector<char> filedata;
+  filedata.resize(uint32_t(infile.seekg(0, ifstream::end).tellg()));
+  infile.seekg(0, ifstream::beg).read(filedata.data(), filedata.size());
+
+  VkShaderModule shaderModule;
+  VkShaderModuleCreateInfo ci{};
+  ci.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  ci.pCode = reinterpret_cast<uint32_t*>(filedata.data());
+  ci.codeSize = filedata.size();
+  vkCreateShaderModule(m_device, &ci, nullptr, &shaderModule);
+
+  VkPipelineShaderStageCreateInfo shaderStageCI{};
+  shaderStageCI.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shaderStageCI.stage = stage;
+  shaderStageCI.module = shaderModule;
+  shaderStageCI.pName = "main";
+  return shaderStageCI;
+}
+
+VkSampler ModelApp::createSampler()
+{
+  VkSampler sampler;
+  VkSamplerCreateInfo ci{};
+  ci.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  ci.minFilter = VK_FILTER_LINEAR;
+  ci.magFilter = VK_FILTER_LINEAR;
+  ci.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  ci.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  ci.maxAnisotropy = 1.0f;
+  ci.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+  vkCreateSampler(m_device, &ci, nullptr, &sampler);
+  return sampler;
+}
+
+ModelApp::TextureObject ModelApp::createTexture(uint32_t width, uint32_t height, const void* pixels)
+{
+  TextureObject texture{};
+  auto format = VK_FORMAT_R8G8B8A8_UNORM;
+
+  {
+    // テクスチャのVkImage を生成
+    VkImageCreateInfo ci{};
+    ci.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    ci.extent = { width, height, 1 };
+    ci.format = format;
+    ci.imageType = VK_IMAGE_TYPE_2D;
+    ci.arrayLayers = 1;
+    ci.mipLevels = 1;
+    ci.samples = VK_SAMPLE_COUNT_1_BIT;
+    ci.usage = getImageUploadUsage(format) | VK_IMAGE_USAGE_SAMPLED_BIT;
+    vkCreateImage(m_device, &ci, nullptr, &texture.image);
+
+    // メモリ量の算出
+    VkMemoryRequirements reqs;
+    vkGetImageMemoryRequirements(m_device, texture.image, &reqs);
+    // メモリの確保
+    auto result = allocateMemory(reqs, MemoryUsage::GpuOnly, MemoryCategory::Texture, &texture.memory);
+    checkResult(result);
+    // メモリのバインド
+    vkBindImageMemory(m_device, texture.image, texture.memory, 0);
+  }
+
+  // ステージング用リングバッファ経由, または対応環境ではホストから直接転送.
+  uploadImage(texture.image, format, width, height, sizeof(uint32_t), pixels);
+
+  {
+    // テクスチャ参照用のビューを生成
+    VkImageViewCreateInfo ci{};
+    ci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    ci.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    ci.image = texture.image;
+    ci.format = format;
+    ci.components = {
+      VK_COMPONENT_SWIZZLE_R,
+      VK_COMPONENT_SWIZZLE_G,
+      VK_COMPONENT_SWIZZLE_B,
+      VK_COMPONENT_SWIZZLE_A,
+    };
+    ci.subresourceRange = {
+      VK_IMAGE_ASPECT_COLOR_BIT,0,1,0,1
+    };
+    vkCreateImageView(m_device, &ci, nullptr, &texture.view);
+  }
+  return texture;
+}
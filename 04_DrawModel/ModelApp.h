@@ -1,99 +1,470 @@
-#pragma once
-
-#include "../common/vkappbase.h"
-#include "glm/glm.hpp"
-#include "GLTFSDK/GLTF.h"
-
-namespace Microsoft
-{
-  namespace glTF
-  {
-    class Document;
-    class GLTFResourceReader;
-  }
-}
-
-class ModelApp : public VulkanAppBase
-{
-public:
-  ModelApp() : VulkanAppBase() { }
-
-  virtual void prepare() override;
-  virtual void cleanup() override;
-
-  virtual void makeCommand(VkCommandBuffer command) override;
-
-  struct Vertex
-  {
-    glm::vec3 pos;
-    glm::vec3 color;
-    glm::vec2 uv;
-  };
-private:
-  struct BufferObject
-  {
-    VkBuffer buffer;
-    VkDeviceMemory  memory;
-  };
-  struct TextureObject
-  {
-    VkImage image;
-    VkDeviceMemory memory;
-    VkImageView view;
-  };
-  struct ShaderParameters
-  {
-    glm::mat4 mtxWorld;
-    glm::mat4 mtxView;
-    glm::mat4 mtxProj;
-  };
-
-  struct ModelMesh
-  {
-    BufferObject vertexBuffer;
-    BufferObject indexBuffer;
-    uint32_t vertexCount;
-    uint32_t indexCount;
-
-    int materialIndex;
-
-    std::vector<VkDescriptorSet> descriptorSet;
-  };
-  struct Material
-  {
-    TextureObject texture;
-    Microsoft::glTF::AlphaMode alphaMode;
-  };
-  struct Model
-  {
-    std::vector<ModelMesh> meshes;
-    std::vector<Material> materials;
-  };
-  
-  void makeModelGeometry(const Microsoft::glTF::Document&, std::shared_ptr<Microsoft::glTF::GLTFResourceReader> reader);
-  void makeModelMaterial(const Microsoft::glTF::Document&, std::shared_ptr<Microsoft::glTF::GLTFResourceReader> reader);
-
-  void prepareUniformBuffers();
-  void prepareDescriptorSetLayout();
-  void prepareDescriptorPool();
-  void prepareDescriptorSet();
-
-  BufferObject createBuffer(uint32_t size, VkBufferUsageFlags usage, VkMemoryPropertyFlags flags, const void* initialData);
-  VkPipelineShaderStageCreateInfo loadShaderModule(const char* fileName, VkShaderStageFlagBits stage);
-  VkSampler createSampler();
-  TextureObject createTextureFromMemory(const std::vector<char>& imageData);
-  void setImageMemoryBarrier( VkCommandBuffer command, VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout);
-
-  Model m_model;
-
-  std::vector<BufferObject> m_uniformBuffers;
-
-  VkDescriptorSetLayout m_descriptorSetLayout;
-  VkDescriptorPool  m_descriptorPool;
-
-  VkSampler m_sampler;
-
-  VkPipelineLayout m_pipelineLayout;
-  VkPipeline  m_pipelineOpaque;
-  VkPipeline  m_pipelineAlpha;
+﻿#pragma once
+
+#include "../common/vkappbase.h"
+#include "glm/glm.hpp"
+#include "GLTFSDK/GLTF.h"
+#include "mappedfile.h"
+#include "frustumcull.h"
+#include "renderqueue.h"
+#include "modelcache.h"
+#include "modelcooker.h"
+#include "../common/instancing.h"
+#include <chrono>
+#include <future>
+
+class ModelApp : public VulkanAppBase
+{
+public:
+  ModelApp() : VulkanAppBase(), m_model(), m_geometry(), m_compactVertices(false), m_optimizeMeshes(true), m_meshletCulling(false),
+    m_generateLods(true), m_lodPixelError(1.0f), m_sceneParameters(), m_frustumCulling(true), m_visibleMeshCount(0),
+    m_frameCount(0), m_descriptorPool(VK_NULL_HANDLE), m_gpuDriven(false), m_drawCount(0), m_occlusionCulling(false), m_earlyRenderPass(VK_NULL_HANDLE),
+    m_depthPyramid(), m_pyramidExtent(), m_pyramidLevels(0), m_pyramidSampler(VK_NULL_HANDLE), m_pyramidInitialized(false),
+    m_occlusionStats(), m_occlusionQueries(false), m_occlusionQueryMinTriangles(4096), m_queryPool(VK_NULL_HANDLE),
+    m_queriesIssued(false), m_proxyPipelineLayout(VK_NULL_HANDLE), m_proxyPipeline(VK_NULL_HANDLE),
+    m_proxyPipelineNoDepth(VK_NULL_HANDLE), m_queryOccludedCount(0), m_instanceBuffer(), m_instanceCount(1),
+    m_bindCount(0), m_bindSkipped(0), m_useModelCache(true), m_asyncLoading(true),
+    m_loadStage(LoadStage::Cooking), m_cookedHeader(nullptr), m_cookedFrom(""), m_residentMeshCount(0), m_residentTextureCount(0),
+    m_streamingBudget(4 * 1024 * 1024), m_streamTicket(0), m_placeholderTexture()
+  { }
+
+  // モデル全体をインスタンス描画で複数配置する (shaderInstanced.vert.spv などが必要).
+  // initialize() の前に設定する.
+  void setInstances(const std::vector<InstanceData>& instances) { m_instances = instances; }
+  // 量子化した頂点形式を使う (shaderCompact.vert.spv が必要). initialize() の前に設定する.
+  void setCompactVertices(bool enable)
+  {
+    m_compactVertices = enable;
+    if (m_compactVertices && m_occlusionCulling)
+    {
+      OutputDebugStringA("Occlusion culling is disabled with compact vertices\n");
+      setOcclusionCulling(false);
+    }
+  }
+  // メッシュレット単位のカリングを行う (meshletCull.comp.spv が必要). initialize() の前に設定する.
+  void setMeshletCulling(bool enable) { m_meshletCulling = enable; }
+  // カリングと描画コマンドの生成を GPU で行う (gpuCull.comp.spv が必要). initialize() の前に設定する.
+  void setGpuDriven(bool enable) { m_gpuDriven = enable; }
+  // Hi-Z による遮蔽カリング (hizCull.comp.spv, hizDownsample.comp.spv が必要). initialize() の前に設定する.
+  // GPU 駆動描画で行い, 前半のパスの結果 (カラー/デプス) を本来のパスへ引き継ぐため, アタッチメントの設定も変える.
+  void setOcclusionCulling(bool enable)
+  {
+    if (enable && m_compactVertices)
+    {
+      OutputDebugStringA("Occlusion culling is disabled with compact vertices\n");
+      enable = false;
+    }
+    m_occlusionCulling = enable;
+    if (enable)
+    {
+      m_gpuDriven = true;
+    }
+    m_depthSampled = enable;
+    m_colorOps.loadOp = enable ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+    m_depthOps.loadOp = enable ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+    m_depthOps.storeOp = enable ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  }
+  // 遮蔽クエリと条件付き描画で重いメッシュの描画を省く (shaderProxy.vert.spv が必要).
+  // initialize() の前に設定する.
+  void setOcclusionQueries(bool enable) { m_occlusionQueries = enable; }
+  // 遮蔽クエリの対象にするメッシュの最小三角形数 (既定 4096). initialize() の前に設定する.
+  void setOcclusionQueryMinTriangles(uint32_t triangles) { m_occlusionQueryMinTriangles = triangles; }
+  // 遮蔽クエリの対象メッシュごとの統計 (閾値の調整用)
+  struct MeshQueryStats
+  {
+    uint32_t meshIndex;
+    uint32_t testedFrames;    // ボックスを判定したフレーム数
+    uint32_t occludedFrames;  // そのうち隠れていたフレーム数
+  };
+  const std::vector<MeshQueryStats>& getMeshQueryStats() const { return m_meshQueryStats; }
+  // 読み込みを描画と並行して行う (既定). false なら prepare() で読み込みの完了まで待つ.
+  // initialize() の前に設定する.
+  void setAsyncLoading(bool enable) { m_asyncLoading = enable; }
+
+  // 読み込みの状況. 描画ループから毎フレーム参照しても待ちは発生しない.
+  enum class LoadStage
+  {
+    Cooking,    // キャッシュの検証または調理中 (まだ何も描画しない)
+    Streaming,  // 転送済みのメッシュから描画している
+    Completed,
+    Failed,
+  };
+  struct LoadProgress
+  {
+    LoadStage stage;
+    uint32_t residentMeshes;
+    uint32_t meshCount;       // 調理が終わるまでは 0
+    uint32_t residentTextures;
+    uint32_t textureCount;
+  };
+  LoadProgress getLoadProgress() const
+  {
+    return LoadProgress{ m_loadStage, m_residentMeshCount, uint32_t(m_model.meshes.size()),
+      m_residentTextureCount, uint32_t(m_model.materials.size()) };
+  }
+
+  virtual void prepare() override;
+  virtual void cleanup() override;
+
+  virtual void makeCommandBeforeRenderPass(VkCommandBuffer command) override;
+  virtual void makeCommand(VkCommandBuffer command) override;
+
+  struct Vertex
+  {
+    glm::vec3 pos;
+    glm::vec3 color;
+    glm::vec2 uv;
+  };
+  // 量子化した頂点 (16バイト)
+  //  位置: メッシュのバウンディングボックス内で正規化した 16bit UNORM
+  //  法線: 八面体エンコードした 2x16bit SNORM
+  //  UV  : 半精度浮動小数点
+  struct CompactVertex
+  {
+    uint16_t pos[4];
+    int16_t  normal[2];
+    uint16_t uv[2];
+  };
+private:
+  struct BufferObject
+  {
+    VkBuffer buffer;
+    VkDeviceMemory  memory;
+  };
+  struct TextureObject
+  {
+    VkImage image;
+    VkDeviceMemory memory;
+    VkImageView view;
+  };
+  struct ShaderParameters
+  {
+    glm::mat4 mtxWorld;
+    glm::mat4 mtxView;
+    glm::mat4 mtxProj;
+  };
+  // 量子化した位置の復元用 (プッシュ定数)
+  struct MeshBounds
+  {
+    glm::vec4 boundsMin;
+    glm::vec4 boundsScale;
+  };
+  // カリング用のメッシュレット情報 (meshletCull.comp の Meshlet と同じ配置)
+  struct MeshletInfo
+  {
+    glm::vec4 sphere;   // xyz: 中心, w: 半径
+    glm::vec4 cone;     // xyz: 軸, w: カットオフ
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    int32_t  vertexOffset;
+    uint32_t padding;
+  };
+  // メッシュレットカリングのパラメータ (プッシュ定数). 平面とカメラ位置はモデル空間.
+  struct CullParameters
+  {
+    glm::vec4 frustumPlanes[6];
+    glm::vec4 cameraPosition;
+    uint32_t meshletCount;
+    uint32_t padding[3];
+  };
+  // GPU 駆動描画での描画ごとのデータ (gpuCull.comp の DrawData と同じ配置)
+  struct DrawData
+  {
+    glm::vec4 boundsMin;
+    glm::vec4 boundsMax;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    int32_t  vertexOffset;
+    uint32_t materialIndex;
+    uint32_t bucket;        // 書き込み先のバケット
+    uint32_t commandBase;   // バケットの先頭コマンド位置
+    uint32_t slot;          // バケット内での固定位置 (詰めない場合)
+    uint32_t ordered;       // 描画順を保つか (半透明)
+  };
+  // GPU 駆動描画のカリングパラメータ (プッシュ定数)
+  struct GpuCullParameters
+  {
+    glm::vec4 frustumPlanes[6];
+    uint32_t drawCount;
+    uint32_t compact;   // 可視の描画だけを詰めて書き込むか (描画数を GPU から取る場合)
+    uint32_t padding[2];
+  };
+  // 遮蔽カリングのパラメータ (プッシュ定数, hizCull.comp と同じ配置)
+  struct HiZCullParameters
+  {
+    glm::vec4 frustumPlanes[6];
+    uint32_t drawCount;
+    uint32_t compact;
+    uint32_t phase;     // 1: 前フレームで見えていたものを描く, 2: 深度ピラミッドで残りを判定する
+    uint32_t reversedZ;
+    glm::vec2 pyramidSize;
+    uint32_t pyramidLevels;
+    uint32_t padding;
+  };
+  // 深度ピラミッドの縮小パラメータ (プッシュ定数)
+  struct PyramidParameters
+  {
+    glm::ivec2 srcSize;
+    glm::ivec2 dstSize;
+    uint32_t reversedZ;
+    uint32_t padding[3];
+  };
+  // 遮蔽クエリの代理ボックス (プッシュ定数)
+  struct ProxyBounds
+  {
+    glm::vec4 boundsMin;
+    glm::vec4 boundsMax;
+  };
+  // 遮蔽カリングの統計 (hizCull.comp の stats と同じ並び)
+  enum OcclusionStat
+  {
+    OcclusionOutsideFrustum,
+    OcclusionDrawnEarly,
+    OcclusionDrawnLate,
+    OcclusionOccluded,
+    OcclusionStatCount
+  };
+  // パイプライン/マテリアル/インデックス型が同じ描画のまとまり. 1 回の間接描画で描く.
+  struct DrawBucket
+  {
+    VkPipeline pipeline;
+    VkIndexType indexType;
+    uint32_t meshIndex;     // ディスクリプタセットを使うメッシュ
+    uint32_t firstCommand;
+    uint32_t capacity;
+  };
+  // バッファ/イメージを入出力とするコンピュートパス. ディスクリプタセットは既定ではスワップチェイン画像ごと.
+  struct ComputePass
+  {
+    VkDescriptorSetLayout setLayout;
+    VkDescriptorPool descriptorPool;
+    std::vector<VkDescriptorSet> descriptorSets;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline pipeline;
+  };
+
+  // 簡略化した詳細度レベル. 元のメッシュと同じインデックスプールに格納する.
+  struct MeshLod
+  {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error;    // 元のメッシュからの最大誤差 (モデル空間の距離)
+  };
+
+  struct ModelMesh
+  {
+    // ジオメトリプール内での位置 (firstIndex は indexType のプール内)
+    VkIndexType indexType;
+    uint32_t firstIndex;
+    int32_t  vertexOffset;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    // バウンディングボックス (量子化した位置の復元にも使う)
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    // GeometryPool::meshlets 内の範囲
+    uint32_t firstMeshlet;
+    uint32_t meshletCount;
+    // 詳細な順に並んだ簡略化レベル (レベル 0 は firstIndex/indexCount)
+    std::vector<MeshLod> lods;
+
+    int materialIndex;
+    // ジオメトリの転送を送信済みか (非同期読み込み中はこれが立ったメッシュだけを描く)
+    bool resident;
+
+    std::vector<VkDescriptorSet> descriptorSet;
+  };
+  struct Material
+  {
+    TextureObject texture;
+    Microsoft::glTF::AlphaMode alphaMode;
+    // スワップチェイン画像ごとのディスクリプタセットが本来のテクスチャを指しているか.
+    // 届くまでは m_placeholderTexture を指す. 使うメッシュが無ければ空.
+    std::vector<uint8_t> descriptorResident;
+  };
+  struct Model
+  {
+    std::vector<ModelMesh> meshes;
+    std::vector<Material> materials;
+  };
+  // 全モデルの頂点/インデックスをそれぞれ 1 つのバッファにまとめたもの
+  struct GeometryPool
+  {
+    BufferObject vertexBuffer;
+    uint32_t vertexCount;
+    // 頂点数が 65536 以下のメッシュは 16bit インデックスを使う.
+    BufferObject indexBuffer16;
+    BufferObject indexBuffer32;
+    // 全メッシュのメッシュレット
+    BufferObject meshletBuffer;
+    std::vector<MeshletInfo> meshlets;
+  };
+
+  void prepareUniformBuffers();
+  void prepareDescriptorSetLayout();
+  void prepareDescriptorPool();
+  void prepareDescriptorSet();
+  void prepareMeshletCulling();
+  void prepareGpuDrivenRendering();
+  void recordMeshletCulling(VkCommandBuffer command, const FrustumPlanes& frustum);
+  void recordGpuCulling(VkCommandBuffer command, const FrustumPlanes& frustum);
+  void drawGpuDriven(VkCommandBuffer command, VkBuffer commandBuffer, VkBuffer countBuffer);
+  void prepareOcclusionCulling(uint32_t commandCount);
+  void recordOcclusionCulling(VkCommandBuffer command, const FrustumPlanes& frustum);
+  void dispatchHiZCulling(VkCommandBuffer command, const FrustumPlanes& frustum, uint32_t phase);
+  void buildDepthPyramid(VkCommandBuffer command);
+  void prepareOcclusionQueries();
+  void resolveOcclusionQueries(VkCommandBuffer command);
+  void drawOcclusionProxies(VkCommandBuffer command);
+  void reportOcclusionQueries() const;
+  void drawMesh(VkCommandBuffer command, const ModelMesh& mesh);
+  ComputePass createComputePass(const char* shaderFile, uint32_t bufferCount, uint32_t pushConstantSize);
+  ComputePass createComputePass(const char* shaderFile, const std::vector<VkDescriptorType>& bindingTypes, uint32_t setCount, uint32_t pushConstantSize);
+  void updateComputeDescriptors(ComputePass& pass, uint32_t setIndex, const std::vector<VkBuffer>& buffers);
+  void destroyComputePass(ComputePass& pass);
+  uint32_t selectLod(const ModelMesh& mesh) const;
+
+  BufferObject createBuffer(uint32_t size, VkBufferUsageFlags usage, MemoryUsage memUsage, MemoryCategory category, const void* initialData);
+  VkPipelineShaderStageCreateInfo loadShaderModule(const char* fileName, VkShaderStageFlagBits stage);
+  VkSampler createSampler();
+  TextureObject createTexture(uint32_t width, uint32_t height, const void* pixels);
+
+  CookSettings getCookSettings() const;
+  // 調理して結果を出力する. 失敗した場合は false.
+  bool cookModel(const wchar_t* modelFileName, CookedModelWriter& writer, const CookSettings& settings);
+  // キャッシュをマップして検証する. 使えない場合は閉じて nullptr を返す.
+  const CookedModelHeader* openModelCache(const wchar_t* cacheFileName, uint64_t sourceHash, uint32_t options);
+  // キャッシュを開くか調理して, 調理済みのモデルを返す. 失敗した場合は nullptr.
+  // 非同期読み込みではワーカースレッドで呼ばれる.
+  const CookedModelHeader* acquireCookedModel(const std::wstring& modelFileName);
+  // streaming が true の場合はバッファとメッシュ/マテリアルの情報だけを作り, 中身は streamModel() で転送する.
+  void loadCookedModel(const uint8_t* data, const CookedModelHeader& header, bool streaming);
+  // 非同期読み込みを進める (描画スレッドで毎フレーム呼ぶ).
+  void updateLoading();
+  void streamModel();
+  bool refreshMaterialDescriptors();
+  void writeTextureDescriptor(VkDescriptorSet descriptorSet, VkImageView view);
+  void finishLoading();
+
+  Model m_model;
+  GeometryPool m_geometry;
+  // 量子化した頂点形式を使うか (shaderCompact.vert.spv が必要)
+  bool m_compactVertices;
+  // 読み込み時にメッシュの最適化を行うか
+  bool m_optimizeMeshes;
+  // メッシュレット単位で視錐台/裏面カリングを行うか (meshletCull.comp.spv が必要)
+  bool m_meshletCulling;
+  // 読み込み時に LOD を生成するか. 誤差が画面上で m_lodPixelError ピクセル以内のレベルを選ぶ.
+  bool m_generateLods;
+  float m_lodPixelError;
+  // 現在のフレームの行列 (LOD 選択にも使う)
+  ShaderParameters m_sceneParameters;
+  // メッシュ単位の視錐台カリング (CPU). m_meshBoxes の番号は m_model.meshes と同じ.
+  bool m_frustumCulling;
+  BoundingBoxSoA m_meshBoxes;
+  std::vector<uint8_t> m_meshVisible;
+  size_t m_visibleMeshCount;
+  // フレーム時間の計測用
+  std::chrono::steady_clock::time_point m_frameTimeStart;
+  uint32_t m_frameCount;
+
+  std::vector<BufferObject> m_uniformBuffers;
+
+  VkDescriptorSetLayout m_descriptorSetLayout;
+  VkDescriptorPool  m_descriptorPool;
+
+  VkSampler m_sampler;
+
+  VkPipelineLayout m_pipelineLayout;
+  VkPipeline  m_pipelineOpaque;
+  VkPipeline  m_pipelineAlpha;
+
+  // メッシュレットカリング用. 間接描画コマンドはスワップチェイン画像ごとに持つ.
+  std::vector<BufferObject> m_indirectBuffers;
+  ComputePass m_meshletCullPass;
+
+  // GPU 駆動描画 (gpuCull.comp.spv が必要). 描画コマンドと描画数はスワップチェイン画像ごと.
+  bool m_gpuDriven;
+  ComputePass m_gpuCullPass;
+  BufferObject m_drawDataBuffer;
+  std::vector<BufferObject> m_drawCommandBuffers;
+  std::vector<BufferObject> m_drawCountBuffers;
+  std::vector<DrawBucket> m_drawBuckets;
+  uint32_t m_drawCount;
+
+  // Hi-Z による遮蔽カリング (hizCull.comp.spv, hizDownsample.comp.spv が必要).
+  // 前のフレームで見えていた描画を先に描き, その深度から作ったピラミッドで残りを判定して描く.
+  bool m_occlusionCulling;
+  VkRenderPass m_earlyRenderPass;
+  // 深度ピラミッド. レベル 0 はデプスバッファの半分のサイズ. 常に GENERAL レイアウトで使う.
+  TextureObject m_depthPyramid;
+  std::vector<VkImageView> m_pyramidLevelViews;
+  VkExtent2D m_pyramidExtent;
+  uint32_t m_pyramidLevels;
+  VkSampler m_pyramidSampler;
+  bool m_pyramidInitialized;
+  ComputePass m_pyramidPass;    // ディスクリプタセットはレベルごと
+  ComputePass m_hizCullPass;    // ディスクリプタセットはスワップチェイン画像ごとに前半/後半の 2 つ
+  BufferObject m_visibilityBuffer;
+  std::vector<BufferObject> m_earlyCommandBuffers;
+  std::vector<BufferObject> m_earlyCountBuffers;
+  std::vector<BufferObject> m_occlusionStatsBuffers;
+  uint32_t m_occlusionStats[OcclusionStatCount];
+
+  // 遮蔽クエリと条件付き描画 (shaderProxy.vert.spv と VK_EXT_conditional_rendering が必要).
+  // 三角形数が m_occlusionQueryMinTriangles 以上のメッシュは, 前のフレームで
+  // バウンディングボックスが見えなかった場合に GPU 側で描画を省く. CPU での待ちはない.
+  bool m_occlusionQueries;
+  uint32_t m_occlusionQueryMinTriangles;
+  std::vector<int32_t> m_meshQuerySlots;    // メッシュごとのクエリ番号 (対象外は -1)
+  std::vector<uint32_t> m_queryMeshes;      // クエリ番号ごとのメッシュ
+  VkQueryPool m_queryPool;
+  bool m_queriesIssued;
+  // 直前に発行したクエリでボックスを判定したか (視錐台外は判定しない)
+  std::vector<uint8_t> m_queryTested;
+  // クエリ結果のコピー先 (条件付き描画の条件). スワップチェイン画像ごと.
+  std::vector<BufferObject> m_predicateBuffers;
+  // 各コピー先に書き込んだ結果を判定したか. 空なら未書き込み.
+  std::vector<std::vector<uint8_t>> m_predicateTested;
+  VkPipelineLayout m_proxyPipelineLayout;
+  VkPipeline m_proxyPipeline;
+  VkPipeline m_proxyPipelineNoDepth;  // カメラがボックス内にある場合
+  std::vector<MeshQueryStats> m_meshQueryStats;
+  uint32_t m_queryOccludedCount;      // 直前に読み戻した結果で隠れていた数
+
+  // インスタンス描画. 空なら通常の描画 (インスタンス数 1).
+  // LOD やカリングはモデル単位で判定するため, インスタンス描画では使わない.
+  std::vector<InstanceData> m_instances;
+  BufferObject m_instanceBuffer;
+  uint32_t m_instanceCount;
+
+  // 描画キュー (パス, パイプライン, マテリアル, 深度の順にソート).
+  // 不透明は手前から奥へ, 半透明は奥から手前へ描く.
+  RenderQueue m_renderQueue;
+  // 直前のフレームで記録したバインド数と, 直前と同じ状態のため省いた数
+  uint32_t m_bindCount;
+  uint32_t m_bindSkipped;
+
+  // 調理済みモデルのキャッシュ (元ファイル名 + ".<設定>.cache", GetCookedCacheFileName).
+  // 設定ごとに別のファイルのため, -instances などで設定を切り替えても作り直しにならない.
+  // 元ファイルのハッシュと設定が一致すれば, 解析や最適化を省いてマップ領域からそのまま転送する.
+  // 一致しない場合は調理して書き出してから使う. asset_cooker で事前に作っておくこともできる.
+  bool m_useModelCache;
+  MappedFile m_cacheFile;
+  // キャッシュを使えない場合にメモリ上で調理した結果. 転送が終わるまで保持する.
+  CookedModelWriter m_cookWriter;
+
+  // 非同期読み込み. 調理 (またはキャッシュの検証) はワーカースレッドで行い,
+  // 転送は描画スレッドで 1 フレームあたり m_streamingBudget バイトまでに分けて行う.
+  // メッシュはジオメトリを転送した時点から描き, テクスチャは届くまで m_placeholderTexture を使う.
+  bool m_asyncLoading;
+  LoadStage m_loadStage;
+  std::future<const CookedModelHeader*> m_loadTask;
+  const CookedModelHeader* m_cookedHeader;
+  const char* m_cookedFrom;
+  std::chrono::steady_clock::time_point m_loadStart;
+  uint32_t m_residentMeshCount;
+  uint32_t m_residentTextureCount;
+  VkDeviceSize m_streamingBudget;
+  UploadTicket m_streamTicket;
+  TextureObject m_placeholderTexture;
 };
\ No newline at end of file
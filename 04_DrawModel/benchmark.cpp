@@ -0,0 +1,120 @@
+﻿#include "benchmark.h"
+#include "frustumcull.h"
+#include "vertexassembly.h"
+
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <vector>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+namespace
+{
+  // 処理を iterations 回実行した 1 回あたりの時間 (ミリ秒)
+  template<class Func>
+  double Measure(int iterations, Func func)
+  {
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+      func();
+    }
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / iterations;
+  }
+}
+
+string RunFrustumCullBenchmark(size_t boxCount, int iterations)
+{
+  // 原点から -Z 方向を見る透視投影 (列優先, 深度 [0,1]).
+  const float fovy = 45.0f * 3.14159265f / 180.0f, aspect = 640.0f / 480.0f, zNear = 0.1f, zFar = 200.0f;
+  const float f = 1.0f / tan(fovy * 0.5f);
+  float proj[16] = {};
+  proj[0] = f / aspect;
+  proj[5] = f;
+  proj[10] = zFar / (zNear - zFar);
+  proj[11] = -1.0f;
+  proj[14] = -(zFar * zNear) / (zFar - zNear);
+  auto frustum = ExtractFrustumPlanes(proj);
+
+  mt19937 rng(12345);
+  uniform_real_distribution<float> position(-150.0f, 150.0f), extent(0.1f, 2.0f);
+  BoundingBoxSoA boxes;
+  for (size_t i = 0; i < boxCount; ++i)
+  {
+    float center[3] = { position(rng), position(rng), position(rng) };
+    float half[3] = { extent(rng), extent(rng), extent(rng) };
+    float boundsMin[3] = { center[0] - half[0], center[1] - half[1], center[2] - half[2] };
+    float boundsMax[3] = { center[0] + half[0], center[1] + half[1], center[2] + half[2] };
+    boxes.add(boundsMin, boundsMax);
+  }
+
+  vector<uint8_t> visibleScalar(boxCount), visibleSimd(boxCount);
+  size_t countScalar = 0, countSimd = 0;
+  auto timeScalar = Measure(iterations, [&]() { countScalar = boxes.cullScalar(frustum, visibleScalar.data()); });
+  auto timeSimd = Measure(iterations, [&]() { countSimd = boxes.cullSimd(frustum, visibleSimd.data()); });
+
+  stringstream ss;
+  ss << "Frustum cull benchmark (" << boxCount << " boxes, " << iterations << " iterations)" << endl;
+  ss << "  scalar: " << timeScalar << " ms, visible " << countScalar << endl;
+  ss << "  simd  : " << timeSimd << " ms, visible " << countSimd
+    << ", x" << (timeSimd > 0.0 ? timeScalar / timeSimd : 0.0) << endl;
+  ss << "  results " << (visibleScalar == visibleSimd ? "match" : "DIFFER") << endl;
+  return ss.str();
+}
+
+string RunVertexAssemblyBenchmark(size_t vertexCount, int iterations)
+{
+  // アクセッサと同じく属性ごとに詰めて並んだストリーム
+  mt19937 rng(12345);
+  uniform_real_distribution<float> value(-1.0f, 1.0f);
+  vector<float> positions(vertexCount * 3), normals(vertexCount * 3), uvs(vertexCount * 2);
+  for (auto* stream : { &positions, &normals, &uvs })
+  {
+    for (auto& v : *stream)
+    {
+      v = value(rng);
+    }
+  }
+  VertexStreams streams{
+    positions.data(), sizeof(float) * 3,
+    normals.data(), sizeof(float) * 3,
+    uvs.data(), sizeof(float) * 2
+  };
+
+  // 従来の方法: 予約なしの配列へ 1 頂点ずつ追加する.
+  struct Vertex
+  {
+    float pos[3];
+    float normal[3];
+    float uv[2];
+  };
+  vector<Vertex> appended;
+  auto timeAppend = Measure(iterations, [&]() {
+    vector<Vertex> vertices;
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+      vertices.emplace_back(Vertex{
+        { positions[3 * i], positions[3 * i + 1], positions[3 * i + 2] },
+        { normals[3 * i], normals[3 * i + 1], normals[3 * i + 2] },
+        { uvs[2 * i], uvs[2 * i + 1] } });
+    }
+    appended.swap(vertices);
+  });
+
+  vector<float> scalar(vertexCount * InterleavedVertexFloats), simd(vertexCount * InterleavedVertexFloats);
+  auto timeScalar = Measure(iterations, [&]() { InterleaveVerticesScalar(scalar.data(), streams, nullptr, vertexCount); });
+  auto timeSimd = Measure(iterations, [&]() { InterleaveVerticesSimd(simd.data(), streams, nullptr, vertexCount); });
+  bool match = scalar == simd && appended.size() == vertexCount &&
+    (vertexCount == 0 || memcmp(appended.data(), simd.data(), sizeof(float) * simd.size()) == 0);
+
+  stringstream ss;
+  ss << "Vertex assembly benchmark (" << vertexCount << " vertices, " << iterations << " iterations)" << endl;
+  ss << "  emplace_back: " << timeAppend << " ms" << endl;
+  ss << "  scalar      : " << timeScalar << " ms, x" << (timeScalar > 0.0 ? timeAppend / timeScalar : 0.0) << endl;
+  ss << "  simd        : " << timeSimd << " ms, x" << (timeSimd > 0.0 ? timeAppend / timeSimd : 0.0) << endl;
+  ss << "  results " << (match ? "match" : "DIFFER") << endl;
+  return ss.str();
+}
@@ -0,0 +1,12 @@
+﻿#pragma once
+#include <string>
+#include <cstddef>
+
+// CPU 側処理の性能計測. 結果は文字列で返す.
+
+// ランダムに配置した boxCount 個のバウンディングボックスを視錐台カリングする.
+std::string RunFrustumCullBenchmark(size_t boxCount = 100000, int iterations = 100);
+
+// vertexCount 頂点の合成プリミティブの頂点を組み立てる.
+// 属性ごとの配列から emplace_back で詰める従来の方法と, 確保済み領域へのインターリーブ (scalar/SIMD) を比べる.
+std::string RunVertexAssemblyBenchmark(size_t vertexCount = 1000000, int iterations = 20);
@@ -0,0 +1,148 @@
+﻿#include "frustumcull.h"
+
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define FRUSTUMCULL_USE_SSE
+#endif
+
+using namespace std;
+
+FrustumPlanes ExtractFrustumPlanes(const float* matrix)
+{
+  // 行 i の要素は matrix[列 * 4 + i]
+  auto row = [&](int i, float out[4]) {
+    for (int c = 0; c < 4; ++c)
+    {
+      out[c] = matrix[c * 4 + i];
+    }
+  };
+  float r0[4], r1[4], r2[4], r3[4];
+  row(0, r0); row(1, r1); row(2, r2); row(3, r3);
+
+  FrustumPlanes frustum;
+  for (int c = 0; c < 4; ++c)
+  {
+    frustum.planes[0][c] = r3[c] + r0[c];  // 左
+    frustum.planes[1][c] = r3[c] - r0[c];  // 右
+    frustum.planes[2][c] = r3[c] + r1[c];  // 下
+    frustum.planes[3][c] = r3[c] - r1[c];  // 上
+    frustum.planes[4][c] = r2[c];          // 深度 0 側
+    frustum.planes[5][c] = r3[c] - r2[c];  // 深度 1 側
+  }
+  // 球の判定にも使えるよう法線を正規化しておく.
+  for (auto& p : frustum.planes)
+  {
+    float length = sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+    if (length > 0.0f)
+    {
+      for (auto& v : p)
+      {
+        v /= length;
+      }
+    }
+  }
+  return frustum;
+}
+
+void BoundingBoxSoA::clear()
+{
+  for (auto* v : { &m_centerX, &m_centerY, &m_centerZ, &m_extentX, &m_extentY, &m_extentZ })
+  {
+    v->clear();
+  }
+  m_count = 0;
+}
+
+size_t BoundingBoxSoA::add(const float boundsMin[3], const float boundsMax[3])
+{
+  auto index = m_count++;
+  // 4 個単位に切り上げた長さを保つ (余りは常に可視となる空のボックス).
+  auto capacity = (m_count + 3) & ~size_t(3);
+  for (auto* v : { &m_centerX, &m_centerY, &m_centerZ, &m_extentX, &m_extentY, &m_extentZ })
+  {
+    v->resize(capacity, 0.0f);
+  }
+  m_centerX[index] = (boundsMin[0] + boundsMax[0]) * 0.5f;
+  m_centerY[index] = (boundsMin[1] + boundsMax[1]) * 0.5f;
+  m_centerZ[index] = (boundsMin[2] + boundsMax[2]) * 0.5f;
+  m_extentX[index] = (boundsMax[0] - boundsMin[0]) * 0.5f;
+  m_extentY[index] = (boundsMax[1] - boundsMin[1]) * 0.5f;
+  m_extentZ[index] = (boundsMax[2] - boundsMin[2]) * 0.5f;
+  return index;
+}
+
+size_t BoundingBoxSoA::cullScalar(const FrustumPlanes& frustum, uint8_t* visible) const
+{
+  size_t visibleCount = 0;
+  for (size_t i = 0; i < m_count; ++i)
+  {
+    bool inside = true;
+    for (const auto& p : frustum.planes)
+    {
+      // 中心の符号付き距離と, 平面法線方向へのボックスの半径を比べる.
+      float distance = p[0] * m_centerX[i] + p[1] * m_centerY[i] + p[2] * m_centerZ[i] + p[3];
+      float radius = fabs(p[0]) * m_extentX[i] + fabs(p[1]) * m_extentY[i] + fabs(p[2]) * m_extentZ[i];
+      inside = inside && distance + radius >= 0.0f;
+    }
+    visible[i] = inside ? 1 : 0;
+    visibleCount += visible[i];
+  }
+  return visibleCount;
+}
+
+size_t BoundingBoxSoA::cullSimd(const FrustumPlanes& frustum, uint8_t* visible) const
+{
+#ifdef FRUSTUMCULL_USE_SSE
+  // 平面の係数は全レーンに展開しておく.
+  __m128 planeX[6], planeY[6], planeZ[6], planeD[6], absX[6], absY[6], absZ[6];
+  for (int p = 0; p < 6; ++p)
+  {
+    planeX[p] = _mm_set1_ps(frustum.planes[p][0]);
+    planeY[p] = _mm_set1_ps(frustum.planes[p][1]);
+    planeZ[p] = _mm_set1_ps(frustum.planes[p][2]);
+    planeD[p] = _mm_set1_ps(frustum.planes[p][3]);
+    absX[p] = _mm_set1_ps(fabs(frustum.planes[p][0]));
+    absY[p] = _mm_set1_ps(fabs(frustum.planes[p][1]));
+    absZ[p] = _mm_set1_ps(fabs(frustum.planes[p][2]));
+  }
+  const __m128 zero = _mm_setzero_ps();
+  size_t visibleCount = 0;
+  for (size_t i = 0; i < m_count; i += 4)
+  {
+    __m128 cx = _mm_loadu_ps(&m_centerX[i]);
+    __m128 cy = _mm_loadu_ps(&m_centerY[i]);
+    __m128 cz = _mm_loadu_ps(&m_centerZ[i]);
+    __m128 ex = _mm_loadu_ps(&m_extentX[i]);
+    __m128 ey = _mm_loadu_ps(&m_extentY[i]);
+    __m128 ez = _mm_loadu_ps(&m_extentZ[i]);
+    __m128 inside = _mm_cmpeq_ps(zero, zero);
+    for (int p = 0; p < 6; ++p)
+    {
+      __m128 distance = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(planeX[p], cx), _mm_mul_ps(planeY[p], cy)),
+        _mm_add_ps(_mm_mul_ps(planeZ[p], cz), planeD[p]));
+      __m128 radius = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(absX[p], ex), _mm_mul_ps(absY[p], ey)),
+        _mm_mul_ps(absZ[p], ez));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), zero));
+    }
+    int mask = _mm_movemask_ps(inside);
+    size_t lanes = (m_count - i < 4) ? m_count - i : 4;
+    for (size_t k = 0; k < lanes; ++k)
+    {
+      visible[i + k] = uint8_t((mask >> k) & 1);
+      visibleCount += visible[i + k];
+    }
+  }
+  return visibleCount;
+#else
+  return cullScalar(frustum, visible);
+#endif
+}
+
+size_t BoundingBoxSoA::cull(const FrustumPlanes& frustum, uint8_t* visible) const
+{
+  return cullSimd(frustum, visible);
+}
@@ -0,0 +1,39 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// 視錐台カリング (CPU). バウンディングボックスを SoA で保持し, SIMD で 4 個ずつ判定する.
+
+// 平面 ax+by+cz+d >= 0 を内側とする 6 平面.
+struct FrustumPlanes
+{
+  float planes[6][4];
+};
+
+// 列優先の 4x4 行列 (射影 * ビュー * ワールド) から, ワールド変換前の空間での平面を取り出す.
+// 深度範囲は [0,1] を前提とする (逆Z でも同じ).
+FrustumPlanes ExtractFrustumPlanes(const float* matrix);
+
+// 中心と半径で表したバウンディングボックス群.
+// 判定は 4 個単位で行うため, 各配列は 4 の倍数の長さに切り上げて確保する.
+class BoundingBoxSoA
+{
+public:
+  BoundingBoxSoA() : m_count(0) { }
+
+  void clear();
+  // 追加したボックスの番号を返す.
+  size_t add(const float boundsMin[3], const float boundsMax[3]);
+  size_t size() const { return m_count; }
+
+  // 判定結果を visible[i] に 0/1 で書き込み, 可視数を返す.
+  size_t cullScalar(const FrustumPlanes& frustum, uint8_t* visible) const;
+  size_t cullSimd(const FrustumPlanes& frustum, uint8_t* visible) const;
+  // 使える場合は SIMD 版を使う.
+  size_t cull(const FrustumPlanes& frustum, uint8_t* visible) const;
+private:
+  std::vector<float> m_centerX, m_centerY, m_centerZ;
+  std::vector<float> m_extentX, m_extentY, m_extentZ;
+  size_t m_count;
+};
@@ -1,40 +1,126 @@
-﻿#define WIN32_LEAN_AND_MEAN
-#include <windows.h>
-
-#include <vector>
-#include <array>
-#include <cassert>
-#include <sstream>
-#include <numeric>
-
-#include "ModelApp.h"
-
-#pragma comment(lib, "vulkan-1.lib")
-
-const int WindowWidth = 640, WindowHeight = 480;
-const char* AppTitle = "DrawModel";
-
-int __stdcall wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLine, int nCmdShow)
-{
-  UNREFERENCED_PARAMETER(hPrevInstance);
-  UNREFERENCED_PARAMETER(lpCmdLine);
-  glfwInit();
-  glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-  glfwWindowHint(GLFW_RESIZABLE, 0);
-  auto window = glfwCreateWindow(WindowWidth, WindowHeight, AppTitle, nullptr, nullptr);
-
-  // Vulkan 初期化
-  ModelApp theApp;
-  theApp.initialize(window, AppTitle);
-
-  while (glfwWindowShouldClose(window) == GLFW_FALSE)
-  {
-    glfwPollEvents();
-    theApp.render();
-  }
-
-  // Vulkan 終了
-  theApp.terminate();
-  glfwTerminate();
-  return 0;
-}
+﻿#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include <vector>
+#include <array>
+#include <cassert>
+#include <sstream>
+#include <numeric>
+#include <algorithm>
+
+#include "ModelApp.h"
+#include "benchmark.h"
+
+#pragma comment(lib, "vulkan-1.lib")
+
+const int WindowWidth = 640, WindowHeight = 480;
+const char* AppTitle = "DrawModel";
+
+// 読み込み中は進み具合をタイトルに表示する.
+static std::string MakeTitle(const ModelApp::LoadProgress& progress)
+{
+  std::stringstream ss;
+  ss << AppTitle;
+  switch (progress.stage)
+  {
+  case ModelApp::LoadStage::Cooking:
+    ss << " - cooking...";
+    break;
+  case ModelApp::LoadStage::Streaming:
+    ss << " - loading meshes " << progress.residentMeshes << "/" << progress.meshCount
+      << ", textures " << progress.residentTextures << "/" << progress.textureCount;
+    break;
+  case ModelApp::LoadStage::Failed:
+    ss << " - failed to load the model";
+    break;
+  default:
+    break;
+  }
+  return ss.str();
+}
+
+int __stdcall wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLine, int nCmdShow)
+{
+  UNREFERENCED_PARAMETER(hPrevInstance);
+
+  // -benchmark 指定時は CPU 処理の計測のみ行って終了する.
+  if (wcsstr(lpCmdLine, L"-benchmark") != nullptr)
+  {
+    OutputDebugStringA(RunFrustumCullBenchmark().c_str());
+    OutputDebugStringA(RunVertexAssemblyBenchmark().c_str());
+    return 0;
+  }
+  glfwInit();
+  glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+  glfwWindowHint(GLFW_RESIZABLE, 0);
+  auto window = glfwCreateWindow(WindowWidth, WindowHeight, AppTitle, nullptr, nullptr);
+
+  // Vulkan 初期化
+  ModelApp theApp;
+  // -instances N でモデルを N 体並べてインスタンス描画する.
+  if (auto option = wcsstr(lpCmdLine, L"-instances"))
+  {
+    auto instanceCount = uint32_t((std::max)(_wtoi(option + wcslen(L"-instances")), 1));
+    theApp.setInstances(MakeInstanceGrid(instanceCount, 1.0f));
+  }
+  // -compact で量子化した頂点形式を使う (頂点サイズとフレーム時間の比較用).
+  if (wcsstr(lpCmdLine, L"-compact") != nullptr)
+  {
+    theApp.setCompactVertices(true);
+  }
+  // -meshlets でメッシュレット単位の視錐台/裏面カリングを行う.
+  if (wcsstr(lpCmdLine, L"-meshlets") != nullptr)
+  {
+    theApp.setMeshletCulling(true);
+  }
+  // -gpudriven でカリングと描画コマンドの生成を GPU で行う.
+  if (wcsstr(lpCmdLine, L"-gpudriven") != nullptr)
+  {
+    theApp.setGpuDriven(true);
+  }
+  // -hiz で前フレームの可視性と深度ピラミッドによる遮蔽カリングを行う (GPU 駆動描画を含む).
+  if (wcsstr(lpCmdLine, L"-hiz") != nullptr)
+  {
+    theApp.setOcclusionCulling(true);
+  }
+  // -queries [N] で遮蔽クエリの結果による条件付き描画を行う. N は対象にする最小三角形数.
+  if (auto option = wcsstr(lpCmdLine, L"-queries"))
+  {
+    theApp.setOcclusionQueries(true);
+    auto minTriangles = _wtoi(option + wcslen(L"-queries"));
+    if (minTriangles > 0)
+    {
+      theApp.setOcclusionQueryMinTriangles(uint32_t(minTriangles));
+    }
+  }
+  // -staging でホストからの直接コピーを使わずテクスチャを転送する (転送方式の比較用).
+  if (wcsstr(lpCmdLine, L"-staging") != nullptr)
+  {
+    theApp.setPreferHostImageCopy(false);
+  }
+  // -sync で読み込みの完了まで待ってから描画を始める (読み込み時間の比較用).
+  if (wcsstr(lpCmdLine, L"-sync") != nullptr)
+  {
+    theApp.setAsyncLoading(false);
+  }
+  theApp.initialize(window, AppTitle);
+
+  std::string title = AppTitle;
+  while (glfwWindowShouldClose(window) == GLFW_FALSE)
+  {
+    glfwPollEvents();
+    theApp.render();
+
+    auto newTitle = MakeTitle(theApp.getLoadProgress());
+    if (newTitle != title)
+    {
+      glfwSetWindowTitle(window, newTitle.c_str());
+      title = newTitle;
+    }
+  }
+
+  // Vulkan 終了
+  theApp.terminate();
+  glfwTerminate();
+  return 0;
+}
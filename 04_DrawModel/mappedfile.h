@@ -0,0 +1,76 @@
+﻿#pragma once
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <cstdint>
+
+// 読み込み専用でファイル全体をメモリにマップする.
+// 先頭アドレスは割り当て粒度 (64KB) に揃っている.
+class MappedFile
+{
+public:
+  MappedFile() : m_file(INVALID_HANDLE_VALUE), m_mapping(nullptr), m_data(nullptr), m_size(0) { }
+  ~MappedFile() { close(); }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool open(const wchar_t* fileName)
+  {
+    close();
+    m_file = CreateFileW(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE)
+    {
+      return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+    {
+      close();
+      return false;
+    }
+    m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_mapping == nullptr)
+    {
+      close();
+      return false;
+    }
+    m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (m_data == nullptr)
+    {
+      close();
+      return false;
+    }
+    m_size = size_t(size.QuadPart);
+    return true;
+  }
+  void close()
+  {
+    if (m_data)
+    {
+      UnmapViewOfFile(m_data);
+    }
+    if (m_mapping)
+    {
+      CloseHandle(m_mapping);
+    }
+    if (m_file != INVALID_HANDLE_VALUE)
+    {
+      CloseHandle(m_file);
+    }
+    m_file = INVALID_HANDLE_VALUE;
+    m_mapping = nullptr;
+    m_data = nullptr;
+    m_size = 0;
+  }
+
+  const uint8_t* data() const { return m_data; }
+  size_t size() const { return m_size; }
+  bool isOpen() const { return m_data != nullptr; }
+
+private:
+  HANDLE m_file;
+  HANDLE m_mapping;
+  const uint8_t* m_data;
+  size_t m_size;
+};
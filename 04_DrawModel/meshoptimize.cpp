@@ -0,0 +1,744 @@
+﻿#include "meshoptimize.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+
+using namespace std;
+
+namespace
+{
+  // 頂点ごとに参照している三角形の一覧
+  struct TriangleAdjacency
+  {
+    vector<uint32_t> offsets;
+    vector<uint32_t> triangles;
+  };
+
+  void BuildAdjacency(TriangleAdjacency& adjacency, vector<uint32_t>& liveCount, const uint32_t* indices, size_t indexCount, size_t vertexCount)
+  {
+    liveCount.assign(vertexCount, 0);
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+      liveCount[indices[i]]++;
+    }
+    adjacency.offsets.assign(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+      adjacency.offsets[v + 1] = adjacency.offsets[v] + liveCount[v];
+    }
+    adjacency.triangles.resize(indexCount);
+    vector<uint32_t> cursor(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+      adjacency.triangles[cursor[indices[i]]++] = uint32_t(i / 3);
+    }
+  }
+
+  // FIFO キャッシュのシミュレーション. 時刻の差でキャッシュ内かどうかを判定する.
+  class FifoCache
+  {
+  public:
+    FifoCache(size_t vertexCount, uint32_t cacheSize)
+      : m_timestamps(vertexCount, 0), m_time(cacheSize + 1), m_cacheSize(cacheSize) { }
+
+    // キャッシュミスなら true
+    bool access(uint32_t v)
+    {
+      if (m_time - m_timestamps[v] > m_cacheSize)
+      {
+        m_timestamps[v] = m_time++;
+        return true;
+      }
+      return false;
+    }
+    void reset()
+    {
+      // 全頂点がキャッシュ外になるよう時刻を進める.
+      m_time += m_cacheSize + 1;
+    }
+  private:
+    vector<uint32_t> m_timestamps;
+    uint32_t m_time;
+    uint32_t m_cacheSize;
+  };
+
+  const float* GetPosition(const float* positions, size_t positionStride, uint32_t v)
+  {
+    return reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + positionStride * v);
+  }
+
+  // 平面までの距離の二乗和を表す二次形式 (対称 4x4 行列の上三角)
+  struct Quadric
+  {
+    double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+  };
+
+  void AddPlane(Quadric& q, double nx, double ny, double nz, double d)
+  {
+    q.a00 += nx * nx; q.a01 += nx * ny; q.a02 += nx * nz; q.a03 += nx * d;
+    q.a11 += ny * ny; q.a12 += ny * nz; q.a13 += ny * d;
+    q.a22 += nz * nz; q.a23 += nz * d;
+    q.a33 += d * d;
+  }
+
+  void AddQuadric(Quadric& q, const Quadric& r)
+  {
+    q.a00 += r.a00; q.a01 += r.a01; q.a02 += r.a02; q.a03 += r.a03;
+    q.a11 += r.a11; q.a12 += r.a12; q.a13 += r.a13;
+    q.a22 += r.a22; q.a23 += r.a23;
+    q.a33 += r.a33;
+  }
+
+  double EvaluateQuadric(const Quadric& q, const float* p)
+  {
+    double x = p[0], y = p[1], z = p[2];
+    return q.a00 * x * x + 2 * q.a01 * x * y + 2 * q.a02 * x * z + 2 * q.a03 * x
+      + q.a11 * y * y + 2 * q.a12 * y * z + 2 * q.a13 * y
+      + q.a22 * z * z + 2 * q.a23 * z
+      + q.a33;
+  }
+
+  void ComputeNormal(float n[3], const float* p0, const float* p1, const float* p2)
+  {
+    float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+  }
+
+  // メッシュレットの境界球と法線コーンを求める.
+  void ComputeMeshletBounds(Meshlet& meshlet, const uint32_t* indices, const float* positions, size_t positionStride)
+  {
+    const auto* first = indices + meshlet.firstIndex;
+    // 境界球: AABB の中心から最も遠い頂点までを半径とする.
+    float boundsMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float boundsMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (uint32_t i = 0; i < meshlet.indexCount; ++i)
+    {
+      auto p = GetPosition(positions, positionStride, first[i]);
+      for (int k = 0; k < 3; ++k)
+      {
+        boundsMin[k] = (min)(boundsMin[k], p[k]);
+        boundsMax[k] = (max)(boundsMax[k], p[k]);
+      }
+    }
+    float radius2 = 0.0f;
+    for (int k = 0; k < 3; ++k)
+    {
+      meshlet.center[k] = (boundsMin[k] + boundsMax[k]) * 0.5f;
+    }
+    for (uint32_t i = 0; i < meshlet.indexCount; ++i)
+    {
+      auto p = GetPosition(positions, positionStride, first[i]);
+      float d[3] = { p[0] - meshlet.center[0], p[1] - meshlet.center[1], p[2] - meshlet.center[2] };
+      radius2 = (max)(radius2, d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    }
+    meshlet.radius = sqrt(radius2);
+
+    // 法線コーン: 三角形の単位法線の平均を軸とし, 軸から最も離れた法線で広がりを決める.
+    vector<float> normals;
+    normals.reserve(meshlet.indexCount);
+    float axis[3] = { 0.0f, 0.0f, 0.0f };
+    for (uint32_t i = 0; i + 2 < meshlet.indexCount; i += 3)
+    {
+      auto p0 = GetPosition(positions, positionStride, first[i + 0]);
+      auto p1 = GetPosition(positions, positionStride, first[i + 1]);
+      auto p2 = GetPosition(positions, positionStride, first[i + 2]);
+      float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+      float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+      float n[3] = {
+        e1[1] * e2[2] - e1[2] * e2[1],
+        e1[2] * e2[0] - e1[0] * e2[2],
+        e1[0] * e2[1] - e1[1] * e2[0],
+      };
+      float length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      if (length == 0.0f)
+      {
+        continue;   // 縮退した三角形は向きを持たない.
+      }
+      for (int k = 0; k < 3; ++k)
+      {
+        n[k] /= length;
+        axis[k] += n[k];
+        normals.push_back(n[k]);
+      }
+    }
+    meshlet.coneAxis[0] = meshlet.coneAxis[1] = meshlet.coneAxis[2] = 0.0f;
+    meshlet.coneCutoff = 1.0f;
+    float axisLength = sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    if (normals.empty() || axisLength == 0.0f)
+    {
+      return;
+    }
+    float minDot = 1.0f;
+    for (size_t i = 0; i < normals.size(); i += 3)
+    {
+      float d = (normals[i] * axis[0] + normals[i + 1] * axis[1] + normals[i + 2] * axis[2]) / axisLength;
+      minDot = (min)(minDot, d);
+    }
+    for (int k = 0; k < 3; ++k)
+    {
+      meshlet.coneAxis[k] = axis[k] / axisLength;
+    }
+    // 広がりが半球を超える場合は裏向き判定できない.
+    if (minDot > 0.0f)
+    {
+      meshlet.coneCutoff = sqrt(1.0f - minDot * minDot);
+    }
+  }
+}
+
+VertexCacheStats AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+  VertexCacheStats stats{};
+  if (indexCount < 3 || vertexCount == 0)
+  {
+    return stats;
+  }
+  FifoCache cache(vertexCount, cacheSize);
+  size_t misses = 0;
+  vector<bool> used(vertexCount, false);
+  size_t usedCount = 0;
+  for (size_t i = 0; i < indexCount; ++i)
+  {
+    auto v = indices[i];
+    misses += cache.access(v) ? 1 : 0;
+    if (!used[v])
+    {
+      used[v] = true;
+      usedCount++;
+    }
+  }
+  stats.acmr = float(misses) / float(indexCount / 3);
+  stats.atvr = float(misses) / float(usedCount);
+  return stats;
+}
+
+void OptimizeVertexCache(uint32_t* destination, const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+  const size_t triangleCount = indexCount / 3;
+  if (triangleCount == 0 || vertexCount == 0)
+  {
+    return;
+  }
+  // destination と indices が同じ場合に備えて元データを保持する.
+  vector<uint32_t> source(indices, indices + triangleCount * 3);
+
+  TriangleAdjacency adjacency;
+  vector<uint32_t> liveCount;
+  BuildAdjacency(adjacency, liveCount, source.data(), source.size(), vertexCount);
+
+  vector<uint32_t> timestamps(vertexCount, 0);
+  vector<bool> emitted(triangleCount, false);
+  vector<uint32_t> deadEnd;
+  vector<uint32_t> candidates;
+  deadEnd.reserve(indexCount);
+  candidates.reserve(64);
+
+  uint32_t time = cacheSize + 1;
+  size_t output = 0;
+  size_t cursor = 0;
+  int64_t fanning = 0;
+  while (fanning >= 0)
+  {
+    // 扇の中心頂点を共有する三角形をすべて出力する.
+    candidates.clear();
+    auto v = uint32_t(fanning);
+    for (auto i = adjacency.offsets[v]; i < adjacency.offsets[v + 1]; ++i)
+    {
+      auto t = adjacency.triangles[i];
+      if (emitted[t])
+      {
+        continue;
+      }
+      emitted[t] = true;
+      for (int k = 0; k < 3; ++k)
+      {
+        auto tv = source[t * 3 + k];
+        destination[output++] = tv;
+        deadEnd.push_back(tv);
+        candidates.push_back(tv);
+        liveCount[tv]--;
+        if (time - timestamps[tv] > cacheSize)
+        {
+          timestamps[tv] = time++;
+        }
+      }
+    }
+
+    // 次の中心頂点: 出力後もキャッシュに残っている見込みが最も高いもの
+    fanning = -1;
+    int64_t bestPriority = -1;
+    for (auto c : candidates)
+    {
+      if (liveCount[c] == 0)
+      {
+        continue;
+      }
+      int64_t priority = 0;
+      if (int64_t(time) - int64_t(timestamps[c]) + 2 * int64_t(liveCount[c]) <= int64_t(cacheSize))
+      {
+        priority = int64_t(time) - int64_t(timestamps[c]);
+      }
+      if (priority > bestPriority)
+      {
+        bestPriority = priority;
+        fanning = c;
+      }
+    }
+    if (fanning >= 0)
+    {
+      continue;
+    }
+    // 行き詰まった場合は, 最近使った頂点から未出力の三角形を持つものを探す.
+    while (!deadEnd.empty())
+    {
+      auto d = deadEnd.back();
+      deadEnd.pop_back();
+      if (liveCount[d] > 0)
+      {
+        fanning = d;
+        break;
+      }
+    }
+    // それも無ければ先頭から順に探す.
+    while (fanning < 0 && cursor < vertexCount)
+    {
+      if (liveCount[cursor] > 0)
+      {
+        fanning = int64_t(cursor);
+      }
+      ++cursor;
+    }
+  }
+}
+
+void OptimizeOverdraw(uint32_t* destination, const uint32_t* indices, size_t indexCount,
+  const float* positions, size_t positionStride, size_t vertexCount, float threshold, uint32_t cacheSize)
+{
+  const size_t triangleCount = indexCount / 3;
+  if (triangleCount == 0 || vertexCount == 0)
+  {
+    return;
+  }
+  vector<uint32_t> source(indices, indices + triangleCount * 3);
+  auto position = [&](uint32_t v) {
+    return GetPosition(positions, positionStride, v);
+  };
+
+  // 3 頂点ともキャッシュミスになる三角形の位置をクラスタの境界とする.
+  vector<size_t> hardBoundaries;
+  {
+    FifoCache cache(vertexCount, cacheSize);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+      int misses = 0;
+      for (int k = 0; k < 3; ++k)
+      {
+        misses += cache.access(source[t * 3 + k]) ? 1 : 0;
+      }
+      if (t == 0 || misses == 3)
+      {
+        hardBoundaries.push_back(t);
+      }
+    }
+    hardBoundaries.push_back(triangleCount);
+  }
+
+  // さらにキャッシュ効率が threshold 倍に収まる範囲で細かく分割する.
+  vector<size_t> clusters;
+  {
+    FifoCache cache(vertexCount, cacheSize);
+    for (size_t h = 0; h + 1 < hardBoundaries.size(); ++h)
+    {
+      auto start = hardBoundaries[h], end = hardBoundaries[h + 1];
+      cache.reset();
+      size_t misses = 0;
+      for (size_t t = start; t < end; ++t)
+      {
+        for (int k = 0; k < 3; ++k)
+        {
+          misses += cache.access(source[t * 3 + k]) ? 1 : 0;
+        }
+      }
+      const float clusterAcmr = float(misses) / float(end - start);
+
+      clusters.push_back(start);
+      cache.reset();
+      misses = 0;
+      size_t clusterStart = start;
+      for (size_t t = start; t < end; ++t)
+      {
+        for (int k = 0; k < 3; ++k)
+        {
+          misses += cache.access(source[t * 3 + k]) ? 1 : 0;
+        }
+        const float acmr = float(misses) / float(t + 1 - clusterStart);
+        if (t + 1 < end && acmr <= clusterAcmr * threshold)
+        {
+          clusters.push_back(t + 1);
+          clusterStart = t + 1;
+          cache.reset();
+          misses = 0;
+        }
+      }
+    }
+    clusters.push_back(triangleCount);
+  }
+
+  // メッシュ全体の中心
+  float meshCenter[3] = { 0.0f, 0.0f, 0.0f };
+  for (size_t i = 0; i < source.size(); ++i)
+  {
+    auto p = position(source[i]);
+    meshCenter[0] += p[0];
+    meshCenter[1] += p[1];
+    meshCenter[2] += p[2];
+  }
+  for (auto& v : meshCenter)
+  {
+    v /= float(source.size());
+  }
+
+  // クラスタの向き (面積で重み付けした法線) と中心から, 外側を向いている度合いを求める.
+  const size_t clusterCount = clusters.size() - 1;
+  vector<float> sortKeys(clusterCount);
+  for (size_t c = 0; c < clusterCount; ++c)
+  {
+    float center[3] = { 0.0f, 0.0f, 0.0f };
+    float normal[3] = { 0.0f, 0.0f, 0.0f };
+    float area = 0.0f;
+    for (auto t = clusters[c]; t < clusters[c + 1]; ++t)
+    {
+      auto p0 = position(source[t * 3 + 0]);
+      auto p1 = position(source[t * 3 + 1]);
+      auto p2 = position(source[t * 3 + 2]);
+      float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+      float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+      float n[3] = {
+        e1[1] * e2[2] - e1[2] * e2[1],
+        e1[2] * e2[0] - e1[0] * e2[2],
+        e1[0] * e2[1] - e1[1] * e2[0],
+      };
+      float a = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      for (int k = 0; k < 3; ++k)
+      {
+        center[k] += (p0[k] + p1[k] + p2[k]) * (a / 3.0f);
+        normal[k] += n[k];
+      }
+      area += a;
+    }
+    float key = 0.0f;
+    if (area > 0.0f)
+    {
+      float length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+      length = length > 0.0f ? length : 1.0f;
+      for (int k = 0; k < 3; ++k)
+      {
+        key += (center[k] / area - meshCenter[k]) * (normal[k] / length);
+      }
+    }
+    sortKeys[c] = key;
+  }
+
+  // 外側を向いたクラスタほど先に描く.
+  vector<uint32_t> order(clusterCount);
+  for (size_t c = 0; c < clusterCount; ++c)
+  {
+    order[c] = uint32_t(c);
+  }
+  stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+  size_t output = 0;
+  for (auto c : order)
+  {
+    for (auto t = clusters[c]; t < clusters[c + 1]; ++t)
+    {
+      destination[output++] = source[t * 3 + 0];
+      destination[output++] = source[t * 3 + 1];
+      destination[output++] = source[t * 3 + 2];
+    }
+  }
+}
+
+void OptimizeVertexFetchRemap(uint32_t* remap, const uint32_t* indices, size_t indexCount, size_t vertexCount)
+{
+  const uint32_t unused = ~0u;
+  fill(remap, remap + vertexCount, unused);
+  uint32_t next = 0;
+  for (size_t i = 0; i < indexCount; ++i)
+  {
+    auto v = indices[i];
+    if (remap[v] == unused)
+    {
+      remap[v] = next++;
+    }
+  }
+  for (size_t v = 0; v < vertexCount; ++v)
+  {
+    if (remap[v] == unused)
+    {
+      remap[v] = next++;
+    }
+  }
+}
+
+void BuildMeshlets(vector<Meshlet>& meshlets, const uint32_t* indices, size_t indexCount,
+  const float* positions, size_t positionStride, size_t vertexCount, uint32_t maxVertices, uint32_t maxTriangles)
+{
+  meshlets.clear();
+  // 頂点が現在のメッシュレットに含まれているかは, メッシュレット番号の印で判定する.
+  vector<uint32_t> marker(vertexCount, ~0u);
+  uint32_t meshletId = 0;
+  Meshlet current{};
+  auto countNewVertices = [&](const uint32_t* tri) {
+    uint32_t count = 0;
+    for (int k = 0; k < 3; ++k)
+    {
+      bool duplicated = (k > 0 && tri[k] == tri[0]) || (k > 1 && tri[k] == tri[1]);
+      count += (marker[tri[k]] != meshletId && !duplicated) ? 1 : 0;
+    }
+    return count;
+  };
+  auto finish = [&]() {
+    ComputeMeshletBounds(current, indices, positions, positionStride);
+    meshlets.push_back(current);
+    current = Meshlet{};
+    ++meshletId;
+  };
+
+  for (size_t i = 0; i + 2 < indexCount; i += 3)
+  {
+    const auto* tri = indices + i;
+    auto newVertices = countNewVertices(tri);
+    if (current.indexCount > 0 &&
+      (current.vertexCount + newVertices > maxVertices || current.indexCount / 3 + 1 > maxTriangles))
+    {
+      finish();
+      newVertices = countNewVertices(tri);
+    }
+    if (current.indexCount == 0)
+    {
+      current.firstIndex = uint32_t(i);
+    }
+    for (int k = 0; k < 3; ++k)
+    {
+      marker[tri[k]] = meshletId;
+    }
+    current.vertexCount += newVertices;
+    current.indexCount += 3;
+  }
+  if (current.indexCount > 0)
+  {
+    finish();
+  }
+}
+
+size_t SimplifyMesh(uint32_t* destination, const uint32_t* indices, size_t indexCount,
+  const float* positions, size_t positionStride, size_t vertexCount, size_t targetIndexCount, float* error)
+{
+  vector<uint32_t> result(indices, indices + indexCount / 3 * 3);
+  float maxError = 0.0f;
+  auto position = [&](uint32_t v) {
+    return GetPosition(positions, positionStride, v);
+  };
+
+  // 同じ位置の頂点をまとめ, 位置ごとの代表番号を振る.
+  vector<uint32_t> positionId(vertexCount);
+  vector<uint32_t> wedgeCount;
+  {
+    vector<uint32_t> order(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+      order[v] = uint32_t(v);
+    }
+    auto less = [&](uint32_t a, uint32_t b) { return memcmp(position(a), position(b), sizeof(float) * 3) < 0; };
+    sort(order.begin(), order.end(), less);
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+      if (i == 0 || less(order[i - 1], order[i]))
+      {
+        wedgeCount.push_back(0);
+      }
+      positionId[order[i]] = uint32_t(wedgeCount.size() - 1);
+      wedgeCount.back()++;
+    }
+  }
+  // 継ぎ目と境界 (位置で見て 1 つの三角形しか共有しない辺) を固定する.
+  vector<bool> lockedPosition(wedgeCount.size(), false);
+  for (size_t p = 0; p < wedgeCount.size(); ++p)
+  {
+    lockedPosition[p] = wedgeCount[p] > 1;
+  }
+  {
+    vector<uint64_t> edges;
+    edges.reserve(result.size());
+    for (size_t i = 0; i < result.size(); i += 3)
+    {
+      for (int k = 0; k < 3; ++k)
+      {
+        uint64_t a = positionId[result[i + k]], b = positionId[result[i + (k + 1) % 3]];
+        edges.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+      }
+    }
+    sort(edges.begin(), edges.end());
+    for (size_t i = 0; i < edges.size();)
+    {
+      size_t j = i;
+      while (j < edges.size() && edges[j] == edges[i])
+      {
+        ++j;
+      }
+      if (j - i != 2)
+      {
+        lockedPosition[size_t(edges[i] >> 32)] = true;
+        lockedPosition[size_t(edges[i] & 0xFFFFFFFF)] = true;
+      }
+      i = j;
+    }
+  }
+
+  // 頂点ごとに, 周囲の三角形の平面から二次形式を作る.
+  vector<Quadric> quadrics(vertexCount, Quadric{});
+  for (size_t i = 0; i < result.size(); i += 3)
+  {
+    float n[3];
+    ComputeNormal(n, position(result[i]), position(result[i + 1]), position(result[i + 2]));
+    double length = sqrt(double(n[0]) * n[0] + double(n[1]) * n[1] + double(n[2]) * n[2]);
+    if (length == 0.0)
+    {
+      continue;
+    }
+    double nx = n[0] / length, ny = n[1] / length, nz = n[2] / length;
+    auto p0 = position(result[i]);
+    double d = -(nx * p0[0] + ny * p0[1] + nz * p0[2]);
+    for (int k = 0; k < 3; ++k)
+    {
+      AddPlane(quadrics[result[i + k]], nx, ny, nz, d);
+    }
+  }
+
+  // 誤差の小さい辺から, 互いに影響しない範囲でまとめて縮約する処理を繰り返す.
+  struct Collapse
+  {
+    uint32_t from;
+    uint32_t to;
+    double cost;
+  };
+  const size_t targetTriangles = targetIndexCount / 3;
+  vector<Collapse> collapses;
+  vector<uint32_t> remap(vertexCount);
+  vector<bool> touched(vertexCount);
+  TriangleAdjacency adjacency;
+  vector<uint32_t> liveCount;
+  while (result.size() / 3 > targetTriangles)
+  {
+    collapses.clear();
+    for (size_t i = 0; i < result.size(); i += 3)
+    {
+      for (int k = 0; k < 3; ++k)
+      {
+        uint32_t a = result[i + k], b = result[i + (k + 1) % 3];
+        for (int dir = 0; dir < 2; ++dir)
+        {
+          if (!lockedPosition[positionId[a]])
+          {
+            auto cost = EvaluateQuadric(quadrics[a], position(b)) + EvaluateQuadric(quadrics[b], position(b));
+            collapses.push_back(Collapse{ a, b, (max)(cost, 0.0) });
+          }
+          swap(a, b);
+        }
+      }
+    }
+    if (collapses.empty())
+    {
+      break;
+    }
+    sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+    BuildAdjacency(adjacency, liveCount, result.data(), result.size(), vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+      remap[v] = uint32_t(v);
+    }
+    fill(touched.begin(), touched.end(), false);
+    const size_t removeTarget = result.size() / 3 - targetTriangles;
+    size_t removed = 0;
+    for (const auto& c : collapses)
+    {
+      if (removed >= removeTarget)
+      {
+        break;
+      }
+      if (touched[c.from] || touched[c.to])
+      {
+        continue;
+      }
+      // 縮約で裏返る三角形があれば行わない.
+      bool flipped = false;
+      size_t degenerate = 0;
+      for (auto i = adjacency.offsets[c.from]; i < adjacency.offsets[c.from + 1] && !flipped; ++i)
+      {
+        const auto* tri = &result[adjacency.triangles[i] * 3];
+        if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to)
+        {
+          degenerate++;
+          continue;
+        }
+        const float* before[3] = { position(tri[0]), position(tri[1]), position(tri[2]) };
+        const float* after[3] = { before[0], before[1], before[2] };
+        for (int k = 0; k < 3; ++k)
+        {
+          after[k] = tri[k] == c.from ? position(c.to) : before[k];
+        }
+        float n0[3], n1[3];
+        ComputeNormal(n0, before[0], before[1], before[2]);
+        ComputeNormal(n1, after[0], after[1], after[2]);
+        flipped = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] <= 0.0f;
+      }
+      if (flipped)
+      {
+        continue;
+      }
+      // 周囲の三角形の形が変わるため, このパスでは隣接頂点を動かさない.
+      for (auto i = adjacency.offsets[c.from]; i < adjacency.offsets[c.from + 1]; ++i)
+      {
+        const auto* tri = &result[adjacency.triangles[i] * 3];
+        touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+      }
+      remap[c.from] = c.to;
+      AddQuadric(quadrics[c.to], quadrics[c.from]);
+      maxError = (max)(maxError, float(sqrt(c.cost)));
+      removed += degenerate;
+    }
+    if (removed == 0)
+    {
+      break;
+    }
+
+    // 縮約を反映し, 潰れた三角形を取り除く.
+    size_t output = 0;
+    for (size_t i = 0; i < result.size(); i += 3)
+    {
+      uint32_t a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+      if (a != b && b != c && c != a)
+      {
+        result[output++] = a;
+        result[output++] = b;
+        result[output++] = c;
+      }
+    }
+    result.resize(output);
+  }
+
+  copy(result.begin(), result.end(), destination);
+  if (error)
+  {
+    *error = maxError;
+  }
+  return result.size();
+}
@@ -0,0 +1,61 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// 読み込み時に行うメッシュの最適化処理.
+// いずれもメッシュ先頭からの番号で表した三角形リストのインデックスを扱う.
+
+// 頂点キャッシュの効率
+//  ACMR: 三角形あたりのキャッシュミス数 (0.5 が理想, 3.0 が最悪)
+//  ATVR: 頂点あたりのキャッシュミス数 (1.0 が理想)
+struct VertexCacheStats
+{
+  float acmr;
+  float atvr;
+};
+
+// FIFO キャッシュをシミュレートして ACMR/ATVR を求める.
+VertexCacheStats AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = 16);
+
+// Tipsify による頂点キャッシュ向けの三角形並べ替え.
+// destination と indices は同じ領域でもよい.
+void OptimizeVertexCache(uint32_t* destination, const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = 16);
+
+// 頂点キャッシュ効率を threshold 倍まで許容してクラスタに分割し,
+// 外側を向いたクラスタから描くように並べ替えてオーバードローを減らす.
+// positions は stride バイトおきに並んだ float3.
+void OptimizeOverdraw(uint32_t* destination, const uint32_t* indices, size_t indexCount,
+  const float* positions, size_t positionStride, size_t vertexCount, float threshold = 1.05f, uint32_t cacheSize = 16);
+
+// 頂点をインデックスで最初に参照される順に並べ替えるための対応表を作る.
+// remap[旧番号] = 新番号. 参照されない頂点は末尾へ回す.
+void OptimizeVertexFetchRemap(uint32_t* remap, const uint32_t* indices, size_t indexCount, size_t vertexCount);
+
+// メッシュレット (クラスタ). 最適化後のインデックス列の連続した範囲で表す.
+struct Meshlet
+{
+  uint32_t firstIndex;  // メッシュ先頭からのインデックス位置
+  uint32_t indexCount;
+  uint32_t vertexCount; // 参照する頂点数
+  // 境界球
+  float center[3];
+  float radius;
+  // 法線コーン. カメラから中心へのベクトル v について
+  // dot(v, coneAxis) >= coneCutoff * |v| + radius なら全三角形が裏向き.
+  // 裏向き判定ができない場合は coneCutoff = 1.
+  float coneAxis[3];
+  float coneCutoff;
+};
+
+// 三角形を先頭から順に, 頂点数/三角形数の上限に達するまでまとめてメッシュレットにする.
+// 頂点キャッシュ最適化後の並びなら近接した三角形がまとまる.
+void BuildMeshlets(std::vector<Meshlet>& meshlets, const uint32_t* indices, size_t indexCount,
+  const float* positions, size_t positionStride, size_t vertexCount, uint32_t maxVertices = 64, uint32_t maxTriangles = 124);
+
+// 二次誤差メトリクスによる辺の縮約でメッシュを簡略化する.
+// 頂点は既存の頂点へ寄せるだけなので, 結果のインデックスは元の頂点バッファをそのまま参照できる.
+// UV の継ぎ目 (同じ位置に複数の頂点がある) とメッシュ境界の頂点は動かさない.
+// 戻り値は destination に書き込んだインデックス数. error には縮約による最大誤差 (距離) を返す.
+size_t SimplifyMesh(uint32_t* destination, const uint32_t* indices, size_t indexCount,
+  const float* positions, size_t positionStride, size_t vertexCount, size_t targetIndexCount, float* error);
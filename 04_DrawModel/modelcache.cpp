@@ -0,0 +1,198 @@
+﻿#include "modelcache.h"
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <cstring>
+#include <algorithm>
+#include "mappedfile.h"
+
+using namespace std;
+
+uint64_t HashFileContents(const uint8_t* data, size_t size)
+{
+  const uint64_t Prime = 0x100000001b3ull;
+  uint64_t hash = 0xcbf29ce484222325ull;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+  {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    hash = (hash ^ word) * Prime;
+  }
+  for (; i < size; ++i)
+  {
+    hash = (hash ^ data[i]) * Prime;
+  }
+  // 長さも混ぜておく (末尾が 0 のファイルを区別する).
+  return (hash ^ uint64_t(size)) * Prime;
+}
+
+wstring GetCookedCacheFileName(const wstring& sourceFile, uint32_t options)
+{
+  return sourceFile + L"." + to_wstring(options) + L".cache";
+}
+
+bool HashSourceFile(const wchar_t* fileName, uint64_t* hash)
+{
+  MappedFile file;
+  if (!file.open(fileName))
+  {
+    return false;
+  }
+  *hash = HashFileContents(file.data(), file.size());
+  return true;
+}
+
+const CookedModelHeader* ValidateCookedModel(const uint8_t* data, size_t size, uint64_t sourceHash, uint32_t options)
+{
+  if (data == nullptr || size < sizeof(CookedModelHeader))
+  {
+    return nullptr;
+  }
+  const auto* header = reinterpret_cast<const CookedModelHeader*>(data);
+  if (header->magic != CookedModelMagic || header->version != CookedModelVersion ||
+    header->sourceHash != sourceHash || header->options != options || header->vertexStride == 0)
+  {
+    return nullptr;
+  }
+  for (const auto* block : { &header->vertices, &header->indices16, &header->indices32, &header->meshlets,
+    &header->meshes, &header->lods, &header->materials, &header->textures })
+  {
+    if (block->offset > size || block->size > size - block->offset)
+    {
+      return nullptr;
+    }
+  }
+  return header;
+}
+
+bool CookedModelWriter::open(const wchar_t* fileName)
+{
+  cancel();
+  m_fileName = fileName;
+  m_tempName = m_fileName + L".tmp";
+  auto file = CreateFileW(m_tempName.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+  {
+    return false;
+  }
+  m_file = file;
+  m_failed = false;
+  // ヘッダは最後に書き込む.
+  m_position = 0;
+  CookedModelHeader header{};
+  append(&header, sizeof(header));
+  return !m_failed;
+}
+
+bool CookedModelWriter::openMemory()
+{
+  cancel();
+  m_inMemory = true;
+  m_failed = false;
+  m_position = 0;
+  CookedModelHeader header{};
+  append(&header, sizeof(header));
+  return true;
+}
+
+void CookedModelWriter::pad(uint64_t alignment)
+{
+  static const uint8_t zeros[16] = {};
+  auto padding = (alignment - m_position % alignment) % alignment;
+  if (padding > 0)
+  {
+    append(zeros, size_t(padding));
+  }
+}
+
+void CookedModelWriter::beginBlock()
+{
+  pad(16);
+  m_blockStart = m_position;
+}
+
+uint64_t CookedModelWriter::append(const void* data, size_t size)
+{
+  auto offset = m_position - m_blockStart;
+  const auto* src = static_cast<const uint8_t*>(data);
+  if (m_inMemory)
+  {
+    m_memory.insert(m_memory.end(), src, src + size);
+    m_position += size;
+    return offset;
+  }
+  while (size > 0 && !m_failed)
+  {
+    // WriteFile は 1 回あたり 4GB 未満
+    auto chunk = DWORD((min)(size, size_t(1) << 30));
+    DWORD written = 0;
+    if (!WriteFile(m_file, src, chunk, &written, nullptr) || written != chunk)
+    {
+      m_failed = true;
+      break;
+    }
+    src += chunk;
+    size -= chunk;
+    m_position += chunk;
+  }
+  return offset;
+}
+
+CookedBlock CookedModelWriter::endBlock()
+{
+  return CookedBlock{ m_blockStart, m_position - m_blockStart };
+}
+
+CookedBlock CookedModelWriter::writeBlock(const void* data, size_t size)
+{
+  beginBlock();
+  append(data, size);
+  return endBlock();
+}
+
+bool CookedModelWriter::finish(CookedModelHeader header)
+{
+  if (!isOpen())
+  {
+    return false;
+  }
+  header.magic = CookedModelMagic;
+  header.version = CookedModelVersion;
+  if (m_inMemory)
+  {
+    memcpy(m_memory.data(), &header, sizeof(header));
+    m_inMemory = false;
+    return true;
+  }
+  LARGE_INTEGER start{};
+  DWORD written = 0;
+  if (m_failed || !SetFilePointerEx(m_file, start, nullptr, FILE_BEGIN) ||
+    !WriteFile(m_file, &header, sizeof(header), &written, nullptr) || written != sizeof(header))
+  {
+    cancel();
+    return false;
+  }
+  CloseHandle(m_file);
+  m_file = nullptr;
+  if (!MoveFileExW(m_tempName.c_str(), m_fileName.c_str(), MOVEFILE_REPLACE_EXISTING))
+  {
+    DeleteFileW(m_tempName.c_str());
+    return false;
+  }
+  return true;
+}
+
+void CookedModelWriter::cancel()
+{
+  m_inMemory = false;
+  m_memory = std::vector<uint8_t>();
+  if (m_file != nullptr)
+  {
+    CloseHandle(m_file);
+    m_file = nullptr;
+    DeleteFileW(m_tempName.c_str());
+  }
+}
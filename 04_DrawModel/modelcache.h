@@ -0,0 +1,164 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// 調理済みモデルのキャッシュファイル.
+// 読み込み・最適化・テクスチャのデコードを済ませた GPU 向けのデータを格納し,
+// ファイル全体を 1 回マップするだけで転送元として使える.
+// 各ブロックはファイル先頭からのオフセットで表し, 16 バイト境界に揃える.
+
+struct CookedBlock
+{
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct CookedModelHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t sourceHash;    // 元ファイルの内容のハッシュ
+  uint32_t options;       // 生成時の設定 (利用側で定義するビット和)
+  uint32_t vertexStride;  // 頂点 1 つのバイト数
+  uint32_t meshletStride; // メッシュレット 1 つのバイト数
+  uint32_t padding;
+  CookedBlock vertices;
+  CookedBlock indices16;
+  CookedBlock indices32;
+  CookedBlock meshlets;
+  CookedBlock meshes;     // CookedMesh の配列
+  CookedBlock lods;       // CookedLod の配列
+  CookedBlock materials;  // CookedMaterial の配列
+  CookedBlock textures;   // デコード済みの RGBA8 画素
+};
+
+struct CookedMesh
+{
+  uint32_t indexType;     // 0: 16bit, 1: 32bit
+  uint32_t firstIndex;
+  int32_t  vertexOffset;
+  uint32_t vertexCount;
+  uint32_t indexCount;
+  float boundsMin[3];
+  float boundsMax[3];
+  uint32_t firstMeshlet;
+  uint32_t meshletCount;
+  uint32_t firstLod;      // lods ブロック内の位置
+  uint32_t lodCount;
+  int32_t  materialIndex;
+};
+
+struct CookedLod
+{
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  float error;
+};
+
+// 頂点 (浮動小数点). 位置, 法線, UV の順.
+struct CookedVertex
+{
+  float pos[3];
+  float normal[3];
+  float uv[2];
+};
+
+// 量子化した頂点 (16バイト)
+//  位置: メッシュのバウンディングボックス内で正規化した 16bit UNORM
+//  法線: 八面体エンコードした 2x16bit SNORM
+//  UV  : 半精度浮動小数点
+struct CookedCompactVertex
+{
+  uint16_t pos[4];
+  int16_t  normal[2];
+  uint16_t uv[2];
+};
+
+// メッシュレット (meshletCull.comp の Meshlet と同じ配置)
+struct CookedMeshlet
+{
+  float sphere[4];      // xyz: 中心, w: 半径
+  float cone[4];        // xyz: 軸, w: カットオフ
+  uint32_t firstIndex;  // インデックスプール内の位置
+  uint32_t indexCount;
+  int32_t  vertexOffset;
+  uint32_t padding;
+};
+
+struct CookedMaterial
+{
+  uint32_t alphaMode;
+  uint32_t width;
+  uint32_t height;
+  uint32_t padding;
+  uint64_t textureOffset; // textures ブロック先頭からの位置
+  uint64_t textureSize;
+};
+
+const uint32_t CookedModelMagic = 0x4344444D;  // 'MDDC'
+const uint32_t CookedModelVersion = 1;
+
+// ファイル内容のハッシュ (FNV-1a を 8 バイト単位で適用したもの).
+uint64_t HashFileContents(const uint8_t* data, size_t size);
+// ファイルをマップしてハッシュを求める. 開けない場合は false.
+bool HashSourceFile(const wchar_t* fileName, uint64_t* hash);
+
+// キャッシュのファイル名 (元ファイル名 + ".<options>.cache").
+// 設定ごとに別のファイルにするため, 設定を切り替えても互いに上書きしない.
+std::wstring GetCookedCacheFileName(const std::wstring& sourceFile, uint32_t options);
+
+// マップしたキャッシュを検証する. 元ファイルのハッシュや設定が異なる場合, 壊れている場合は nullptr.
+const CookedModelHeader* ValidateCookedModel(const uint8_t* data, size_t size, uint64_t sourceHash, uint32_t options);
+
+template<class T>
+const T* GetCookedBlock(const uint8_t* data, const CookedBlock& block)
+{
+  return reinterpret_cast<const T*>(data + block.offset);
+}
+
+// キャッシュの書き出し. 一時ファイルへ書き込み, finish() で置き換えるため,
+// 途中で失敗しても古いキャッシュや書きかけのファイルが有効とみなされることはない.
+// ファイルの代わりにメモリへ書き出すこともできる (キャッシュを使わない場合).
+class CookedModelWriter
+{
+public:
+  CookedModelWriter() : m_file(nullptr), m_inMemory(false), m_position(0), m_blockStart(0), m_failed(false) { }
+  ~CookedModelWriter() { cancel(); }
+  CookedModelWriter(const CookedModelWriter&) = delete;
+  CookedModelWriter& operator=(const CookedModelWriter&) = delete;
+
+  bool open(const wchar_t* fileName);
+  // メモリへ書き出す. finish() の後, 次に開くまで data() で参照できる.
+  bool openMemory();
+  bool isOpen() const { return m_file != nullptr || m_inMemory; }
+
+  // beginBlock から endBlock までに追加したデータが 1 つのブロックになる.
+  void beginBlock();
+  // 追加したデータのブロック先頭からの位置を返す.
+  uint64_t append(const void* data, size_t size);
+  CookedBlock endBlock();
+  CookedBlock writeBlock(const void* data, size_t size);
+
+  // ヘッダを書き込んで閉じ, 本来のファイル名に置き換える.
+  bool finish(CookedModelHeader header);
+  // 書き込みを中止して一時ファイルを削除する.
+  void cancel();
+
+  // 書き込んだバイト数 (ヘッダを含む)
+  uint64_t size() const { return m_position; }
+  // メモリへ書き出した内容
+  const uint8_t* data() const { return m_memory.data(); }
+private:
+  void pad(uint64_t alignment);
+
+  void* m_file;   // HANDLE
+  bool m_inMemory;
+  std::vector<uint8_t> m_memory;
+  std::wstring m_fileName;
+  std::wstring m_tempName;
+  uint64_t m_position;
+  uint64_t m_blockStart;
+  bool m_failed;
+};
@@ -0,0 +1,623 @@
+﻿#include "modelcooker.h"
+
+#include <chrono>
+#include <sstream>
+#include <cfloat>
+#include <cstring>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <iomanip>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../common/stb_image.h"
+
+#include "streamreader.h"
+#include "mappedfile.h"
+#include "meshoptimize.h"
+#include "vertexassembly.h"
+
+using namespace glm;
+using namespace std;
+
+static_assert(sizeof(CookedVertex) == sizeof(float) * InterleavedVertexFloats, "Vertex layout must match the assembly kernel");
+
+// 読み込み途中のプリミティブ. プールへ追加する前に最適化を行う.
+struct PrimitiveSource
+{
+  // 頂点属性. マップしたファイル内のアクセッサを直接指し, 指せない場合のみ下の配列に読み込む.
+  VertexStreams streams;
+  vector<float> positions;
+  vector<float> normals;
+  vector<float> uvs;
+  // 頂点フェッチ最適化による並べ替え (remap[元の番号] = 新しい番号). 空なら並べ替えない.
+  vector<uint32_t> vertexRemap;
+  vector<uint32_t> indices;
+  vector<Meshlet> meshlets;
+  vector<vector<uint32_t>> lodIndices;
+  vector<float> lodErrors;
+  // アクセッサの min/max (無ければ空)
+  vector<float> boundsMin;
+  vector<float> boundsMax;
+  bool doubleSided;
+  uint32_t vertexCount;
+  uint32_t indexType;     // 0: 16bit, 1: 32bit
+  int materialIndex;
+};
+
+// 全プリミティブ分をまとめたジオメトリ. 浮動小数点の頂点は書き出し時に組み立てる.
+struct CookedGeometry
+{
+  uint32_t vertexCount;
+  vector<CookedCompactVertex> compactVertices;
+  vector<uint16_t> indices16;
+  vector<uint32_t> indices32;
+  vector<CookedMeshlet> meshlets;
+  vector<CookedMesh> meshes;
+  vector<CookedLod> lods;
+};
+
+// 法線を八面体エンコードして 2x16bit SNORM にする.
+static void EncodeOctahedron(vec3 n, int16_t out[2])
+{
+  auto l1 = abs(n.x) + abs(n.y) + abs(n.z);
+  vec2 e(0.0f);
+  if (l1 > 0.0f)
+  {
+    n /= l1;
+    e = vec2(n.x, n.y);
+    if (n.z < 0.0f)
+    {
+      // 下半球は外側へ折り返す.
+      e = (1.0f - glm::abs(vec2(n.y, n.x))) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+  }
+  out[0] = int16_t(round(glm::clamp(e.x, -1.0f, 1.0f) * 32767.0f));
+  out[1] = int16_t(round(glm::clamp(e.y, -1.0f, 1.0f) * 32767.0f));
+}
+
+// 任意の型で格納されたインデックスを 32bit に拡張して読み込む.
+static vector<uint32_t> ReadIndices(const Microsoft::glTF::Document& doc, Microsoft::glTF::GLTFResourceReader& reader, const Microsoft::glTF::Accessor& accessor)
+{
+  using namespace Microsoft::glTF;
+  vector<uint32_t> indices;
+  switch (accessor.componentType)
+  {
+  case COMPONENT_UNSIGNED_BYTE:
+    {
+      auto data = reader.ReadBinaryData<uint8_t>(doc, accessor);
+      indices.assign(data.begin(), data.end());
+    }
+    break;
+  case COMPONENT_UNSIGNED_SHORT:
+    {
+      auto data = reader.ReadBinaryData<uint16_t>(doc, accessor);
+      indices.assign(data.begin(), data.end());
+    }
+    break;
+  case COMPONENT_UNSIGNED_INT:
+    indices = reader.ReadBinaryData<uint32_t>(doc, accessor);
+    break;
+  default:
+    throw runtime_error("Unsupported index component type.");
+  }
+  return indices;
+}
+
+static uint16_t QuantizeUnorm16(float v)
+{
+  return uint16_t(round(glm::clamp(v, 0.0f, 1.0f) * 65535.0f));
+}
+
+// GLB の BIN チャンク内で詰めて格納されたアクセッサのデータを, マップ領域のまま参照する.
+// 参照できない場合は nullptr.
+static const void* GetMappedAccessorData(const MappedFile& file, const Microsoft::glTF::Document& doc, const Microsoft::glTF::Accessor& accessor)
+{
+  using namespace Microsoft::glTF;
+  if (!file.isOpen() || accessor.bufferViewId.empty() || accessor.sparse.count > 0)
+  {
+    return nullptr;
+  }
+  // GLB はヘッダ (12バイト) の後に JSON チャンク, BIN チャンクの順に並ぶ.
+  const auto* data = file.data();
+  const auto fileSize = file.size();
+  uint32_t magic = 0, jsonLength = 0, binLength = 0, binType = 0;
+  if (fileSize < 20)
+  {
+    return nullptr;
+  }
+  memcpy(&magic, data, 4);
+  memcpy(&jsonLength, data + 12, 4);
+  const size_t binChunk = 20 + size_t(jsonLength);
+  if (magic != 0x46546C67 /* glTF */ || binChunk + 8 > fileSize)
+  {
+    return nullptr;
+  }
+  memcpy(&binLength, data + binChunk, 4);
+  memcpy(&binType, data + binChunk + 4, 4);
+  if (binType != 0x004E4942 /* BIN */ || binChunk + 8 + binLength > fileSize)
+  {
+    return nullptr;
+  }
+
+  auto& view = doc.bufferViews.Get(accessor.bufferViewId);
+  if (!doc.buffers.Get(view.bufferId).uri.empty())
+  {
+    return nullptr;
+  }
+  const size_t elementSize = Accessor::GetComponentTypeSize(accessor.componentType) * Accessor::GetTypeCount(accessor.type);
+  if (view.byteStride.HasValue() && view.byteStride.Get() != elementSize)
+  {
+    return nullptr;
+  }
+  const size_t offset = view.byteOffset + accessor.byteOffset;
+  if (offset + elementSize * accessor.count > binLength)
+  {
+    return nullptr;
+  }
+  return data + binChunk + 8 + offset;
+}
+
+static string OptimizePrimitive(PrimitiveSource& src)
+{
+  auto* indices = src.indices.data();
+  const auto indexCount = src.indices.size();
+  const auto vertexCount = src.vertexCount;
+  auto before = AnalyzeVertexCache(indices, indexCount, vertexCount);
+
+  OptimizeVertexCache(indices, indices, indexCount, vertexCount);
+  OptimizeOverdraw(indices, indices, indexCount, src.streams.positions, src.streams.positionStride, vertexCount);
+
+  // 頂点の番号を付け替えてもキャッシュ効率は変わらない (並べ替えは RemapVertexFetch で行う).
+  auto after = AnalyzeVertexCache(indices, indexCount, vertexCount);
+  stringstream ss;
+  ss << fixed << setprecision(3)
+    << "ACMR " << before.acmr << " -> " << after.acmr
+    << ", ATVR " << before.atvr << " -> " << after.atvr;
+  return ss.str();
+}
+
+static string GenerateLods(PrimitiveSource& src)
+{
+  // 元のメッシュに対する三角形数の割合. 1 つ前のレベルから順に簡略化する.
+  const float ratios[] = { 0.5f, 0.25f, 0.125f };
+  const size_t MinTriangles = 64;
+  const auto* source = &src.indices;
+  float error = 0.0f;
+  stringstream ss;
+  ss << "LOD triangles " << src.indices.size() / 3;
+  src.lodIndices.reserve(sizeof(ratios) / sizeof(ratios[0]));
+  for (auto ratio : ratios)
+  {
+    auto target = size_t(src.indices.size() * ratio) / 3 * 3;
+    if (target < MinTriangles * 3)
+    {
+      break;
+    }
+    vector<uint32_t> lod(source->size());
+    float stepError = 0.0f;
+    auto count = SimplifyMesh(lod.data(), source->data(), source->size(),
+      src.streams.positions, src.streams.positionStride, src.vertexCount, target, &stepError);
+    // 固定した継ぎ目や境界が多く, 十分に減らせない場合は打ち切る.
+    if (count > source->size() * 85 / 100)
+    {
+      break;
+    }
+    lod.resize(count);
+    OptimizeVertexCache(lod.data(), lod.data(), count, src.vertexCount);
+    error += stepError;
+    src.lodIndices.push_back(std::move(lod));
+    src.lodErrors.push_back(error);
+    source = &src.lodIndices.back();
+    ss << " / " << count / 3;
+  }
+  return ss.str();
+}
+
+static void RemapVertexFetch(PrimitiveSource& src)
+{
+  // 頂点を参照順に並べ替える. 頂点データ自体は組み立て時に remap の位置へ書き込む.
+  src.vertexRemap.resize(src.vertexCount);
+  auto* remap = src.vertexRemap.data();
+  OptimizeVertexFetchRemap(remap, src.indices.data(), src.indices.size(), src.vertexCount);
+  for (auto& index : src.indices)
+  {
+    index = remap[index];
+  }
+  for (auto& lod : src.lodIndices)
+  {
+    for (auto& index : lod)
+    {
+      index = remap[index];
+    }
+  }
+}
+
+// インデックスをプールの型に変換して末尾に追加し, 先頭位置を返す.
+template<class T>
+static uint32_t AppendIndices(vector<T>& pool, const vector<uint32_t>& indices)
+{
+  auto first = uint32_t(pool.size());
+  pool.reserve(pool.size() + indices.size());
+  for (auto index : indices)
+  {
+    pool.push_back(T(index));
+  }
+  return first;
+}
+
+static void AppendPrimitive(CookedGeometry& geometry, const PrimitiveSource& src, bool compactVertices)
+{
+  const auto& streams = src.streams;
+  CookedMesh mesh{};
+  mesh.vertexOffset = int32_t(geometry.vertexCount);
+
+  auto vertexCount = src.vertexCount;
+  geometry.vertexCount += vertexCount;
+  auto position = [&](uint32_t i) {
+    const auto* p = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(streams.positions) + streams.positionStride * i);
+    return vec3(p[0], p[1], p[2]);
+  };
+  // バウンディングボックス. アクセッサの min/max があればそれを使う.
+  vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+  if (src.boundsMin.size() == 3 && src.boundsMax.size() == 3)
+  {
+    boundsMin = vec3(src.boundsMin[0], src.boundsMin[1], src.boundsMin[2]);
+    boundsMax = vec3(src.boundsMax[0], src.boundsMax[1], src.boundsMax[2]);
+  }
+  else
+  {
+    for (uint32_t i = 0; i < vertexCount; ++i)
+    {
+      auto pos = position(i);
+      boundsMin = (glm::min)(boundsMin, pos);
+      boundsMax = (glm::max)(boundsMax, pos);
+    }
+  }
+  for (int c = 0; c < 3; ++c)
+  {
+    mesh.boundsMin[c] = boundsMin[c];
+    mesh.boundsMax[c] = boundsMax[c];
+  }
+
+  if (compactVertices)
+  {
+    // 頂点データを量子化して構築
+    auto extent = boundsMax - boundsMin;
+    auto invExtent = vec3(
+      extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+      extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+      extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+    auto& vertices = geometry.compactVertices;
+    vertices.resize(vertices.size() + vertexCount);
+    auto* dst = vertices.data() + mesh.vertexOffset;
+    for (uint32_t i = 0; i < vertexCount; ++i)
+    {
+      const auto* nrm = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(streams.normals) + streams.normalStride * i);
+      const auto* uv = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(streams.uvs) + streams.uvStride * i);
+      auto pos = (position(i) - boundsMin) * invExtent;
+      auto& v = dst[src.vertexRemap.empty() ? i : src.vertexRemap[i]];
+      v = CookedCompactVertex{};
+      v.pos[0] = QuantizeUnorm16(pos.x);
+      v.pos[1] = QuantizeUnorm16(pos.y);
+      v.pos[2] = QuantizeUnorm16(pos.z);
+      EncodeOctahedron(vec3(nrm[0], nrm[1], nrm[2]), v.normal);
+      v.uv[0] = packHalf1x16(uv[0]);
+      v.uv[1] = packHalf1x16(uv[1]);
+    }
+  }
+
+  // LOD のインデックスは元のメッシュと同じプールの後ろに追加する.
+  auto appendIndices = [&](const vector<uint32_t>& indices) {
+    return src.indexType == 0 ? AppendIndices(geometry.indices16, indices) : AppendIndices(geometry.indices32, indices);
+  };
+  mesh.indexType = src.indexType;
+  mesh.firstIndex = appendIndices(src.indices);
+  mesh.firstLod = uint32_t(geometry.lods.size());
+  mesh.lodCount = uint32_t(src.lodIndices.size());
+  for (size_t i = 0; i < src.lodIndices.size(); ++i)
+  {
+    CookedLod lod{};
+    lod.indexCount = uint32_t(src.lodIndices[i].size());
+    lod.error = src.lodErrors[i];
+    lod.firstIndex = appendIndices(src.lodIndices[i]);
+    geometry.lods.push_back(lod);
+  }
+
+  // メッシュレットはプール内の位置に変換して格納する.
+  mesh.firstMeshlet = uint32_t(geometry.meshlets.size());
+  mesh.meshletCount = uint32_t(src.meshlets.size());
+  for (const auto& meshlet : src.meshlets)
+  {
+    CookedMeshlet info{};
+    info.sphere[0] = meshlet.center[0];
+    info.sphere[1] = meshlet.center[1];
+    info.sphere[2] = meshlet.center[2];
+    info.sphere[3] = meshlet.radius;
+    info.cone[0] = meshlet.coneAxis[0];
+    info.cone[1] = meshlet.coneAxis[1];
+    info.cone[2] = meshlet.coneAxis[2];
+    // 両面描画のマテリアルは裏面でも見えるため, 裏面カリングを無効にする.
+    info.cone[3] = src.doubleSided ? 1.0f : meshlet.coneCutoff;
+    info.firstIndex = mesh.firstIndex + meshlet.firstIndex;
+    info.indexCount = meshlet.indexCount;
+    info.vertexOffset = mesh.vertexOffset;
+    geometry.meshlets.push_back(info);
+  }
+
+  mesh.vertexCount = vertexCount;
+  mesh.indexCount = uint32_t(src.indices.size());
+  mesh.materialIndex = src.materialIndex;
+  geometry.meshes.push_back(mesh);
+}
+
+// プリミティブ 1 つ分の最適化, LOD とメッシュレットの生成. 結果の概要を返す.
+static string ProcessPrimitive(PrimitiveSource& src, const CookSettings& settings)
+{
+  string primitiveReport;
+  if (settings.optimizeMeshes)
+  {
+    primitiveReport = OptimizePrimitive(src);
+  }
+  if (settings.lods)
+  {
+    primitiveReport += (primitiveReport.empty() ? "" : ", ") + GenerateLods(src);
+  }
+  if (settings.meshlets)
+  {
+    BuildMeshlets(src.meshlets, src.indices.data(), src.indices.size(), src.streams.positions, src.streams.positionStride, src.vertexCount);
+    primitiveReport += (primitiveReport.empty() ? "" : ", ") + to_string(src.meshlets.size()) + " meshlets";
+  }
+  // 頂点の並べ替えは最後にインデックスにのみ適用し, 頂点は組み立て時に並べ替える.
+  if (settings.optimizeMeshes)
+  {
+    RemapVertexFetch(src);
+  }
+  return primitiveReport;
+}
+
+bool CookModel(const wchar_t* sourceFile, CookedModelWriter& writer, const CookSettings& settings, CookStats* stats, std::string* error)
+{
+  using namespace Microsoft::glTF;
+  CookStats localStats;
+  auto& result = stats ? *stats : localStats;
+  result = CookStats{};
+  auto fail = [&](const string& message) {
+    writer.cancel();
+    if (error)
+    {
+      *error = message;
+    }
+    return false;
+  };
+  auto lapStart = chrono::steady_clock::now();
+  auto lap = [&]() {
+    auto now = chrono::steady_clock::now();
+    auto elapsed = chrono::duration<double, milli>(now - lapStart).count();
+    lapStart = now;
+    return elapsed;
+  };
+
+  // 頂点属性はマップ領域から直接読む.
+  MappedFile file;
+  if (!file.open(sourceFile))
+  {
+    return fail("Unable to open the model file.");
+  }
+  result.sourceSize = file.size();
+
+  CookedModelHeader header{};
+  header.sourceHash = HashFileContents(file.data(), file.size());
+  header.options = settings.options();
+  header.vertexStride = uint32_t(settings.compactVertices ? sizeof(CookedCompactVertex) : sizeof(CookedVertex));
+  header.meshletStride = uint32_t(sizeof(CookedMeshlet));
+
+  stringstream report;
+  try
+  {
+    auto modelFilePath = experimental::filesystem::path(sourceFile);
+    auto reader = make_unique<StreamReader>(modelFilePath.parent_path());
+    auto glbStream = reader->GetInputStream(modelFilePath.filename().u8string());
+    auto glbResourceReader = make_shared<GLBResourceReader>(std::move(reader), std::move(glbStream));
+    auto doc = Deserialize(glbResourceReader->GetJson());
+
+    // アクセッサからデータ列を取得 (リーダーは共有できないため順に読む)
+    vector<PrimitiveSource> primitives;
+    for (const auto& mesh : doc.meshes.Elements())
+    {
+      for (const auto& meshPrimitive : mesh.primitives)
+      {
+        // 頂点位置/法線/テクスチャ座標/インデックスのアクセッサの取得
+        auto& accPos = doc.accessors.Get(meshPrimitive.GetAttributeAccessorId(ACCESSOR_POSITION));
+        auto& accNrm = doc.accessors.Get(meshPrimitive.GetAttributeAccessorId(ACCESSOR_NORMAL));
+        auto& accUV = doc.accessors.Get(meshPrimitive.GetAttributeAccessorId(ACCESSOR_TEXCOORD_0));
+        auto& accIndex = doc.accessors.Get(meshPrimitive.indicesAccessorId);
+
+        // 頂点属性はマップ領域のアクセッサをそのまま参照する.
+        // 参照できない (float で詰めて格納されていない等) 場合のみ読み込んで配列に持つ.
+        // 配列はムーブしても領域が変わらないため, ポインタは primitives へ移した後も有効.
+        auto mapStream = [&](const Accessor& accessor, size_t components, vector<float>& storage, const float*& data, size_t& stride) {
+          data = nullptr;
+          if (accessor.componentType == COMPONENT_FLOAT && Accessor::GetTypeCount(accessor.type) == components)
+          {
+            data = static_cast<const float*>(GetMappedAccessorData(file, doc, accessor));
+          }
+          if (data == nullptr)
+          {
+            storage = glbResourceReader->ReadBinaryData<float>(doc, accessor);
+            data = storage.data();
+          }
+          stride = sizeof(float) * components;
+        };
+        PrimitiveSource src{};
+        mapStream(accPos, 3, src.positions, src.streams.positions, src.streams.positionStride);
+        mapStream(accNrm, 3, src.normals, src.streams.normals, src.streams.normalStride);
+        mapStream(accUV, 2, src.uvs, src.streams.uvs, src.streams.uvStride);
+        src.boundsMin = accPos.min;
+        src.boundsMax = accPos.max;
+        src.vertexCount = uint32_t(accPos.count);
+        src.materialIndex = int(doc.materials.GetIndex(meshPrimitive.materialId));
+        src.doubleSided = doc.materials.Get(meshPrimitive.materialId).doubleSided;
+
+        // インデックスデータ (頂点はメッシュ先頭からの番号のまま格納する)
+        // 頂点数が 16bit で表せるなら 16bit インデックスにする. ファイル上の型とは独立に決める.
+        src.indexType = src.vertexCount <= 0x10000 ? 0 : 1;
+        src.indices = ReadIndices(doc, *glbResourceReader, accIndex);
+        primitives.push_back(std::move(src));
+      }
+    }
+    result.parseTime = lap();
+
+    // 頂点キャッシュ/オーバードロー/頂点フェッチの最適化, LOD とメッシュレットの生成.
+    // プリミティブごとに独立なので, 複数のスレッドで空いたものから次を取って処理する.
+    if (settings.optimizeMeshes || settings.meshlets || settings.lods)
+    {
+      vector<string> primitiveReports(primitives.size());
+      atomic<size_t> nextPrimitive(0);
+      mutex errorMutex;
+      exception_ptr firstError;
+      auto worker = [&]() {
+        for (size_t index = nextPrimitive++; index < primitives.size(); index = nextPrimitive++)
+        {
+          try
+          {
+            primitiveReports[index] = ProcessPrimitive(primitives[index], settings);
+          }
+          catch (...)
+          {
+            lock_guard<mutex> lock(errorMutex);
+            if (!firstError)
+            {
+              firstError = current_exception();
+            }
+          }
+        }
+      };
+      // 呼び出したスレッドも処理に加わる. threadCount が 1 なら追加のスレッドは作らない.
+      auto threadCount = settings.threadCount != 0 ? settings.threadCount : (std::max)(thread::hardware_concurrency(), 1u);
+      threadCount = uint32_t((std::min)(size_t(threadCount), (std::max)(primitives.size(), size_t(1))));
+      vector<thread> threads;
+      for (uint32_t i = 1; i < threadCount; ++i)
+      {
+        threads.emplace_back(worker);
+      }
+      worker();
+      for (auto& t : threads)
+      {
+        t.join();
+      }
+      if (firstError)
+      {
+        rethrow_exception(firstError);
+      }
+      report << "Mesh optimization:" << endl;
+      for (size_t i = 0; i < primitiveReports.size(); ++i)
+      {
+        report << "  primitive " << i << ": " << primitiveReports[i] << endl;
+      }
+    }
+
+    CookedGeometry geometry{};
+    for (const auto& src : primitives)
+    {
+      AppendPrimitive(geometry, src, settings.compactVertices);
+    }
+
+    // 全メッシュ分の頂点を 1 つのブロックにする.
+    // 浮動小数点の頂点はプリミティブごとに一時領域へ組み立てて書き出す.
+    if (settings.compactVertices)
+    {
+      header.vertices = writer.writeBlock(geometry.compactVertices.data(), sizeof(CookedCompactVertex) * geometry.compactVertices.size());
+    }
+    else
+    {
+      vector<CookedVertex> assembled;
+      writer.beginBlock();
+      for (const auto& src : primitives)
+      {
+        if (src.vertexCount == 0)
+        {
+          continue;
+        }
+        const auto* remap = src.vertexRemap.empty() ? nullptr : src.vertexRemap.data();
+        assembled.resize(src.vertexCount);
+        InterleaveVertices(assembled[0].pos, src.streams, remap, src.vertexCount);
+        writer.append(assembled.data(), sizeof(CookedVertex) * src.vertexCount);
+      }
+      header.vertices = writer.endBlock();
+    }
+    header.indices16 = writer.writeBlock(geometry.indices16.data(), sizeof(uint16_t) * geometry.indices16.size());
+    header.indices32 = writer.writeBlock(geometry.indices32.data(), sizeof(uint32_t) * geometry.indices32.size());
+    header.meshlets = writer.writeBlock(geometry.meshlets.data(), sizeof(CookedMeshlet) * geometry.meshlets.size());
+    header.meshes = writer.writeBlock(geometry.meshes.data(), sizeof(CookedMesh) * geometry.meshes.size());
+    header.lods = writer.writeBlock(geometry.lods.data(), sizeof(CookedLod) * geometry.lods.size());
+    report << "Vertex data: " << header.vertices.size << " bytes (" << (settings.compactVertices ? "compact" : "float") << ")" << endl;
+    report << "Index data: " << header.indices16.size << " bytes (16bit), " << header.indices32.size << " bytes (32bit)" << endl;
+
+    result.meshCount = uint32_t(geometry.meshes.size());
+    result.vertexCount = geometry.vertexCount;
+    for (const auto& mesh : geometry.meshes)
+    {
+      result.triangleCount += mesh.indexCount / 3;
+    }
+    result.geometryTime = lap();
+
+    // テクスチャはデコードした画素をそのまま格納する.
+    vector<CookedMaterial> materials;
+    writer.beginBlock();
+    for (auto& m : doc.materials.Elements())
+    {
+      auto textureId = m.metallicRoughness.baseColorTexture.textureId;
+      if (textureId.empty())
+      {
+        textureId = m.normalTexture.textureId;
+      }
+      auto& texture = doc.textures.Get(textureId);
+      auto& image = doc.images.Get(texture.imageId);
+      auto imageBufferView = doc.bufferViews.Get(image.bufferViewId);
+      auto imageData = glbResourceReader->ReadBinaryData<char>(doc, imageBufferView);
+
+      // imageData が画像データ. 転送は RGBA8 で行うため 4 チャンネルに揃えて読み込む.
+      int width, height, channels;
+      auto* pImage = stbi_load_from_memory(
+        reinterpret_cast<const uint8_t*>(imageData.data()),
+        int(imageData.size()),
+        &width, &height, &channels, STBI_rgb_alpha);
+      if (pImage == nullptr)
+      {
+        throw runtime_error("Unable to decode the texture of material '" + m.name + "'.");
+      }
+
+      CookedMaterial cooked{};
+      cooked.alphaMode = uint32_t(m.alphaMode);
+      cooked.width = uint32_t(width);
+      cooked.height = uint32_t(height);
+      cooked.textureSize = uint64_t(width) * uint64_t(height) * sizeof(uint32_t);
+      cooked.textureOffset = writer.append(pImage, size_t(cooked.textureSize));
+      materials.push_back(cooked);
+      stbi_image_free(pImage);
+    }
+    header.textures = writer.endBlock();
+    header.materials = writer.writeBlock(materials.data(), sizeof(CookedMaterial) * materials.size());
+    report << "Texture data: " << header.textures.size << " bytes (" << materials.size() << " materials)" << endl;
+    result.materialCount = uint32_t(materials.size());
+    result.textureTime = lap();
+  }
+  catch (const exception& e)
+  {
+    return fail(e.what());
+  }
+
+  result.cookedSize = writer.size();
+  result.report = report.str();
+  if (!writer.finish(header))
+  {
+    return fail("Unable to write the cooked model.");
+  }
+  result.writeTime = lap();
+  return true;
+}
@@ -0,0 +1,51 @@
+﻿#pragma once
+#include <cstdint>
+#include <string>
+#include "modelcache.h"
+
+// モデルの調理. glTF/VRM (GLB) を読み込み, GPU へそのまま転送できる形 (modelcache.h) に加工する.
+//  - 頂点の組み立て (浮動小数点, または量子化した形式)
+//  - 頂点キャッシュ/オーバードロー/頂点フェッチの最適化
+//  - LOD とメッシュレットの生成
+//  - テクスチャのデコード (RGBA8)
+// Vulkan を使わないため, 描画サンプルとオフラインの変換ツール (asset_cooker) で共有する.
+
+// 調理の設定. 値が変わるとキャッシュは作り直しになる.
+struct CookSettings
+{
+  bool compactVertices;
+  bool optimizeMeshes;
+  bool meshlets;
+  bool lods;
+  // プリミティブの最適化に使うスレッド数 (呼び出したスレッドを含む). 結果には影響しない.
+  // 0 ならハードウェアのスレッド数. 呼び出し側がファイル単位で並列化している場合は 1 にする.
+  uint32_t threadCount;
+
+  // CookedModelHeader::options に格納する値
+  uint32_t options() const
+  {
+    return (compactVertices ? 1u : 0u) | (optimizeMeshes ? 2u : 0u) | (meshlets ? 4u : 0u) | (lods ? 8u : 0u);
+  }
+};
+
+struct CookStats
+{
+  uint64_t sourceSize;
+  uint64_t cookedSize;
+  uint32_t meshCount;
+  uint32_t materialCount;
+  uint32_t vertexCount;
+  uint32_t triangleCount;
+  // 各段階の処理時間 (ミリ秒)
+  double parseTime;
+  double geometryTime;
+  double textureTime;
+  double writeTime;
+  // プリミティブごとの最適化結果などの詳細 (複数行)
+  std::string report;
+};
+
+// sourceFile を調理して writer へ書き出す. writer は開いた状態で渡し, 成功時は finish() まで行う.
+// 失敗した場合は writer を中止して false を返し, error に理由を返す.
+// 複数のファイルを別々のスレッドで同時に調理してよい (その場合は settings.threadCount を 1 にする).
+bool CookModel(const wchar_t* sourceFile, CookedModelWriter& writer, const CookSettings& settings, CookStats* stats, std::string* error);
@@ -0,0 +1,81 @@
+﻿#include "renderqueue.h"
+
+#include <cstring>
+
+using namespace std;
+
+static uint32_t DepthToBits(float depth)
+{
+  // 非負の浮動小数点数はビット列を整数とみなしても大小関係が保たれる.
+  if (!(depth > 0.0f))
+  {
+    return 0;
+  }
+  uint32_t bits;
+  memcpy(&bits, &depth, sizeof(bits));
+  return bits;
+}
+
+uint64_t MakeSortKey(uint32_t pass, uint32_t pipeline, uint32_t material, float depth, bool backToFront)
+{
+  const uint64_t MaterialMask = (1u << 22) - 1;
+  uint64_t key = (uint64_t(pass & 0x3) << 62) | (uint64_t(pipeline & 0xFF) << 54);
+  uint64_t depthBits = DepthToBits(depth);
+  if (backToFront)
+  {
+    key |= (uint64_t(~uint32_t(depthBits)) << 22) | (material & MaterialMask);
+  }
+  else
+  {
+    key |= ((material & MaterialMask) << 32) | depthBits;
+  }
+  return key;
+}
+
+void RenderQueue::sort()
+{
+  const size_t count = m_packets.size();
+  if (count < 2)
+  {
+    return;
+  }
+  // 全桁のヒストグラムを 1 回の走査で作る.
+  const int DigitCount = sizeof(uint64_t);
+  size_t histogram[DigitCount][256] = {};
+  for (const auto& packet : m_packets)
+  {
+    for (int d = 0; d < DigitCount; ++d)
+    {
+      ++histogram[d][(packet.key >> (d * 8)) & 0xFF];
+    }
+  }
+
+  m_scratch.resize(count);
+  auto* src = m_packets.data();
+  auto* dst = m_scratch.data();
+  for (int d = 0; d < DigitCount; ++d)
+  {
+    auto& counts = histogram[d];
+    // 全パケットで同じ値の桁は順序が変わらない.
+    if (counts[(src[0].key >> (d * 8)) & 0xFF] == count)
+    {
+      continue;
+    }
+    size_t offset = 0;
+    for (auto& c : counts)
+    {
+      auto n = c;
+      c = offset;
+      offset += n;
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+      dst[counts[(src[i].key >> (d * 8)) & 0xFF]++] = src[i];
+    }
+    swap(src, dst);
+  }
+  if (src != m_packets.data())
+  {
+    m_packets.swap(m_scratch);
+  }
+}
@@ -0,0 +1,39 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// 描画パケットをソートキー順に並べる描画キュー.
+// キーの上位から パス, パイプライン, マテリアル, 深度 の順に比較されるため,
+// 同じ状態の描画が連続し, 記録時に重複したバインドを省ける.
+
+// ソートキーの構成 (64bit)
+//  63-62: パス (描画順)
+//  61-54: パイプライン
+//  通常        53-32: マテリアル, 31-0: 深度 (手前から奥へ)
+//  backToFront 53-22: 深度 (奥から手前へ), 21-0: マテリアル
+// 半透明は描画順が結果に影響するため, マテリアルより深度を優先する.
+uint64_t MakeSortKey(uint32_t pass, uint32_t pipeline, uint32_t material, float depth, bool backToFront);
+
+struct DrawPacket
+{
+  uint64_t key;
+  uint32_t index;   // 描画対象の番号 (キューの利用側で解釈する)
+};
+
+class RenderQueue
+{
+public:
+  void clear() { m_packets.clear(); }
+  void push(uint64_t key, uint32_t index) { m_packets.push_back({ key, index }); }
+
+  // キーの昇順に並べ替える (8bit ずつの LSD 基数ソート. 同じキーの順序は保たれる).
+  // 全パケットで値が同じ桁は並べ替えを省く.
+  void sort();
+
+  const std::vector<DrawPacket>& packets() const { return m_packets; }
+  size_t size() const { return m_packets.size(); }
+private:
+  std::vector<DrawPacket> m_packets;
+  std::vector<DrawPacket> m_scratch;  // ソート用の作業領域 (フレーム間で使い回す)
+};
@@ -0,0 +1,44 @@
+#version 450
+
+// 量子化した頂点入力 (ModelApp::CompactVertex)
+layout(location=0) in vec4 inPos;    // バウンディングボックス内で正規化した位置
+layout(location=1) in vec2 inNormal; // 八面体エンコードした法線
+layout(location=2) in vec2 inUV;
+layout(location=0) out vec2 outUV;
+layout(location=1) out vec3 outNormal;
+
+layout(binding=0) uniform Matrices
+{
+  mat4 world;
+  mat4 view;
+  mat4 proj;
+};
+
+layout(push_constant) uniform MeshBounds
+{
+  vec4 boundsMin;
+  vec4 boundsScale;
+};
+
+out gl_PerVertex
+{
+  vec4 gl_Position;
+};
+
+vec3 decodeOctahedron(vec2 e)
+{
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  float t = max(-n.z, 0.0);
+  n.x += n.x >= 0.0 ? -t : t;
+  n.y += n.y >= 0.0 ? -t : t;
+  return normalize(n);
+}
+
+void main()
+{
+  vec3 pos = boundsMin.xyz + inPos.xyz * boundsScale.xyz;
+  mat4 pvw = proj * view * world;
+  gl_Position = pvw * vec4(pos, 1.0);
+  outUV = inUV;
+  outNormal = mat3(world) * decodeOctahedron(inNormal);
+}
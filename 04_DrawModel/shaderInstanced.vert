@@ -0,0 +1,30 @@
+#version 450
+
+layout(location=0) in vec3 inPos;
+layout(location=1) in vec3 inNormal;
+layout(location=2) in vec2 inUV;
+// インスタンスごとのデータ (InstanceData)
+layout(location=3) in mat4 inInstanceWorld;
+layout(location=7) in vec4 inInstanceTint;
+layout(location=0) out vec2 outUV;
+layout(location=1) out vec4 outTint;
+
+layout(binding=0) uniform Matrices
+{
+  mat4 world;
+  mat4 view;
+  mat4 proj;
+};
+
+out gl_PerVertex
+{
+  vec4 gl_Position;
+};
+
+void main()
+{
+  mat4 pvw = proj * view * inInstanceWorld * world;
+  gl_Position = pvw * vec4(inPos, 1.0);
+  outUV = inUV;
+  outTint = inInstanceTint;
+}
@@ -0,0 +1,38 @@
+#version 450
+
+// 遮蔽クエリ用にバウンディングボックスを描く. 頂点は番号から生成する.
+layout(binding=0) uniform Matrices
+{
+  mat4 world;
+  mat4 view;
+  mat4 proj;
+};
+
+layout(push_constant) uniform ProxyBounds
+{
+  vec4 boundsMin;
+  vec4 boundsMax;
+};
+
+out gl_PerVertex
+{
+  vec4 gl_Position;
+};
+
+// 箱の 12 三角形. 角の番号は bit0: x, bit1: y, bit2: z が最大側.
+const int cubeIndices[36] = int[36](
+  0, 2, 1,  1, 2, 3,  // -Z
+  4, 5, 6,  5, 7, 6,  // +Z
+  0, 1, 4,  1, 5, 4,  // -Y
+  2, 6, 3,  3, 6, 7,  // +Y
+  0, 4, 2,  2, 4, 6,  // -X
+  1, 3, 5,  3, 7, 5   // +X
+);
+
+void main()
+{
+  int corner = cubeIndices[gl_VertexIndex];
+  vec3 t = vec3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1);
+  vec3 pos = mix(boundsMin.xyz, boundsMax.xyz, t);
+  gl_Position = proj * view * world * vec4(pos, 1.0);
+}
@@ -0,0 +1,92 @@
+﻿#include "vertexassembly.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define VERTEXASSEMBLY_USE_SSE
+#endif
+
+using namespace std;
+
+namespace
+{
+  template<class T>
+  const T* Advance(const T* p, size_t bytes)
+  {
+    return reinterpret_cast<const T*>(reinterpret_cast<const uint8_t*>(p) + bytes);
+  }
+
+  void InterleaveRange(float* destination, const VertexStreams& streams, const uint32_t* remap, size_t first, size_t last)
+  {
+    auto* pos = Advance(streams.positions, streams.positionStride * first);
+    auto* nrm = Advance(streams.normals, streams.normalStride * first);
+    auto* uv = Advance(streams.uvs, streams.uvStride * first);
+    for (size_t i = first; i < last; ++i)
+    {
+      auto* dst = destination + (remap ? remap[i] : i) * InterleavedVertexFloats;
+      dst[0] = pos[0]; dst[1] = pos[1]; dst[2] = pos[2];
+      dst[3] = nrm[0]; dst[4] = nrm[1]; dst[5] = nrm[2];
+      dst[6] = uv[0];  dst[7] = uv[1];
+      pos = Advance(pos, streams.positionStride);
+      nrm = Advance(nrm, streams.normalStride);
+      uv = Advance(uv, streams.uvStride);
+    }
+  }
+}
+
+void InterleaveVerticesScalar(float* destination, const VertexStreams& streams, const uint32_t* remap, size_t vertexCount)
+{
+  InterleaveRange(destination, streams, remap, 0, vertexCount);
+}
+
+void InterleaveVerticesSimd(float* destination, const VertexStreams& streams, const uint32_t* remap, size_t vertexCount)
+{
+#ifdef VERTEXASSEMBLY_USE_SSE
+  if (streams.positionStride != sizeof(float) * 3 || streams.normalStride != sizeof(float) * 3 || streams.uvStride != sizeof(float) * 2)
+  {
+    InterleaveVerticesScalar(destination, streams, remap, vertexCount);
+    return;
+  }
+  // _MM_SHUFFLE は引数が上位の要素からの順なので, 下位からの順で書けるようにする.
+#define SHUF(i0, i1, i2, i3) _MM_SHUFFLE(i3, i2, i1, i0)
+  const size_t blockCount = vertexCount / 4;
+  for (size_t b = 0; b < blockCount; ++b)
+  {
+    // 4 頂点分: 位置と法線は 12 float, UV は 8 float.
+    const float* pos = streams.positions + b * 12;
+    const float* nrm = streams.normals + b * 12;
+    const float* uv = streams.uvs + b * 8;
+    auto p0 = _mm_loadu_ps(pos), p1 = _mm_loadu_ps(pos + 4), p2 = _mm_loadu_ps(pos + 8);
+    auto n0 = _mm_loadu_ps(nrm), n1 = _mm_loadu_ps(nrm + 4), n2 = _mm_loadu_ps(nrm + 8);
+    auto t0 = _mm_loadu_ps(uv), t1 = _mm_loadu_ps(uv + 4);
+
+    // 頂点ごとに [px py pz nx] [ny nz u v] の 2 つを作る.
+    __m128 out[8];
+    out[0] = _mm_shuffle_ps(p0, _mm_shuffle_ps(p0, n0, SHUF(2, 2, 0, 0)), SHUF(0, 1, 0, 2));
+    out[1] = _mm_shuffle_ps(n0, t0, SHUF(1, 2, 0, 1));
+    out[2] = _mm_shuffle_ps(_mm_shuffle_ps(p0, p1, SHUF(3, 3, 0, 1)), _mm_shuffle_ps(p1, n0, SHUF(1, 1, 3, 3)), SHUF(1, 2, 0, 2));
+    out[3] = _mm_shuffle_ps(n1, t0, SHUF(0, 1, 2, 3));
+    out[4] = _mm_shuffle_ps(p1, _mm_shuffle_ps(p2, n1, SHUF(0, 0, 2, 2)), SHUF(2, 3, 0, 2));
+    out[5] = _mm_shuffle_ps(_mm_shuffle_ps(n1, n2, SHUF(3, 3, 0, 0)), t1, SHUF(0, 2, 0, 1));
+    out[6] = _mm_shuffle_ps(p2, _mm_shuffle_ps(p2, n2, SHUF(3, 3, 1, 1)), SHUF(1, 2, 0, 2));
+    out[7] = _mm_shuffle_ps(n2, t1, SHUF(2, 3, 2, 3));
+
+    const size_t first = b * 4;
+    for (size_t i = 0; i < 4; ++i)
+    {
+      auto* dst = destination + (remap ? remap[first + i] : first + i) * InterleavedVertexFloats;
+      _mm_storeu_ps(dst, out[i * 2]);
+      _mm_storeu_ps(dst + 4, out[i * 2 + 1]);
+    }
+  }
+#undef SHUF
+  InterleaveRange(destination, streams, remap, blockCount * 4, vertexCount);
+#else
+  InterleaveVerticesScalar(destination, streams, remap, vertexCount);
+#endif
+}
+
+void InterleaveVertices(float* destination, const VertexStreams& streams, const uint32_t* remap, size_t vertexCount)
+{
+  // 1 頂点あたりの処理は単純なコピーのため, コンパイラの生成する scalar 版の方が速い.
+  InterleaveVerticesScalar(destination, streams, remap, vertexCount);
+}
@@ -0,0 +1,29 @@
+﻿#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// 頂点の組み立て. 位置/法線/UV の各ストリームを 1 つの頂点 (pos3, normal3, uv2 の 32 バイト) に並べる.
+// 入力はアクセッサのデータをそのまま指せばよく, 途中でメモリ確保は行わない.
+
+// 頂点属性のストリーム. ストライドはバイト単位.
+struct VertexStreams
+{
+  const float* positions;
+  size_t positionStride;
+  const float* normals;
+  size_t normalStride;
+  const float* uvs;
+  size_t uvStride;
+};
+
+// 組み立てた頂点 1 つあたりの float 数
+const size_t InterleavedVertexFloats = 8;
+
+// ソースの頂点 i を destination の remap[i] 番目 (remap が nullptr なら i 番目) に書き込む.
+// destination は vertexCount 個の頂点分の領域を持つこと. ステージングのマップ領域を直接指してもよい.
+void InterleaveVerticesScalar(float* destination, const VertexStreams& streams, const uint32_t* remap, size_t vertexCount);
+// 4 頂点ずつシャッフルで並べ替える. 詰めて格納されていないストリームは scalar 版で処理する.
+// シャッフルの分だけ遅く, 計測 (RunVertexAssemblyBenchmark) では scalar 版を下回るため比較用に残している.
+void InterleaveVerticesSimd(float* destination, const VertexStreams& streams, const uint32_t* remap, size_t vertexCount);
+// 速い方の実装 (現在は scalar 版) を使う.
+void InterleaveVertices(float* destination, const VertexStreams& streams, const uint32_t* remap, size_t vertexCount);
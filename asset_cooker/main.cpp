@@ -0,0 +1,224 @@
+﻿#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cwctype>
+
+#if _MSC_VER > 1922 && !defined(_SILENCE_EXPERIMENTAL_FILESYSTEM_DEPRECATION_WARNING)
+#define _SILENCE_EXPERIMENTAL_FILESYSTEM_DEPRECATION_WARNING
+#endif
+#include <experimental/filesystem>
+
+#include "../04_DrawModel/modelcooker.h"
+#include "../04_DrawModel/mappedfile.h"
+
+// glTF/VRM (GLB) のモデルを調理済みのキャッシュ (元ファイル名 + ".<設定>.cache") に変換する.
+// 04_DrawModel と同じ処理とファイル名で作るため, 設定が同じなら実行時はキャッシュから直接読み込める.
+// 設定ごとに別のファイルになるので, 複数の設定で実行すればそれぞれのキャッシュを用意できる.
+//
+//  asset_cooker [オプション] <ディレクトリまたはファイル>...
+//   -compact      量子化した頂点形式にする
+//   -meshlets     メッシュレットを生成する
+//   -no-optimize  メッシュの最適化を行わない
+//   -no-lods      LOD を生成しない
+//   -force        変更のないモデルも変換し直す
+//   -jobs N       同時に変換するモデル数 (既定は論理コア数)
+//   -verbose      プリミティブごとの最適化結果も表示する
+
+using namespace std;
+namespace fs = std::experimental::filesystem;
+
+enum class CookResult
+{
+  Cooked,
+  Skipped,
+  Failed,
+};
+
+struct CookJob
+{
+  fs::path source;
+  CookResult result;
+  CookStats stats;
+};
+
+static bool IsModelFile(const fs::path& path)
+{
+  auto extension = path.extension().wstring();
+  transform(extension.begin(), extension.end(), extension.begin(), [](wchar_t c) { return wchar_t(towlower(c)); });
+  return extension == L".vrm" || extension == L".glb";
+}
+
+// 既存のキャッシュが元ファイルと設定に一致していれば変換を省く.
+static bool IsUpToDate(const wstring& sourceFile, const wstring& cacheFile, const CookSettings& settings)
+{
+  uint64_t sourceHash = 0;
+  MappedFile cache;
+  if (!HashSourceFile(sourceFile.c_str(), &sourceHash) || !cache.open(cacheFile.c_str()))
+  {
+    return false;
+  }
+  auto header = ValidateCookedModel(cache.data(), cache.size(), sourceHash, settings.options());
+  auto vertexStride = settings.compactVertices ? sizeof(CookedCompactVertex) : sizeof(CookedVertex);
+  return header != nullptr && header->vertexStride == vertexStride && header->meshletStride == sizeof(CookedMeshlet);
+}
+
+static wstring Widen(const string& text)
+{
+  return wstring(text.begin(), text.end());
+}
+
+static double Megabytes(uint64_t size)
+{
+  return double(size) / (1024.0 * 1024.0);
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+  // 04_DrawModel (ModelApp) の既定値に合わせる.
+  CookSettings settings{ false, true, false, true, 0 };
+  bool force = false, verbose = false;
+  unsigned jobCount = (max)(thread::hardware_concurrency(), 1u);
+  vector<fs::path> inputs;
+  for (int i = 1; i < argc; ++i)
+  {
+    wstring arg = argv[i];
+    if (arg == L"-compact") { settings.compactVertices = true; }
+    else if (arg == L"-meshlets") { settings.meshlets = true; }
+    else if (arg == L"-no-optimize") { settings.optimizeMeshes = false; }
+    else if (arg == L"-no-lods") { settings.lods = false; }
+    else if (arg == L"-force") { force = true; }
+    else if (arg == L"-verbose") { verbose = true; }
+    else if (arg == L"-jobs" && i + 1 < argc) { jobCount = unsigned((max)(_wtoi(argv[++i]), 1)); }
+    else { inputs.push_back(arg); }
+  }
+  if (inputs.empty())
+  {
+    wcout << L"usage: asset_cooker [-compact] [-meshlets] [-no-optimize] [-no-lods] [-force] [-jobs N] [-verbose] <directory or file>..." << endl;
+    return 1;
+  }
+
+  // ディレクトリは再帰的に .vrm/.glb を集める.
+  vector<CookJob> jobs;
+  for (const auto& input : inputs)
+  {
+    error_code ec;
+    if (fs::is_directory(input, ec))
+    {
+      for (fs::recursive_directory_iterator it(input, ec), end; !ec && it != end; it.increment(ec))
+      {
+        if (fs::is_regular_file(it->path(), ec) && IsModelFile(it->path()))
+        {
+          jobs.push_back(CookJob{ it->path() });
+        }
+      }
+    }
+    else if (fs::is_regular_file(input, ec))
+    {
+      jobs.push_back(CookJob{ input });
+    }
+    else
+    {
+      wcout << L"not found: " << input.wstring() << endl;
+    }
+  }
+
+  // 1 つのモデルを 1 つのスレッドで変換する. 空いたスレッドが次のモデルを取る.
+  auto start = chrono::steady_clock::now();
+  atomic<size_t> nextJob(0);
+  mutex outputMutex;
+  auto worker = [&]() {
+    for (size_t index = nextJob++; index < jobs.size(); index = nextJob++)
+    {
+      auto& job = jobs[index];
+      const auto sourceFile = job.source.wstring();
+      const auto cacheFile = GetCookedCacheFileName(sourceFile, settings.options());
+      wstringstream ss;
+      ss << fixed << setprecision(1);
+      if (!force && IsUpToDate(sourceFile, cacheFile, settings))
+      {
+        job.result = CookResult::Skipped;
+        ss << L"skipped " << sourceFile << L" (up to date)" << endl;
+      }
+      else
+      {
+        CookedModelWriter writer;
+        string error = "Unable to create the cache file.";
+        job.stats = CookStats{};
+        job.result = writer.open(cacheFile.c_str()) && CookModel(sourceFile.c_str(), writer, settings, &job.stats, &error)
+          ? CookResult::Cooked : CookResult::Failed;
+        const auto& stats = job.stats;
+        if (job.result == CookResult::Failed)
+        {
+          ss << L"FAILED  " << sourceFile << L": " << Widen(error) << endl;
+        }
+        else
+        {
+          ss << L"cooked  " << sourceFile
+            << L"  " << Megabytes(stats.sourceSize) << L" MB -> " << Megabytes(stats.cookedSize) << L" MB"
+            << L"  " << stats.parseTime + stats.geometryTime + stats.textureTime + stats.writeTime << L" ms"
+            << L" (parse " << stats.parseTime << L", geometry " << stats.geometryTime
+            << L", textures " << stats.textureTime << L", write " << stats.writeTime << L")"
+            << L"  " << stats.meshCount << L" meshes, " << stats.materialCount << L" materials, "
+            << stats.vertexCount << L" vertices, " << stats.triangleCount << L" triangles" << endl;
+          if (verbose)
+          {
+            ss << Widen(stats.report);
+          }
+        }
+      }
+      lock_guard<mutex> lock(outputMutex);
+      wcout << ss.str() << flush;
+    }
+  };
+  // 複数のモデルを同時に変換する場合, モデル内のプリミティブは並列化しない (スレッド数が掛け算で増えるため).
+  const auto workerCount = (min)(jobCount, unsigned((max)(jobs.size(), size_t(1))));
+  settings.threadCount = workerCount > 1 ? 1 : 0;
+  vector<thread> threads;
+  for (unsigned i = 0; i < workerCount; ++i)
+  {
+    threads.emplace_back(worker);
+  }
+  for (auto& t : threads)
+  {
+    t.join();
+  }
+
+  // 集計
+  size_t cooked = 0, skipped = 0, failed = 0;
+  uint64_t sourceSize = 0, cookedSize = 0;
+  double cookTime = 0.0;
+  for (const auto& job : jobs)
+  {
+    switch (job.result)
+    {
+    case CookResult::Cooked:
+      ++cooked;
+      sourceSize += job.stats.sourceSize;
+      cookedSize += job.stats.cookedSize;
+      cookTime += job.stats.parseTime + job.stats.geometryTime + job.stats.textureTime + job.stats.writeTime;
+      break;
+    case CookResult::Skipped:
+      ++skipped;
+      break;
+    case CookResult::Failed:
+      ++failed;
+      break;
+    }
+  }
+  auto elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  wcout << fixed << setprecision(1)
+    << cooked << L" cooked, " << skipped << L" skipped, " << failed << L" failed"
+    << L"  " << Megabytes(sourceSize) << L" MB -> " << Megabytes(cookedSize) << L" MB"
+    << L"  " << elapsed << L" s (" << cookTime / 1000.0 << L" s of cooking on " << threads.size() << L" threads)" << endl;
+  return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,48 @@
+﻿#pragma once
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <vulkan/vulkan.h>
+
+// インスタンス描画用のインスタンスごとのデータ.
+// 2 番目の頂点バインディング (VK_VERTEX_INPUT_RATE_INSTANCE) として渡す.
+struct InstanceData
+{
+  glm::mat4 world;
+  glm::vec4 tint;   // 頂点カラー/テクスチャに乗算する色
+};
+
+inline VkVertexInputBindingDescription GetInstanceBinding(uint32_t binding)
+{
+  return VkVertexInputBindingDescription{ binding, sizeof(InstanceData), VK_VERTEX_INPUT_RATE_INSTANCE };
+}
+
+// world は列ごとに 4 つのロケーションを使い, 続くロケーションに tint を置く.
+inline void AppendInstanceAttributes(std::vector<VkVertexInputAttributeDescription>& attribs, uint32_t binding, uint32_t firstLocation)
+{
+  for (uint32_t i = 0; i < 4; ++i)
+  {
+    attribs.push_back({ firstLocation + i, binding, VK_FORMAT_R32G32B32A32_SFLOAT, uint32_t(offsetof(InstanceData, world) + sizeof(glm::vec4) * i) });
+  }
+  attribs.push_back({ firstLocation + 4, binding, VK_FORMAT_R32G32B32A32_SFLOAT, uint32_t(offsetof(InstanceData, tint)) });
+}
+
+// count 個のインスタンスを XZ 平面の正方形の格子 (原点中心) に並べる.
+// 色は格子上の位置に応じて変える.
+inline std::vector<InstanceData> MakeInstanceGrid(uint32_t count, float spacing)
+{
+  std::vector<InstanceData> instances(count);
+  auto columns = uint32_t(std::ceil(std::sqrt(float(count))));
+  auto offset = (float(columns) - 1.0f) * 0.5f * spacing;
+  for (uint32_t i = 0; i < count; ++i)
+  {
+    auto x = float(i % columns);
+    auto z = float(i / columns);
+    auto position = glm::vec3(x * spacing - offset, 0.0f, z * spacing - offset);
+    instances[i].world = glm::translate(glm::mat4(1.0f), position);
+    instances[i].tint = glm::vec4(0.5f + 0.5f * x / float(columns), 0.5f + 0.5f * z / float(columns), 1.0f, 1.0f);
+  }
+  return instances;
+}
@@ -0,0 +1,15 @@
+﻿#pragma once
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+// Vulkan のクリップ空間 (深度 0..1) に合わせた透視投影行列を作成する.
+// 逆Z の場合は near/far を入れ替え, 手前が 1, 奥が 0 になるようにする.
+// 浮動小数点の精度が 0 付近に集中するため, 遠方の深度精度が改善する.
+inline glm::mat4 MakePerspective(float fovy, float aspect, float zNear, float zFar, bool reversedZ)
+{
+  if (reversedZ)
+  {
+    return glm::perspectiveRH_ZO(fovy, aspect, zFar, zNear);
+  }
+  return glm::perspectiveRH_ZO(fovy, aspect, zNear, zFar);
+}
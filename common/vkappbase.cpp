@@ -1,600 +1,1789 @@
-﻿#include "vkappbase.h"
-#include <sstream>
-#include <algorithm>
-#include <array>
-
-#define GetInstanceProcAddr(FuncName) \
-  m_##FuncName = reinterpret_cast<PFN_##FuncName>(vkGetInstanceProcAddr(m_instance, #FuncName))
-
-using namespace std;
-
-static VkBool32 VKAPI_CALL DebugReportCallback(
-  VkDebugReportFlagsEXT flags,
-  VkDebugReportObjectTypeEXT objactTypes,
-  uint64_t object,
-  size_t	location,
-  int32_t messageCode,
-  const char* pLayerPrefix,
-  const char* pMessage,
-  void* pUserData)
-{
-  VkBool32 ret = VK_FALSE;
-  if (flags & VK_DEBUG_REPORT_INFORMATION_BIT_EXT ||
-    flags & VK_DEBUG_REPORT_DEBUG_BIT_EXT)
-  {
-    ret = VK_TRUE;
-  }
-  std::stringstream ss;
-  if (pLayerPrefix)
-  {
-    ss << "[" << pLayerPrefix << "] ";
-  }
-  ss << pMessage << std::endl;
-
-  OutputDebugStringA(ss.str().c_str());
-
-  return ret;
-}
-
-void VulkanAppBase::checkResult(VkResult result)
-{
-  if (result != VK_SUCCESS)
-  {
-    DebugBreak();
-  }
-}
-
-VulkanAppBase::VulkanAppBase()
-  : m_presentMode(VK_PRESENT_MODE_FIFO_KHR)
-  ,m_imageIndex(0)
-{
-}
-
-void VulkanAppBase::initialize(GLFWwindow* window, const char* appName)
-{
-  // Vulkan インスタンスの生成
-  initializeInstance(appName);
-  // 物理デバイスの選択
-  selectPhysicalDevice();
-  m_graphicsQueueIndex = searchGraphicsQueueIndex();
-
-#ifdef _DEBUG
-  // デバッグレポート関数のセット.
-  enableDebugReport();
-#endif
-
-  // 論理デバイスの生成
-  createDevice();
-  // コマンドプールの準備
-  prepareCommandPool();
-
-  // サーフェース生成
-  glfwCreateWindowSurface(m_instance, window, nullptr, &m_surface);
-  // サーフェースのフォーマット情報選択
-  selectSurfaceFormat(VK_FORMAT_B8G8R8A8_UNORM);
-  // サーフェースの能力値情報取得
-  vkGetPhysicalDeviceSurfaceCapabilitiesKHR(m_physDev, m_surface, &m_surfaceCaps);
-  VkBool32 isSupport;
-  vkGetPhysicalDeviceSurfaceSupportKHR(m_physDev, m_graphicsQueueIndex, m_surface, &isSupport);
-
-  // スワップチェイン生成
-  createSwapchain(window);
-  // デプスバッファ生成
-  createDepthBuffer();
-  // スワップチェインイメージとデプスバッファへのImageViewを生成
-  createViews();
-
-  // レンダーパスの生成
-  createRenderPass();
-
-  // フレームバッファの生成
-  createFramebuffer();
-
-  // コマンドバッファの準備.
-  prepareCommandBuffers();
-
-  // 描画フレーム同期用
-  prepareSemaphores();
-
-  prepare();
-}
-
-void VulkanAppBase::terminate()
-{
-  vkDeviceWaitIdle(m_device);
-
-  cleanup();
-  
-  vkFreeCommandBuffers(m_device, m_commandPool, uint32_t(m_commands.size()), m_commands.data());
-  m_commands.clear();
-
-  vkDestroyRenderPass(m_device, m_renderPass, nullptr);
-  for (auto& v : m_framebuffers)
-  {
-    vkDestroyFramebuffer(m_device, v, nullptr);
-  }
-  m_framebuffers.clear();
-
-  vkFreeMemory(m_device, m_depthBufferMemory, nullptr);
-  vkDestroyImage(m_device, m_depthBuffer, nullptr);
-  vkDestroyImageView(m_device, m_depthBufferView, nullptr);
-
-  for (auto& v : m_swapchainViews)
-  {
-    vkDestroyImageView(m_device, v, nullptr);
-  }
-  m_swapchainImages.clear();
-  vkDestroySwapchainKHR(m_device, m_swapchain, nullptr);
-
-  for (auto& v : m_fences)
-  {
-    vkDestroyFence(m_device, v, nullptr);
-  }
-  m_fences.clear();
-  vkDestroySemaphore(m_device, m_presentCompletedSem, nullptr);
-  vkDestroySemaphore(m_device, m_renderCompletedSem, nullptr);
-
-  vkDestroyCommandPool(m_device, m_commandPool, nullptr);
-
-  vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
-  vkDestroyDevice(m_device, nullptr);
-#ifdef _DEBUG
-  disableDebugReport();
-#endif
-  vkDestroyInstance(m_instance,nullptr);
-}
-
-
-void VulkanAppBase::initializeInstance(const char* appName)
-{
-  vector<const char*> extensions;
-  VkApplicationInfo appInfo{};
-  appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-  appInfo.pApplicationName = appName;
-  appInfo.pEngineName = appName;
-  appInfo.apiVersion = VK_API_VERSION_1_1;
-  appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-
-  // 拡張情報の取得.
-  vector<VkExtensionProperties> props;
-  {
-    uint32_t count = 0;
-    vkEnumerateInstanceExtensionProperties(nullptr, &count, nullptr);
-    props.resize(count);
-    vkEnumerateInstanceExtensionProperties(nullptr, &count, props.data());
-
-    for (const auto& v : props)
-    {
-      extensions.push_back(v.extensionName);
-    }
-  }
-
-  VkInstanceCreateInfo ci{};
-  ci.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO; 
-  ci.enabledExtensionCount = uint32_t(extensions.size());
-  ci.ppEnabledExtensionNames = extensions.data();
-  ci.pApplicationInfo = &appInfo;
-#ifdef _DEBUG 
-  // デバッグビルド時には検証レイヤーを有効化
-  const char* layers[] = { "VK_LAYER_KHRONOS_validation" };
-  if (VK_HEADER_VERSION_COMPLETE < VK_MAKE_VERSION(1, 1, 106)) {
-	  // "VK_LAYER_LUNARG_standard_validation" は廃止になっているが昔の Vulkan SDK では動くので対処しておく.
-	  layers[0] = "VK_LAYER_LUNARG_standard_validation";
-  }
-  ci.enabledLayerCount = 1;
-  ci.ppEnabledLayerNames = layers;
-#endif
-
-  // インスタンス生成
-  auto result = vkCreateInstance(&ci, nullptr, &m_instance);
-  checkResult(result);
-}
-
-void VulkanAppBase::selectPhysicalDevice()
-{
-  uint32_t devCount = 0;
-  vkEnumeratePhysicalDevices(m_instance, &devCount, nullptr);
-  vector<VkPhysicalDevice> physDevs(devCount);
-  vkEnumeratePhysicalDevices(m_instance, &devCount, physDevs.data());
-
-  // 最初のデバイスを使用する
-  m_physDev = physDevs[0];
-  // メモリプロパティを取得しておく
-  vkGetPhysicalDeviceMemoryProperties(m_physDev, &m_physMemProps);
-}
-
-uint32_t VulkanAppBase::searchGraphicsQueueIndex()
-{
-  uint32_t propCount;
-  vkGetPhysicalDeviceQueueFamilyProperties(m_physDev, &propCount, nullptr);
-  vector<VkQueueFamilyProperties> props(propCount);
-  vkGetPhysicalDeviceQueueFamilyProperties(m_physDev, &propCount, props.data());
-
-  uint32_t graphicsQueue = ~0u;
-  for (uint32_t i = 0; i < propCount; ++i)
-  {
-    if (props[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
-    {
-      graphicsQueue = i; break;
-    }
-  }
-  return graphicsQueue;
-}
-void VulkanAppBase::createDevice()
-{
-  const float defaultQueuePriority(1.0f);
-  VkDeviceQueueCreateInfo devQueueCI{};
-  devQueueCI.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-  devQueueCI.queueFamilyIndex = m_graphicsQueueIndex;
-  devQueueCI.queueCount = 1;
-  devQueueCI.pQueuePriorities = &defaultQueuePriority;
-
-
-  vector<VkExtensionProperties> devExtProps;
-  {
-    // 拡張情報の取得.
-    uint32_t count = 0;
-    vkEnumerateDeviceExtensionProperties(m_physDev, nullptr, &count, nullptr);
-    devExtProps.resize(count);
-    vkEnumerateDeviceExtensionProperties(m_physDev, nullptr, &count, devExtProps.data());
-  }
-
-  vector<const char*> extensions;
-  for (const auto& v : devExtProps)
-  {
-    extensions.push_back(v.extensionName);
-  }
-  VkDeviceCreateInfo ci{};
-  ci.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-  ci.pQueueCreateInfos = &devQueueCI;
-  ci.queueCreateInfoCount = 1;
-  ci.ppEnabledExtensionNames = extensions.data();
-  ci.enabledExtensionCount = uint32_t(extensions.size());
-
-  auto result = vkCreateDevice(m_physDev, &ci, nullptr, &m_device);
-  checkResult(result);
-
-  // デバイスキューの取得
-  vkGetDeviceQueue(m_device, m_graphicsQueueIndex, 0, &m_deviceQueue);
-}
-
-void VulkanAppBase::prepareCommandPool()
-{
-  VkCommandPoolCreateInfo ci{};
-  ci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-  ci.queueFamilyIndex = m_graphicsQueueIndex;
-  ci.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-  auto result = vkCreateCommandPool(m_device, &ci, nullptr, &m_commandPool);
-  checkResult(result);
-}
-
-void VulkanAppBase::selectSurfaceFormat(VkFormat format)
-{
-  uint32_t surfaceFormatCount = 0;
-  vkGetPhysicalDeviceSurfaceFormatsKHR(m_physDev, m_surface, &surfaceFormatCount, nullptr);
-  std::vector<VkSurfaceFormatKHR> formats(surfaceFormatCount);
-  vkGetPhysicalDeviceSurfaceFormatsKHR(m_physDev, m_surface, &surfaceFormatCount, formats.data());
-
-  // 検索して一致するフォーマットを見つける.
-  for (const auto& f : formats)
-  {
-    if (f.format == format)
-    {
-      m_surfaceFormat = f;
-    }
-  }
-}
-
-void VulkanAppBase::createSwapchain(GLFWwindow* window)
-{
-  auto imageCount = (std::max)(2u, m_surfaceCaps.minImageCount);
-  auto extent = m_surfaceCaps.currentExtent;
-  if (extent.width == ~0u)
-  {
-    // 値が無効なのでウィンドウサイズを使用する.
-    int width, height;
-    glfwGetWindowSize(window, &width, &height);
-    extent.width = uint32_t(width);
-    extent.height = uint32_t(height);
-  }
-  uint32_t queueFamilyIndices[] = { m_graphicsQueueIndex };
-  VkSwapchainCreateInfoKHR ci{};
-  ci.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-  ci.surface = m_surface;
-  ci.minImageCount = imageCount;
-  ci.imageFormat = m_surfaceFormat.format;
-  ci.imageColorSpace = m_surfaceFormat.colorSpace;
-  ci.imageExtent = extent;
-  ci.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-  ci.preTransform = m_surfaceCaps.currentTransform;
-  ci.imageArrayLayers = 1;
-  ci.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-  ci.queueFamilyIndexCount = 0;
-  ci.presentMode = m_presentMode;
-  ci.oldSwapchain = VK_NULL_HANDLE;
-  ci.clipped = VK_TRUE;
-  ci.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-
-  auto result = vkCreateSwapchainKHR(m_device, &ci, nullptr, &m_swapchain);
-  checkResult(result);
-  m_swapchainExtent = extent;
-}
-void VulkanAppBase::createDepthBuffer()
-{
-  VkImageCreateInfo ci{};
-  ci.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-  ci.imageType = VK_IMAGE_TYPE_2D;
-  ci.format = VK_FORMAT_D32_SFLOAT;
-  ci.extent.width = m_swapchainExtent.width;
-  ci.extent.height = m_swapchainExtent.height;
-  ci.extent.depth = 1;
-  ci.mipLevels = 1;
-  ci.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
-  ci.samples = VK_SAMPLE_COUNT_1_BIT;
-  ci.arrayLayers = 1;
-  auto result = vkCreateImage(m_device, &ci, nullptr, &m_depthBuffer);
-  checkResult(result);
-
-  VkMemoryRequirements reqs;
-  vkGetImageMemoryRequirements(m_device, m_depthBuffer, &reqs);
-  VkMemoryAllocateInfo ai{};
-  ai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  ai.allocationSize = reqs.size;
-  ai.memoryTypeIndex = getMemoryTypeIndex(reqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-  vkAllocateMemory(m_device, &ai, nullptr, &m_depthBufferMemory);
-  vkBindImageMemory(m_device, m_depthBuffer, m_depthBufferMemory, 0);
-}
-
-void VulkanAppBase::createViews()
-{
-  uint32_t imageCount;
-  vkGetSwapchainImagesKHR(m_device, m_swapchain, &imageCount, nullptr);
-  m_swapchainImages.resize(imageCount);
-  vkGetSwapchainImagesKHR(m_device, m_swapchain, &imageCount, m_swapchainImages.data());
-  m_swapchainViews.resize(imageCount);
-  for (uint32_t i = 0; i < imageCount; ++i)
-  {
-    VkImageViewCreateInfo ci{};
-    ci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-    ci.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    ci.format = m_surfaceFormat.format;
-    ci.components = { 
-      VK_COMPONENT_SWIZZLE_R,
-      VK_COMPONENT_SWIZZLE_G,
-      VK_COMPONENT_SWIZZLE_B,
-      VK_COMPONENT_SWIZZLE_A,
-    };
-    ci.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
-    ci.image = m_swapchainImages[i];
-    auto result = vkCreateImageView(m_device, &ci, nullptr, &m_swapchainViews[i]);
-    checkResult(result);
-  }
-
-  // for depthbuffer
-  {
-    VkImageViewCreateInfo ci{};
-    ci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-    ci.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    ci.format = VK_FORMAT_D32_SFLOAT;
-    ci.components = {
-      VK_COMPONENT_SWIZZLE_R,
-      VK_COMPONENT_SWIZZLE_G,
-      VK_COMPONENT_SWIZZLE_B,
-      VK_COMPONENT_SWIZZLE_A,
-    };
-    ci.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
-    ci.image = m_depthBuffer;
-    auto result = vkCreateImageView(m_device, &ci, nullptr, &m_depthBufferView);
-    checkResult(result);
-  }
-}
-
-void VulkanAppBase::createRenderPass()
-{
-  VkRenderPassCreateInfo ci{};
-  ci.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-
-  array<VkAttachmentDescription, 2> attachments;
-  auto& colorTarget = attachments[0];
-  auto& depthTarget = attachments[1];
-
-  colorTarget = VkAttachmentDescription{};
-  colorTarget.format = m_surfaceFormat.format;
-  colorTarget.samples = VK_SAMPLE_COUNT_1_BIT;
-  colorTarget.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-  colorTarget.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-  colorTarget.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-  colorTarget.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  colorTarget.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  colorTarget.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-  depthTarget = VkAttachmentDescription{};
-  depthTarget.format = VK_FORMAT_D32_SFLOAT;
-  depthTarget.samples = VK_SAMPLE_COUNT_1_BIT;
-  depthTarget.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-  depthTarget.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-  depthTarget.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-  depthTarget.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  depthTarget.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  depthTarget.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-  VkAttachmentReference colorReference{}, depthReference{};
-  colorReference.attachment = 0;
-  colorReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-  depthReference.attachment = 1;
-  depthReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-  VkSubpassDescription subpassDesc{};
-  subpassDesc.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-  subpassDesc.colorAttachmentCount = 1;
-  subpassDesc.pColorAttachments = &colorReference;
-  subpassDesc.pDepthStencilAttachment = &depthReference;
-
-  ci.attachmentCount = uint32_t(attachments.size());
-  ci.pAttachments = attachments.data();
-  ci.subpassCount = 1;
-  ci.pSubpasses = &subpassDesc;
-
-  auto result = vkCreateRenderPass(m_device, &ci, nullptr, &m_renderPass);
-  checkResult(result);
-}
-
-void VulkanAppBase::createFramebuffer()
-{
-  VkFramebufferCreateInfo ci{};
-  ci.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-  ci.renderPass = m_renderPass;
-  ci.width = m_swapchainExtent.width;
-  ci.height = m_swapchainExtent.height;
-  ci.layers = 1;
-  m_framebuffers.clear();
-  for (auto& v : m_swapchainViews)
-  {
-    array<VkImageView, 2> attachments;
-    ci.attachmentCount = uint32_t(attachments.size());
-    ci.pAttachments = attachments.data();
-    attachments[0] = v;
-    attachments[1] = m_depthBufferView;
-
-    VkFramebuffer framebuffer;
-    auto result = vkCreateFramebuffer(m_device, &ci, nullptr, &framebuffer);
-    checkResult(result);
-    m_framebuffers.push_back(framebuffer);
-  }
-}
-void VulkanAppBase::prepareCommandBuffers()
-{
-  VkCommandBufferAllocateInfo ai{};
-  ai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  ai.commandPool = m_commandPool;
-  ai.commandBufferCount = uint32_t(m_swapchainViews.size());
-  ai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  m_commands.resize(ai.commandBufferCount);
-  auto result = vkAllocateCommandBuffers(m_device, &ai, m_commands.data());
-  checkResult(result);
-
-  // コマンドバッファのフェンスも同数用意する.
-  m_fences.resize(ai.commandBufferCount);
-  VkFenceCreateInfo ci{};
-  ci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  ci.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-  for (auto& v : m_fences)
-  {
-    result = vkCreateFence(m_device, &ci, nullptr, &v);
-    checkResult(result);
-  }
-}
-
-void VulkanAppBase::prepareSemaphores()
-{
-  VkSemaphoreCreateInfo ci{};
-  ci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-  vkCreateSemaphore(m_device, &ci, nullptr, &m_renderCompletedSem);
-  vkCreateSemaphore(m_device, &ci, nullptr, &m_presentCompletedSem);
-}
-
-
-uint32_t VulkanAppBase::getMemoryTypeIndex(uint32_t requestBits, VkMemoryPropertyFlags requestProps)const
-{
-  uint32_t result = ~0u;
-  for (uint32_t i = 0; i < m_physMemProps.memoryTypeCount; ++i)
-  {
-    if (requestBits & 1)
-    {
-      const auto& types = m_physMemProps.memoryTypes[i];
-      if ((types.propertyFlags & requestProps) == requestProps)
-      {
-        result = i;
-        break;
-      }
-    }
-    requestBits >>= 1;
-  }
-  return result;
-}
-
-
-void VulkanAppBase::enableDebugReport()
-{
-  GetInstanceProcAddr(vkCreateDebugReportCallbackEXT);
-  GetInstanceProcAddr(vkDebugReportMessageEXT);
-  GetInstanceProcAddr(vkDestroyDebugReportCallbackEXT);
-
-  VkDebugReportFlagsEXT flags = VK_DEBUG_REPORT_ERROR_BIT_EXT | VK_DEBUG_REPORT_WARNING_BIT_EXT;
-
-  VkDebugReportCallbackCreateInfoEXT drcCI{};
-  drcCI.sType = VK_STRUCTURE_TYPE_DEBUG_REPORT_CALLBACK_CREATE_INFO_EXT;
-  drcCI.flags = flags;
-  drcCI.pfnCallback = &DebugReportCallback;
-  m_vkCreateDebugReportCallbackEXT(m_instance, &drcCI, nullptr, &m_debugReport);
-}
-void VulkanAppBase::disableDebugReport()
-{
-  if (m_vkDestroyDebugReportCallbackEXT)
-  {
-    m_vkDestroyDebugReportCallbackEXT(m_instance, m_debugReport, nullptr);
-  }
-}
-
-void VulkanAppBase::render()
-{
-  uint32_t nextImageIndex = 0;
-  vkAcquireNextImageKHR(m_device, m_swapchain, UINT64_MAX, m_presentCompletedSem, VK_NULL_HANDLE, &nextImageIndex);
-  auto commandFence = m_fences[nextImageIndex];
-  vkWaitForFences(m_device, 1, &commandFence, VK_TRUE, UINT64_MAX);
-
-  // クリア値
-  array<VkClearValue, 2> clearValue = {
-    { {0.5f, 0.25f, 0.25f, 0.0f}, // for Color
-      {1.0f, 0 } // for Depth
-    }
-  };
-
-  VkRenderPassBeginInfo renderPassBI{};
-  renderPassBI.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-  renderPassBI.renderPass = m_renderPass;
-  renderPassBI.framebuffer = m_framebuffers[nextImageIndex];
-  renderPassBI.renderArea.offset = VkOffset2D{ 0, 0 };
-  renderPassBI.renderArea.extent = m_swapchainExtent;
-  renderPassBI.pClearValues = clearValue.data();
-  renderPassBI.clearValueCount = uint32_t(clearValue.size());
-
-  // コマンドバッファ・レンダーパス開始
-  VkCommandBufferBeginInfo commandBI{};
-  commandBI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  auto& command = m_commands[nextImageIndex];
-  vkBeginCommandBuffer(command, &commandBI);
-  vkCmdBeginRenderPass(command, &renderPassBI, VK_SUBPASS_CONTENTS_INLINE);
-
-  m_imageIndex = nextImageIndex;
-  makeCommand(command);
-
-  // コマンド・レンダーパス終了
-  vkCmdEndRenderPass(command);
-  vkEndCommandBuffer(command);
-
-  // コマンドを実行（送信)
-  VkSubmitInfo submitInfo{};
-  VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &command;
-  submitInfo.pWaitDstStageMask = &waitStageMask;
-  submitInfo.waitSemaphoreCount = 1;
-  submitInfo.pWaitSemaphores = &m_presentCompletedSem;
-  submitInfo.signalSemaphoreCount = 1;
-  submitInfo.pSignalSemaphores = &m_renderCompletedSem;
-  vkResetFences(m_device, 1, &commandFence);
-  vkQueueSubmit(m_deviceQueue, 1, &submitInfo, commandFence);
-
-  // Present 処理
-  VkPresentInfoKHR presentInfo{};
-  presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-  presentInfo.swapchainCount = 1;
-  presentInfo.pSwapchains = &m_swapchain;
-  presentInfo.pImageIndices = &nextImageIndex;
-  presentInfo.waitSemaphoreCount = 1;
-  presentInfo.pWaitSemaphores = &m_renderCompletedSem;
-  vkQueuePresentKHR(m_deviceQueue, &presentInfo);
+﻿#include "vkappbase.h"
+#include <sstream>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <chrono>
+
+#define GetInstanceProcAddr(FuncName) \
+  m_##FuncName = reinterpret_cast<PFN_##FuncName>(vkGetInstanceProcAddr(m_instance, #FuncName))
+
+using namespace std;
+
+static VkBool32 VKAPI_CALL DebugReportCallback(
+  VkDebugReportFlagsEXT flags,
+  VkDebugReportObjectTypeEXT objactTypes,
+  uint64_t object,
+  size_t	location,
+  int32_t messageCode,
+  const char* pLayerPrefix,
+  const char* pMessage,
+  void* pUserData)
+{
+  VkBool32 ret = VK_FALSE;
+  if (flags & VK_DEBUG_REPORT_INFORMATION_BIT_EXT ||
+    flags & VK_DEBUG_REPORT_DEBUG_BIT_EXT)
+  {
+    ret = VK_TRUE;
+  }
+  std::stringstream ss;
+  if (pLayerPrefix)
+  {
+    ss << "[" << pLayerPrefix << "] ";
+  }
+  ss << pMessage << std::endl;
+
+  OutputDebugStringA(ss.str().c_str());
+
+  return ret;
+}
+
+static int CountBits(uint32_t v)
+{
+  int count = 0;
+  for (; v != 0; v &= v - 1)
+  {
+    ++count;
+  }
+  return count;
+}
+
+// 用途ごとの必須/推奨/回避するメモリプロパティ
+static void GetMemoryUsageFlags(
+  VulkanAppBase::MemoryUsage usage,
+  VkMemoryPropertyFlags& required,
+  VkMemoryPropertyFlags& preferred,
+  VkMemoryPropertyFlags& avoided)
+{
+  using MemoryUsage = VulkanAppBase::MemoryUsage;
+  switch (usage)
+  {
+  default:
+  case MemoryUsage::GpuOnly:
+    required = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    preferred = 0;
+    avoided = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+    break;
+  case MemoryUsage::Upload:
+    // 書き込みのみのため HOST_CACHED は不要. 貴重な DEVICE_LOCAL なヒープも避ける.
+    required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    preferred = 0;
+    avoided = VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    break;
+  case MemoryUsage::Readback:
+    required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    preferred = VK_MEMORY_PROPERTY_HOST_CACHED_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    avoided = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    break;
+  case MemoryUsage::Streaming:
+    required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    avoided = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    break;
+  case MemoryUsage::Transient:
+    // 対応していればタイル上のみで完結し, 物理メモリが割り当てられない.
+    required = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    preferred = VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+    avoided = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    break;
+  }
+}
+
+static const char* GetMemoryCategoryName(VulkanAppBase::MemoryCategory category)
+{
+  using MemoryCategory = VulkanAppBase::MemoryCategory;
+  switch (category)
+  {
+  case MemoryCategory::Texture: return "Texture";
+  case MemoryCategory::Mesh: return "Mesh";
+  case MemoryCategory::Uniform: return "Uniform";
+  case MemoryCategory::DepthBuffer: return "DepthBuffer";
+  case MemoryCategory::Staging: return "Staging";
+  default: return "Other";
+  }
+}
+
+void VulkanAppBase::checkResult(VkResult result)
+{
+  if (result != VK_SUCCESS)
+  {
+    DebugBreak();
+  }
+}
+
+VulkanAppBase::VulkanAppBase()
+  : m_enabledFeatures()
+  ,m_vkCmdDrawIndexedIndirectCount(nullptr)
+  ,m_vkCmdBeginConditionalRendering(nullptr)
+  ,m_vkCmdEndConditionalRendering(nullptr)
+  ,m_externalMemoryHostSupported(false)
+  ,m_hostPointerAlignment(0)
+  ,m_vkGetMemoryHostPointerPropertiesEXT(nullptr)
+  ,m_preferHostImageCopy(true)
+  ,m_hostImageCopySupported(false)
+  ,m_hostCopyToShaderReadOnly(false)
+#ifdef VK_EXT_host_image_copy
+  ,m_vkCopyMemoryToImageEXT(nullptr)
+  ,m_vkTransitionImageLayoutEXT(nullptr)
+#endif
+  ,m_memoryBudgetSupported(false)
+  ,m_presentMode(VK_PRESENT_MODE_FIFO_KHR)
+  ,m_frameNumber(1)
+  ,m_completedFrame(0)
+  ,m_timestampPool(VK_NULL_HANDLE)
+  ,m_timestampPeriod(0.0f)
+  ,m_timestampMask(0)
+  ,m_gpuFrameTime(0.0)
+  ,m_cpuFrameTime(0.0)
+  ,m_stagingBufferSize(32 * 1024 * 1024)
+  ,m_stagingBuffer(VK_NULL_HANDLE)
+  ,m_stagingMemory(VK_NULL_HANDLE)
+  ,m_stagingMapped(nullptr)
+  ,m_stagingHead(0)
+  ,m_stagingTail(0)
+  ,m_stagingPeakUsage(0)
+  ,m_uploadCommand(VK_NULL_HANDLE)
+  ,m_uploadBatchDepth(0)
+  ,m_uploadSerial(0)
+  ,m_completedUploadSerial(0)
+  ,m_imageIndex(0)
+{
+  // カラーはクリアして表示用に保存, デプスはパス終了後に読まないので保存しない.
+  m_colorOps = { VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE, VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE };
+  m_depthOps = { VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE };
+  m_depthFormatCandidates = { VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D16_UNORM };
+  m_depthFormat = VK_FORMAT_UNDEFINED;
+  m_reversedZ = false;
+  m_depthSampled = false;
+  m_depthSampledView = VK_NULL_HANDLE;
+  memset(m_categoryCounters, 0, sizeof(m_categoryCounters));
+  memset(m_heapCounters, 0, sizeof(m_heapCounters));
+}
+
+void VulkanAppBase::initialize(GLFWwindow* window, const char* appName)
+{
+  // Vulkan インスタンスの生成
+  initializeInstance(appName);
+  // 物理デバイスの選択
+  selectPhysicalDevice();
+  m_graphicsQueueIndex = searchGraphicsQueueIndex();
+
+#ifdef _DEBUG
+  // デバッグレポート関数のセット.
+  enableDebugReport();
+#endif
+
+  // 論理デバイスの生成
+  createDevice();
+  // コマンドプールの準備
+  prepareCommandPool();
+  // アップロード用ステージングバッファの準備
+  prepareStagingBuffer();
+
+  // サーフェース生成
+  glfwCreateWindowSurface(m_instance, window, nullptr, &m_surface);
+  // サーフェースのフォーマット情報選択
+  selectSurfaceFormat(VK_FORMAT_B8G8R8A8_UNORM);
+  // サーフェースの能力値情報取得
+  vkGetPhysicalDeviceSurfaceCapabilitiesKHR(m_physDev, m_surface, &m_surfaceCaps);
+  VkBool32 isSupport;
+  vkGetPhysicalDeviceSurfaceSupportKHR(m_physDev, m_graphicsQueueIndex, m_surface, &isSupport);
+
+  // スワップチェイン生成
+  createSwapchain(window);
+  // デプスバッファ生成
+  selectDepthFormat();
+  createDepthBuffer();
+  // スワップチェインイメージとデプスバッファへのImageViewを生成
+  createViews();
+
+  // レンダーパスの生成
+  createRenderPass();
+
+  // フレームバッファの生成
+  createFramebuffer();
+  prepareAttachmentLayouts();
+
+  // コマンドバッファの準備.
+  prepareCommandBuffers();
+
+  // 描画フレーム同期用
+  prepareSemaphores();
+  // フレーム時間計測用
+  prepareTimestampQueries();
+
+  prepare();
+}
+
+void VulkanAppBase::terminate()
+{
+  vkDeviceWaitIdle(m_device);
+
+  cleanup();
+  // GPU は停止しているので, 残っている破棄要求はすべて実行してよい.
+  processDeferredDestroys(true);
+
+  destroyStagingBuffer();
+  
+  vkFreeCommandBuffers(m_device, m_commandPool, uint32_t(m_commands.size()), m_commands.data());
+  m_commands.clear();
+
+  vkDestroyRenderPass(m_device, m_renderPass, nullptr);
+  for (auto& v : m_framebuffers)
+  {
+    vkDestroyFramebuffer(m_device, v, nullptr);
+  }
+  m_framebuffers.clear();
+
+  freeMemory(m_depthBufferMemory);
+  vkDestroyImage(m_device, m_depthBuffer, nullptr);
+  vkDestroyImageView(m_device, m_depthBufferView, nullptr);
+  if (m_depthSampledView != VK_NULL_HANDLE)
+  {
+    vkDestroyImageView(m_device, m_depthSampledView, nullptr);
+    m_depthSampledView = VK_NULL_HANDLE;
+  }
+
+  for (auto& v : m_swapchainViews)
+  {
+    vkDestroyImageView(m_device, v, nullptr);
+  }
+  m_swapchainImages.clear();
+  vkDestroySwapchainKHR(m_device, m_swapchain, nullptr);
+
+  for (auto& v : m_fences)
+  {
+    vkDestroyFence(m_device, v, nullptr);
+  }
+  m_fences.clear();
+  m_fenceFrames.clear();
+  if (m_timestampPool != VK_NULL_HANDLE)
+  {
+    vkDestroyQueryPool(m_device, m_timestampPool, nullptr);
+  }
+  vkDestroySemaphore(m_device, m_presentCompletedSem, nullptr);
+  vkDestroySemaphore(m_device, m_renderCompletedSem, nullptr);
+
+  vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+
+  // この時点で残っているメモリはリークしている.
+  reportMemoryUsage();
+  reportMemoryLeaks();
+
+  vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
+  vkDestroyDevice(m_device, nullptr);
+#ifdef _DEBUG
+  disableDebugReport();
+#endif
+  vkDestroyInstance(m_instance,nullptr);
+}
+
+
+void VulkanAppBase::initializeInstance(const char* appName)
+{
+  vector<const char*> extensions;
+  VkApplicationInfo appInfo{};
+  appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+  appInfo.pApplicationName = appName;
+  appInfo.pEngineName = appName;
+  appInfo.apiVersion = VK_API_VERSION_1_1;
+  appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+
+  // 拡張情報の取得.
+  vector<VkExtensionProperties> props;
+  {
+    uint32_t count = 0;
+    vkEnumerateInstanceExtensionProperties(nullptr, &count, nullptr);
+    props.resize(count);
+    vkEnumerateInstanceExtensionProperties(nullptr, &count, props.data());
+
+    for (const auto& v : props)
+    {
+      extensions.push_back(v.extensionName);
+    }
+  }
+
+  VkInstanceCreateInfo ci{};
+  ci.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO; 
+  ci.enabledExtensionCount = uint32_t(extensions.size());
+  ci.ppEnabledExtensionNames = extensions.data();
+  ci.pApplicationInfo = &appInfo;
+#ifdef _DEBUG 
+  // デバッグビルド時には検証レイヤーを有効化
+  const char* layers[] = { "VK_LAYER_KHRONOS_validation" };
+  if (VK_HEADER_VERSION_COMPLETE < VK_MAKE_VERSION(1, 1, 106)) {
+	  // "VK_LAYER_LUNARG_standard_validation" は廃止になっているが昔の Vulkan SDK では動くので対処しておく.
+	  layers[0] = "VK_LAYER_LUNARG_standard_validation";
+  }
+  ci.enabledLayerCount = 1;
+  ci.ppEnabledLayerNames = layers;
+#endif
+
+  // インスタンス生成
+  auto result = vkCreateInstance(&ci, nullptr, &m_instance);
+  checkResult(result);
+}
+
+void VulkanAppBase::selectPhysicalDevice()
+{
+  uint32_t devCount = 0;
+  vkEnumeratePhysicalDevices(m_instance, &devCount, nullptr);
+  vector<VkPhysicalDevice> physDevs(devCount);
+  vkEnumeratePhysicalDevices(m_instance, &devCount, physDevs.data());
+
+  // 最初のデバイスを使用する
+  m_physDev = physDevs[0];
+  // メモリプロパティを取得しておく
+  vkGetPhysicalDeviceMemoryProperties(m_physDev, &m_physMemProps);
+}
+
+uint32_t VulkanAppBase::searchGraphicsQueueIndex()
+{
+  uint32_t propCount;
+  vkGetPhysicalDeviceQueueFamilyProperties(m_physDev, &propCount, nullptr);
+  vector<VkQueueFamilyProperties> props(propCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(m_physDev, &propCount, props.data());
+
+  uint32_t graphicsQueue = ~0u;
+  for (uint32_t i = 0; i < propCount; ++i)
+  {
+    if (props[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+    {
+      graphicsQueue = i; break;
+    }
+  }
+  return graphicsQueue;
+}
+void VulkanAppBase::createDevice()
+{
+  const float defaultQueuePriority(1.0f);
+  VkDeviceQueueCreateInfo devQueueCI{};
+  devQueueCI.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+  devQueueCI.queueFamilyIndex = m_graphicsQueueIndex;
+  devQueueCI.queueCount = 1;
+  devQueueCI.pQueuePriorities = &defaultQueuePriority;
+
+
+  vector<VkExtensionProperties> devExtProps;
+  {
+    // 拡張情報の取得.
+    uint32_t count = 0;
+    vkEnumerateDeviceExtensionProperties(m_physDev, nullptr, &count, nullptr);
+    devExtProps.resize(count);
+    vkEnumerateDeviceExtensionProperties(m_physDev, nullptr, &count, devExtProps.data());
+  }
+
+  vector<const char*> extensions;
+  bool drawIndirectCountSupported = false;
+  bool conditionalRenderingSupported = false;
+  for (const auto& v : devExtProps)
+  {
+    extensions.push_back(v.extensionName);
+    if (strcmp(v.extensionName, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME) == 0)
+    {
+      drawIndirectCountSupported = true;
+    }
+    if (strcmp(v.extensionName, VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME) == 0)
+    {
+      conditionalRenderingSupported = true;
+    }
+    if (strcmp(v.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+    {
+      m_memoryBudgetSupported = true;
+    }
+    if (strcmp(v.extensionName, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME) == 0)
+    {
+      m_externalMemoryHostSupported = true;
+    }
+#ifdef VK_EXT_host_image_copy
+    if (strcmp(v.extensionName, VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME) == 0)
+    {
+      m_hostImageCopySupported = m_preferHostImageCopy;
+    }
+#endif
+  }
+  VkDeviceCreateInfo ci{};
+  ci.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+#ifdef VK_EXT_host_image_copy
+  // 拡張があっても機能が有効でなければ使えない.
+  VkPhysicalDeviceHostImageCopyFeaturesEXT hostImageCopyFeatures{};
+  hostImageCopyFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_FEATURES_EXT;
+  if (m_hostImageCopySupported)
+  {
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &hostImageCopyFeatures;
+    vkGetPhysicalDeviceFeatures2(m_physDev, &features);
+    m_hostImageCopySupported = hostImageCopyFeatures.hostImageCopy == VK_TRUE;
+    hostImageCopyFeatures.pNext = nullptr;
+    if (m_hostImageCopySupported)
+    {
+      ci.pNext = &hostImageCopyFeatures;
+    }
+  }
+#endif
+  VkPhysicalDeviceConditionalRenderingFeaturesEXT conditionalRenderingFeatures{};
+  conditionalRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_CONDITIONAL_RENDERING_FEATURES_EXT;
+  if (conditionalRenderingSupported)
+  {
+    VkPhysicalDeviceFeatures2 features{};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &conditionalRenderingFeatures;
+    vkGetPhysicalDeviceFeatures2(m_physDev, &features);
+    conditionalRenderingSupported = conditionalRenderingFeatures.conditionalRendering == VK_TRUE;
+    if (conditionalRenderingSupported)
+    {
+      conditionalRenderingFeatures.inheritedConditionalRendering = VK_FALSE;
+      conditionalRenderingFeatures.pNext = const_cast<void*>(ci.pNext);
+      ci.pNext = &conditionalRenderingFeatures;
+    }
+  }
+  // 間接描画で使う機能
+  VkPhysicalDeviceFeatures supportedFeatures{};
+  vkGetPhysicalDeviceFeatures(m_physDev, &supportedFeatures);
+  m_enabledFeatures = VkPhysicalDeviceFeatures{};
+  m_enabledFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+  m_enabledFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+  ci.pEnabledFeatures = &m_enabledFeatures;
+  ci.pQueueCreateInfos = &devQueueCI;
+  ci.queueCreateInfoCount = 1;
+  ci.ppEnabledExtensionNames = extensions.data();
+  ci.enabledExtensionCount = uint32_t(extensions.size());
+
+  auto result = vkCreateDevice(m_physDev, &ci, nullptr, &m_device);
+  checkResult(result);
+
+  // デバイスキューの取得
+  vkGetDeviceQueue(m_device, m_graphicsQueueIndex, 0, &m_deviceQueue);
+
+  if (drawIndirectCountSupported)
+  {
+    m_vkCmdDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+      vkGetDeviceProcAddr(m_device, "vkCmdDrawIndexedIndirectCountKHR"));
+  }
+  if (conditionalRenderingSupported)
+  {
+    m_vkCmdBeginConditionalRendering = reinterpret_cast<PFN_vkCmdBeginConditionalRenderingEXT>(
+      vkGetDeviceProcAddr(m_device, "vkCmdBeginConditionalRenderingEXT"));
+    m_vkCmdEndConditionalRendering = reinterpret_cast<PFN_vkCmdEndConditionalRenderingEXT>(
+      vkGetDeviceProcAddr(m_device, "vkCmdEndConditionalRenderingEXT"));
+  }
+
+  if (m_externalMemoryHostSupported)
+  {
+    VkPhysicalDeviceExternalMemoryHostPropertiesEXT hostProps{};
+    hostProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+    VkPhysicalDeviceProperties2 props{};
+    props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    props.pNext = &hostProps;
+    vkGetPhysicalDeviceProperties2(m_physDev, &props);
+    m_hostPointerAlignment = hostProps.minImportedHostPointerAlignment;
+    m_vkGetMemoryHostPointerPropertiesEXT = reinterpret_cast<PFN_vkGetMemoryHostPointerPropertiesEXT>(
+      vkGetDeviceProcAddr(m_device, "vkGetMemoryHostPointerPropertiesEXT"));
+    m_externalMemoryHostSupported = m_vkGetMemoryHostPointerPropertiesEXT != nullptr;
+  }
+#ifdef VK_EXT_host_image_copy
+  if (m_hostImageCopySupported)
+  {
+    // 転送先レイアウトに SHADER_READ_ONLY_OPTIMAL が使えれば, 遷移は 1 回で済む.
+    VkPhysicalDeviceHostImageCopyPropertiesEXT copyProps{};
+    copyProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_PROPERTIES_EXT;
+    VkPhysicalDeviceProperties2 props{};
+    props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    props.pNext = &copyProps;
+    vkGetPhysicalDeviceProperties2(m_physDev, &props);
+    vector<VkImageLayout> dstLayouts(copyProps.copyDstLayoutCount);
+    copyProps.pCopyDstLayouts = dstLayouts.data();
+    vkGetPhysicalDeviceProperties2(m_physDev, &props);
+    m_hostCopyToShaderReadOnly = find(dstLayouts.begin(), dstLayouts.end(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) != dstLayouts.end();
+
+    m_vkCopyMemoryToImageEXT = reinterpret_cast<PFN_vkCopyMemoryToImageEXT>(vkGetDeviceProcAddr(m_device, "vkCopyMemoryToImageEXT"));
+    m_vkTransitionImageLayoutEXT = reinterpret_cast<PFN_vkTransitionImageLayoutEXT>(vkGetDeviceProcAddr(m_device, "vkTransitionImageLayoutEXT"));
+    m_hostImageCopySupported = m_vkCopyMemoryToImageEXT != nullptr && m_vkTransitionImageLayoutEXT != nullptr;
+  }
+#endif
+}
+
+void VulkanAppBase::prepareCommandPool()
+{
+  VkCommandPoolCreateInfo ci{};
+  ci.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  ci.queueFamilyIndex = m_graphicsQueueIndex;
+  ci.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  auto result = vkCreateCommandPool(m_device, &ci, nullptr, &m_commandPool);
+  checkResult(result);
+}
+
+void VulkanAppBase::selectSurfaceFormat(VkFormat format)
+{
+  uint32_t surfaceFormatCount = 0;
+  vkGetPhysicalDeviceSurfaceFormatsKHR(m_physDev, m_surface, &surfaceFormatCount, nullptr);
+  std::vector<VkSurfaceFormatKHR> formats(surfaceFormatCount);
+  vkGetPhysicalDeviceSurfaceFormatsKHR(m_physDev, m_surface, &surfaceFormatCount, formats.data());
+
+  // 検索して一致するフォーマットを見つける.
+  for (const auto& f : formats)
+  {
+    if (f.format == format)
+    {
+      m_surfaceFormat = f;
+    }
+  }
+}
+
+void VulkanAppBase::createSwapchain(GLFWwindow* window)
+{
+  auto imageCount = (std::max)(2u, m_surfaceCaps.minImageCount);
+  auto extent = m_surfaceCaps.currentExtent;
+  if (extent.width == ~0u)
+  {
+    // 値が無効なのでウィンドウサイズを使用する.
+    int width, height;
+    glfwGetWindowSize(window, &width, &height);
+    extent.width = uint32_t(width);
+    extent.height = uint32_t(height);
+  }
+  uint32_t queueFamilyIndices[] = { m_graphicsQueueIndex };
+  VkSwapchainCreateInfoKHR ci{};
+  ci.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+  ci.surface = m_surface;
+  ci.minImageCount = imageCount;
+  ci.imageFormat = m_surfaceFormat.format;
+  ci.imageColorSpace = m_surfaceFormat.colorSpace;
+  ci.imageExtent = extent;
+  ci.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  ci.preTransform = m_surfaceCaps.currentTransform;
+  ci.imageArrayLayers = 1;
+  ci.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  ci.queueFamilyIndexCount = 0;
+  ci.presentMode = m_presentMode;
+  ci.oldSwapchain = VK_NULL_HANDLE;
+  ci.clipped = VK_TRUE;
+  ci.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+
+  auto result = vkCreateSwapchainKHR(m_device, &ci, nullptr, &m_swapchain);
+  checkResult(result);
+  m_swapchainExtent = extent;
+}
+void VulkanAppBase::selectDepthFormat()
+{
+  // 候補の中からデプスアタッチメントとして使える最初のフォーマットを選ぶ.
+  // シェーダーから読む場合はサンプリングできることも条件とする.
+  VkFormatFeatureFlags required = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT;
+  if (m_depthSampled)
+  {
+    required |= VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+  }
+  m_depthFormat = VK_FORMAT_UNDEFINED;
+  for (auto format : m_depthFormatCandidates)
+  {
+    VkFormatProperties props;
+    vkGetPhysicalDeviceFormatProperties(m_physDev, format, &props);
+    if ((props.optimalTilingFeatures & required) == required)
+    {
+      m_depthFormat = format;
+      break;
+    }
+  }
+  if (m_depthFormat == VK_FORMAT_UNDEFINED)
+  {
+    OutputDebugStringA("No supported depth format found.\n");
+    checkResult(VK_ERROR_FORMAT_NOT_SUPPORTED);
+  }
+}
+
+VkImageAspectFlags VulkanAppBase::getDepthAspect() const
+{
+  switch (m_depthFormat)
+  {
+  case VK_FORMAT_D16_UNORM_S8_UINT:
+  case VK_FORMAT_D24_UNORM_S8_UINT:
+  case VK_FORMAT_D32_SFLOAT_S8_UINT:
+    return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+  default:
+    return VK_IMAGE_ASPECT_DEPTH_BIT;
+  }
+}
+
+VkCompareOp VulkanAppBase::getDepthCompareOp() const
+{
+  return m_reversedZ ? VK_COMPARE_OP_GREATER_OR_EQUAL : VK_COMPARE_OP_LESS_OR_EQUAL;
+}
+
+void VulkanAppBase::getClearValues(VkClearValue values[2]) const
+{
+  values[0].color = { 0.5f, 0.25f, 0.25f, 0.0f };
+  // 逆Z では奥が 0 になる.
+  values[1].depthStencil = { m_reversedZ ? 0.0f : 1.0f, 0 };
+}
+
+void VulkanAppBase::createDepthBuffer()
+{
+  VkImageCreateInfo ci{};
+  ci.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  ci.imageType = VK_IMAGE_TYPE_2D;
+  ci.format = m_depthFormat;
+  ci.extent.width = m_swapchainExtent.width;
+  ci.extent.height = m_swapchainExtent.height;
+  ci.extent.depth = 1;
+  ci.mipLevels = 1;
+  ci.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+  if (m_depthSampled)
+  {
+    ci.usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+  }
+  ci.samples = VK_SAMPLE_COUNT_1_BIT;
+  ci.arrayLayers = 1;
+  auto memoryUsage = MemoryUsage::GpuOnly;
+  if (isDepthBufferTransient())
+  {
+    // 内容をパスの外へ持ち出さないので一時アタッチメントとして作成する.
+    ci.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    memoryUsage = MemoryUsage::Transient;
+  }
+  auto result = vkCreateImage(m_device, &ci, nullptr, &m_depthBuffer);
+  checkResult(result);
+
+  VkMemoryRequirements reqs;
+  vkGetImageMemoryRequirements(m_device, m_depthBuffer, &reqs);
+  result = allocateMemory(reqs, memoryUsage, MemoryCategory::DepthBuffer, &m_depthBufferMemory);
+  checkResult(result);
+  vkBindImageMemory(m_device, m_depthBuffer, m_depthBufferMemory, 0);
+}
+
+bool VulkanAppBase::isDepthBufferTransient() const
+{
+  // 前の内容を読まず, 結果も保存せず, シェーダーからも読まない場合のみ一時アタッチメントにできる.
+  return !m_depthSampled
+    && m_depthOps.loadOp != VK_ATTACHMENT_LOAD_OP_LOAD
+    && m_depthOps.storeOp == VK_ATTACHMENT_STORE_OP_DONT_CARE
+    && m_depthOps.stencilLoadOp != VK_ATTACHMENT_LOAD_OP_LOAD
+    && m_depthOps.stencilStoreOp == VK_ATTACHMENT_STORE_OP_DONT_CARE;
+}
+
+void VulkanAppBase::createViews()
+{
+  uint32_t imageCount;
+  vkGetSwapchainImagesKHR(m_device, m_swapchain, &imageCount, nullptr);
+  m_swapchainImages.resize(imageCount);
+  vkGetSwapchainImagesKHR(m_device, m_swapchain, &imageCount, m_swapchainImages.data());
+  m_swapchainViews.resize(imageCount);
+  for (uint32_t i = 0; i < imageCount; ++i)
+  {
+    VkImageViewCreateInfo ci{};
+    ci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    ci.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    ci.format = m_surfaceFormat.format;
+    ci.components = { 
+      VK_COMPONENT_SWIZZLE_R,
+      VK_COMPONENT_SWIZZLE_G,
+      VK_COMPONENT_SWIZZLE_B,
+      VK_COMPONENT_SWIZZLE_A,
+    };
+    ci.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+    ci.image = m_swapchainImages[i];
+    auto result = vkCreateImageView(m_device, &ci, nullptr, &m_swapchainViews[i]);
+    checkResult(result);
+  }
+
+  // for depthbuffer
+  {
+    VkImageViewCreateInfo ci{};
+    ci.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    ci.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    ci.format = m_depthFormat;
+    ci.components = {
+      VK_COMPONENT_SWIZZLE_R,
+      VK_COMPONENT_SWIZZLE_G,
+      VK_COMPONENT_SWIZZLE_B,
+      VK_COMPONENT_SWIZZLE_A,
+    };
+    ci.subresourceRange = { getDepthAspect(), 0, 1, 0, 1 };
+    ci.image = m_depthBuffer;
+    auto result = vkCreateImageView(m_device, &ci, nullptr, &m_depthBufferView);
+    checkResult(result);
+
+    if (m_depthSampled)
+    {
+      // サンプリングするビューはデプスのアスペクトのみとする.
+      ci.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+      result = vkCreateImageView(m_device, &ci, nullptr, &m_depthSampledView);
+      checkResult(result);
+    }
+  }
+}
+
+void VulkanAppBase::createRenderPass()
+{
+  VkRenderPassCreateInfo ci{};
+  ci.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+
+  array<VkAttachmentDescription, 2> attachments;
+  auto& colorTarget = attachments[0];
+  auto& depthTarget = attachments[1];
+
+  colorTarget = VkAttachmentDescription{};
+  colorTarget.format = m_surfaceFormat.format;
+  colorTarget.samples = VK_SAMPLE_COUNT_1_BIT;
+  colorTarget.loadOp = m_colorOps.loadOp;
+  colorTarget.storeOp = m_colorOps.storeOp;
+  colorTarget.stencilLoadOp = m_colorOps.stencilLoadOp;
+  colorTarget.stencilStoreOp = m_colorOps.stencilStoreOp;
+  // 前の内容を読む場合は, 同じフレームの前のパスの最終レイアウトから開始する.
+  colorTarget.initialLayout = m_colorOps.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR : VK_IMAGE_LAYOUT_UNDEFINED;
+  colorTarget.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+  depthTarget = VkAttachmentDescription{};
+  depthTarget.format = m_depthFormat;
+  depthTarget.samples = VK_SAMPLE_COUNT_1_BIT;
+  depthTarget.loadOp = m_depthOps.loadOp;
+  depthTarget.storeOp = m_depthOps.storeOp;
+  depthTarget.stencilLoadOp = m_depthOps.stencilLoadOp;
+  depthTarget.stencilStoreOp = m_depthOps.stencilStoreOp;
+  depthTarget.initialLayout = m_depthOps.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+  depthTarget.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+  VkAttachmentReference colorReference{}, depthReference{};
+  colorReference.attachment = 0;
+  colorReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+  depthReference.attachment = 1;
+  depthReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+  VkSubpassDescription subpassDesc{};
+  subpassDesc.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpassDesc.colorAttachmentCount = 1;
+  subpassDesc.pColorAttachments = &colorReference;
+  subpassDesc.pDepthStencilAttachment = &depthReference;
+
+  ci.attachmentCount = uint32_t(attachments.size());
+  ci.pAttachments = attachments.data();
+  ci.subpassCount = 1;
+  ci.pSubpasses = &subpassDesc;
+
+  auto result = vkCreateRenderPass(m_device, &ci, nullptr, &m_renderPass);
+  checkResult(result);
+}
+
+void VulkanAppBase::prepareAttachmentLayouts()
+{
+  // 作成直後のデプスバッファは UNDEFINED のため, LOAD で始まるレンダーパスの開始レイアウトと一致しない.
+  // 最初のフレームより前に一度だけ移しておく (内容は不定のまま).
+  // スワップチェインのイメージは取得前に遷移できないため対象外. カラーを LOAD する場合は,
+  // 同じフレームの前のパスで PRESENT_SRC_KHR へ移しておくこと.
+  if (m_depthOps.loadOp != VK_ATTACHMENT_LOAD_OP_LOAD)
+  {
+    return;
+  }
+  VkImageMemoryBarrier imb{};
+  imb.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  imb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imb.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imb.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  imb.subresourceRange = { getDepthAspect(), 0, 1, 0, 1 };
+  imb.image = m_depthBuffer;
+
+  // 描画と同じキューへ先に送信するため, 完了を待つ必要はない.
+  auto command = beginUploadCommand();
+  vkCmdPipelineBarrier(command,
+    VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+    0, 0, nullptr, 0, nullptr,
+    1, &imb);
+  submitUploadCommand();
+}
+
+void VulkanAppBase::createFramebuffer()
+{
+  VkFramebufferCreateInfo ci{};
+  ci.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+  ci.renderPass = m_renderPass;
+  ci.width = m_swapchainExtent.width;
+  ci.height = m_swapchainExtent.height;
+  ci.layers = 1;
+  m_framebuffers.clear();
+  for (auto& v : m_swapchainViews)
+  {
+    array<VkImageView, 2> attachments;
+    ci.attachmentCount = uint32_t(attachments.size());
+    ci.pAttachments = attachments.data();
+    attachments[0] = v;
+    attachments[1] = m_depthBufferView;
+
+    VkFramebuffer framebuffer;
+    auto result = vkCreateFramebuffer(m_device, &ci, nullptr, &framebuffer);
+    checkResult(result);
+    m_framebuffers.push_back(framebuffer);
+  }
+}
+void VulkanAppBase::prepareCommandBuffers()
+{
+  VkCommandBufferAllocateInfo ai{};
+  ai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  ai.commandPool = m_commandPool;
+  ai.commandBufferCount = uint32_t(m_swapchainViews.size());
+  ai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  m_commands.resize(ai.commandBufferCount);
+  auto result = vkAllocateCommandBuffers(m_device, &ai, m_commands.data());
+  checkResult(result);
+
+  // コマンドバッファのフェンスも同数用意する.
+  m_fences.resize(ai.commandBufferCount);
+  m_fenceFrames.assign(ai.commandBufferCount, 0);
+  VkFenceCreateInfo ci{};
+  ci.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  ci.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+  for (auto& v : m_fences)
+  {
+    result = vkCreateFence(m_device, &ci, nullptr, &v);
+    checkResult(result);
+  }
+}
+
+void VulkanAppBase::prepareSemaphores()
+{
+  VkSemaphoreCreateInfo ci{};
+  ci.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  vkCreateSemaphore(m_device, &ci, nullptr, &m_renderCompletedSem);
+  vkCreateSemaphore(m_device, &ci, nullptr, &m_presentCompletedSem);
+}
+
+void VulkanAppBase::prepareTimestampQueries()
+{
+  // グラフィックスキューがタイムスタンプに対応している場合のみ計測する.
+  uint32_t propCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(m_physDev, &propCount, nullptr);
+  vector<VkQueueFamilyProperties> props(propCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(m_physDev, &propCount, props.data());
+  auto validBits = props[m_graphicsQueueIndex].timestampValidBits;
+  if (validBits == 0)
+  {
+    return;
+  }
+  m_timestampMask = validBits >= 64 ? ~0ull : ((1ull << validBits) - 1);
+  VkPhysicalDeviceProperties physProps;
+  vkGetPhysicalDeviceProperties(m_physDev, &physProps);
+  m_timestampPeriod = physProps.limits.timestampPeriod;
+
+  // スワップチェイン画像ごとに開始/終了の 2 つ
+  VkQueryPoolCreateInfo ci{};
+  ci.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  ci.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  ci.queryCount = uint32_t(m_commands.size()) * 2;
+  auto result = vkCreateQueryPool(m_device, &ci, nullptr, &m_timestampPool);
+  checkResult(result);
+  m_timestampWritten.assign(m_commands.size(), 0);
+}
+
+
+uint32_t VulkanAppBase::getMemoryTypeIndex(uint32_t requestBits, VkMemoryPropertyFlags requestProps)const
+{
+  uint32_t result = ~0u;
+  for (uint32_t i = 0; i < m_physMemProps.memoryTypeCount; ++i)
+  {
+    if (requestBits & 1)
+    {
+      const auto& types = m_physMemProps.memoryTypes[i];
+      if ((types.propertyFlags & requestProps) == requestProps)
+      {
+        result = i;
+        break;
+      }
+    }
+    requestBits >>= 1;
+  }
+  return result;
+}
+
+uint32_t VulkanAppBase::getMemoryTypeIndex(uint32_t requestBits, MemoryUsage usage, VkDeviceSize size)
+{
+  updateMemoryBudget();
+  auto candidates = getMemoryTypeCandidates(requestBits, usage, size);
+  return candidates.empty() ? ~0u : candidates.front();
+}
+
+std::vector<uint32_t> VulkanAppBase::getMemoryTypeCandidates(uint32_t requestBits, MemoryUsage usage, VkDeviceSize size)
+{
+  VkMemoryPropertyFlags required, preferred, avoided;
+  GetMemoryUsageFlags(usage, required, preferred, avoided);
+
+  vector<uint32_t> candidates;
+  vector<int> scores(m_physMemProps.memoryTypeCount);
+  for (uint32_t i = 0; i < m_physMemProps.memoryTypeCount; ++i)
+  {
+    if ((requestBits & (1u << i)) == 0)
+    {
+      continue;
+    }
+    const auto flags = m_physMemProps.memoryTypes[i].propertyFlags;
+    if ((flags & required) != required)
+    {
+      continue;
+    }
+    // 望ましいフラグは加点, 避けたいフラグは減点する.
+    scores[i] = CountBits(flags & preferred) - CountBits(flags & avoided);
+    candidates.push_back(i);
+  }
+  stable_sort(candidates.begin(), candidates.end(),
+    [&](uint32_t a, uint32_t b) { return scores[a] > scores[b]; });
+
+  // ヒープの予算を超えてしまう候補は後ろへ回す (他に無ければそれでも試す).
+  stable_partition(candidates.begin(), candidates.end(),
+    [&](uint32_t index) {
+      auto heapIndex = m_physMemProps.memoryTypes[index].heapIndex;
+      return m_heapUsage[heapIndex] + size <= m_heapBudget[heapIndex];
+    });
+  return candidates;
+}
+
+VkResult VulkanAppBase::allocateMemory(const VkMemoryRequirements& reqs, MemoryUsage usage, MemoryCategory category, VkDeviceMemory* memory, const void* pNext)
+{
+  updateMemoryBudget();
+  auto candidates = getMemoryTypeCandidates(reqs.memoryTypeBits, usage, reqs.size);
+
+  VkMemoryAllocateInfo ai{};
+  ai.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  ai.pNext = pNext;
+  ai.allocationSize = reqs.size;
+  VkResult result = VK_ERROR_OUT_OF_DEVICE_MEMORY;
+  for (auto index : candidates)
+  {
+    ai.memoryTypeIndex = index;
+    result = vkAllocateMemory(m_device, &ai, nullptr, memory);
+    if (result == VK_SUCCESS)
+    {
+      break;
+    }
+    // ヒープが一杯の場合には次の候補で再試行する.
+    OutputDebugStringA("allocateMemory: memory heap is full, try next memory type.\n");
+  }
+  if (result != VK_SUCCESS)
+  {
+    return result;
+  }
+
+  // 使用量の集計
+  MemoryAllocation allocation{};
+  allocation.size = reqs.size;
+  allocation.heapIndex = m_physMemProps.memoryTypes[ai.memoryTypeIndex].heapIndex;
+  allocation.category = category;
+  m_memoryAllocations[*memory] = allocation;
+
+  for (auto* counter : { &m_categoryCounters[size_t(category)], &m_heapCounters[allocation.heapIndex] })
+  {
+    counter->live += allocation.size;
+    counter->peak = (std::max)(counter->peak, counter->live);
+    counter->count++;
+  }
+  return result;
+}
+
+void VulkanAppBase::freeMemory(VkDeviceMemory memory)
+{
+  if (memory == VK_NULL_HANDLE)
+  {
+    return;
+  }
+  auto itr = m_memoryAllocations.find(memory);
+  if (itr != m_memoryAllocations.end())
+  {
+    const auto& allocation = itr->second;
+    for (auto* counter : { &m_categoryCounters[size_t(allocation.category)], &m_heapCounters[allocation.heapIndex] })
+    {
+      counter->live -= allocation.size;
+      counter->count--;
+    }
+    m_memoryAllocations.erase(itr);
+  }
+  vkFreeMemory(m_device, memory, nullptr);
+}
+
+void VulkanAppBase::reportMemoryUsage() const
+{
+  std::stringstream ss;
+  ss << "---- Device memory usage (KiB) ----" << std::endl;
+  for (size_t i = 0; i < size_t(MemoryCategory::Count); ++i)
+  {
+    const auto& counter = m_categoryCounters[i];
+    ss << GetMemoryCategoryName(MemoryCategory(i))
+      << ": live=" << counter.live / 1024
+      << " peak=" << counter.peak / 1024
+      << " count=" << counter.count << std::endl;
+  }
+  for (uint32_t i = 0; i < m_physMemProps.memoryHeapCount; ++i)
+  {
+    const auto& counter = m_heapCounters[i];
+    ss << "Heap" << i
+      << ((m_physMemProps.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? "(DeviceLocal)" : "(Host)")
+      << ": live=" << counter.live / 1024
+      << " peak=" << counter.peak / 1024
+      << " size=" << m_physMemProps.memoryHeaps[i].size / 1024 << std::endl;
+  }
+  OutputDebugStringA(ss.str().c_str());
+}
+
+void VulkanAppBase::reportTextureUpload() const
+{
+  // どちらの方式でも同じ項目を出力し, 1 回ずつの実行で比較できるようにする.
+  const auto& staging = m_categoryCounters[size_t(MemoryCategory::Staging)];
+  const auto& texture = m_categoryCounters[size_t(MemoryCategory::Texture)];
+  std::stringstream ss;
+  ss << "  texture upload: " << (useHostImageCopy(VK_FORMAT_R8G8B8A8_UNORM) ? "host image copy" : "staging")
+    << ", staging ring peak: " << m_stagingPeakUsage << " bytes"
+    << ", staging memory peak: " << staging.peak / 1024 << " KiB"
+    << ", texture memory: " << texture.live / 1024 << " KiB" << std::endl;
+  OutputDebugStringA(ss.str().c_str());
+}
+
+void VulkanAppBase::reportMemoryLeaks() const
+{
+  if (m_memoryAllocations.empty())
+  {
+    return;
+  }
+  std::stringstream ss;
+  ss << "---- Device memory leaks: " << m_memoryAllocations.size() << " allocation(s) ----" << std::endl;
+  for (const auto& v : m_memoryAllocations)
+  {
+    ss << "  " << GetMemoryCategoryName(v.second.category)
+      << ": " << v.second.size << " bytes (heap " << v.second.heapIndex << ")" << std::endl;
+  }
+  OutputDebugStringA(ss.str().c_str());
+}
+
+void VulkanAppBase::updateMemoryBudget()
+{
+  for (uint32_t i = 0; i < m_physMemProps.memoryHeapCount; ++i)
+  {
+    // 拡張が使えない場合にはヒープサイズを予算とし, 自前の集計値を使用量とみなす.
+    m_heapBudget[i] = m_physMemProps.memoryHeaps[i].size;
+    m_heapUsage[i] = m_heapCounters[i].live;
+  }
+  if (!m_memoryBudgetSupported)
+  {
+    return;
+  }
+
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProps{};
+  budgetProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+  VkPhysicalDeviceMemoryProperties2 memProps2{};
+  memProps2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+  memProps2.pNext = &budgetProps;
+  vkGetPhysicalDeviceMemoryProperties2(m_physDev, &memProps2);
+  for (uint32_t i = 0; i < m_physMemProps.memoryHeapCount; ++i)
+  {
+    m_heapBudget[i] = budgetProps.heapBudget[i];
+    m_heapUsage[i] = budgetProps.heapUsage[i];
+  }
+}
+
+
+static VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+void VulkanAppBase::prepareStagingBuffer()
+{
+  VkBufferCreateInfo ci{};
+  ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  ci.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  ci.size = m_stagingBufferSize;
+  auto result = vkCreateBuffer(m_device, &ci, nullptr, &m_stagingBuffer);
+  checkResult(result);
+
+  VkMemoryRequirements reqs;
+  vkGetBufferMemoryRequirements(m_device, m_stagingBuffer, &reqs);
+  result = allocateMemory(reqs, MemoryUsage::Upload, MemoryCategory::Staging, &m_stagingMemory);
+  checkResult(result);
+  vkBindBufferMemory(m_device, m_stagingBuffer, m_stagingMemory, 0);
+
+  // 使い終わるまでマップしたままにしておく.
+  void* p;
+  vkMapMemory(m_device, m_stagingMemory, 0, VK_WHOLE_SIZE, 0, &p);
+  m_stagingMapped = static_cast<uint8_t*>(p);
+  m_stagingHead = m_stagingTail = 0;
+}
+
+void VulkanAppBase::destroyStagingBuffer()
+{
+  recordPendingUploads();
+  submitUploadCommand();
+  while (!m_uploadSubmissions.empty())
+  {
+    reclaimStagingBuffer(true);
+  }
+  vkUnmapMemory(m_device, m_stagingMemory);
+  vkDestroyBuffer(m_device, m_stagingBuffer, nullptr);
+  freeMemory(m_stagingMemory);
+  m_stagingMapped = nullptr;
+}
+
+bool VulkanAppBase::allocateStagingBuffer(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset)
+{
+  if (size > m_stagingBufferSize)
+  {
+    return false;
+  }
+  for (;;)
+  {
+    reclaimStagingBuffer(false);
+
+    auto head = AlignUp(m_stagingHead, alignment);
+    auto pos = head % m_stagingBufferSize;
+    if (pos + size > m_stagingBufferSize)
+    {
+      // 末尾に収まらないので先頭から使う.
+      head += m_stagingBufferSize - pos;
+      pos = 0;
+    }
+    if (head + size - m_stagingTail <= m_stagingBufferSize)
+    {
+      m_stagingHead = head + size;
+      m_stagingPeakUsage = (std::max)(m_stagingPeakUsage, m_stagingHead - m_stagingTail);
+      *offset = pos;
+      return true;
+    }
+
+    // 空きが無いので溜めている転送を送信し, 古いものから完了を待つ.
+    recordPendingUploads();
+    submitUploadCommand();
+    if (m_uploadSubmissions.empty())
+    {
+      m_stagingTail = m_stagingHead;
+      continue;
+    }
+    reclaimStagingBuffer(true);
+  }
+}
+
+void VulkanAppBase::reclaimStagingBuffer(bool waitOldest)
+{
+  while (!m_uploadSubmissions.empty())
+  {
+    auto& submission = m_uploadSubmissions.front();
+    if (waitOldest)
+    {
+      vkWaitForFences(m_device, 1, &submission.fence, VK_TRUE, UINT64_MAX);
+      waitOldest = false;
+    }
+    if (vkGetFenceStatus(m_device, submission.fence) != VK_SUCCESS)
+    {
+      break;
+    }
+    // GPU での使用が完了した領域を解放.
+    m_stagingTail = submission.stagingEnd;
+    m_completedUploadSerial = submission.serial;
+    vkDestroyFence(m_device, submission.fence, nullptr);
+    vkFreeCommandBuffers(m_device, m_commandPool, 1, &submission.command);
+    m_uploadSubmissions.pop_front();
+  }
+}
+
+VkCommandBuffer VulkanAppBase::beginUploadCommand()
+{
+  if (m_uploadCommand == VK_NULL_HANDLE)
+  {
+    VkCommandBufferAllocateInfo ai{};
+    ai.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    ai.commandBufferCount = 1;
+    ai.commandPool = m_commandPool;
+    ai.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    vkAllocateCommandBuffers(m_device, &ai, &m_uploadCommand);
+
+    VkCommandBufferBeginInfo commandBI{};
+    commandBI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    commandBI.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(m_uploadCommand, &commandBI);
+  }
+  return m_uploadCommand;
+}
+
+void VulkanAppBase::submitUploadCommand()
+{
+  if (m_uploadCommand == VK_NULL_HANDLE)
+  {
+    return;
+  }
+  vkEndCommandBuffer(m_uploadCommand);
+
+  UploadSubmission submission{};
+  VkFenceCreateInfo fenceCI{};
+  fenceCI.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  vkCreateFence(m_device, &fenceCI, nullptr, &submission.fence);
+  submission.command = m_uploadCommand;
+  submission.stagingEnd = m_stagingHead;
+  submission.serial = ++m_uploadSerial;
+
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &submission.command;
+  auto result = vkQueueSubmit(m_deviceQueue, 1, &submitInfo, submission.fence);
+  checkResult(result);
+
+  m_uploadSubmissions.push_back(submission);
+  m_uploadCommand = VK_NULL_HANDLE;
+}
+
+void VulkanAppBase::beginUploadBatch()
+{
+  m_uploadBatchDepth++;
+}
+
+VulkanAppBase::UploadTicket VulkanAppBase::endUploadBatch()
+{
+  if (m_uploadBatchDepth > 0 && --m_uploadBatchDepth == 0)
+  {
+    // 溜めておいた転送をまとめて記録し, 1 回で送信する.
+    recordPendingUploads();
+    submitUploadCommand();
+
+    // バッチ中に登録された遅延破棄を最後の送信に結び付ける.
+    // 何も送信しなかった場合は現在のシリアル (完了済みの転送) になる.
+    for (auto it = m_deferredDestroys.rbegin(); it != m_deferredDestroys.rend(); ++it)
+    {
+      if (it->uploadSerial != PendingUploadSerial)
+      {
+        break;
+      }
+      it->uploadSerial = m_uploadSerial;
+    }
+  }
+  return m_uploadSerial;
+}
+
+bool VulkanAppBase::isUploadCompleted(UploadTicket ticket)
+{
+  reclaimStagingBuffer(false);
+  return m_completedUploadSerial >= ticket;
+}
+
+void VulkanAppBase::waitUpload(UploadTicket ticket)
+{
+  reclaimStagingBuffer(false);
+  while (m_completedUploadSerial < ticket && !m_uploadSubmissions.empty())
+  {
+    reclaimStagingBuffer(true);
+  }
+}
+
+void VulkanAppBase::recordPendingUploads()
+{
+  auto& pending = m_pendingUploads;
+  if (pending.preBarriers.empty() && pending.bufferCopies.empty() && pending.imageCopies.empty() && pending.postBarriers.empty())
+  {
+    return;
+  }
+  auto command = beginUploadCommand();
+
+  // 転送先イメージのレイアウト変更はまとめて 1 回で行う.
+  if (!pending.preBarriers.empty())
+  {
+    vkCmdPipelineBarrier(command,
+      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+      0, 0, nullptr, 0, nullptr,
+      uint32_t(pending.preBarriers.size()), pending.preBarriers.data());
+  }
+  for (const auto& v : pending.bufferCopies)
+  {
+    vkCmdCopyBuffer(command, v.srcBuffer, v.buffer, 1, &v.region);
+  }
+  for (const auto& v : pending.imageCopies)
+  {
+    vkCmdCopyBufferToImage(command, m_stagingBuffer, v.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &v.region);
+  }
+
+  // 転送完了後に描画やシェーダーから参照できるようにする.
+  VkMemoryBarrier memoryBarrier{};
+  memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  memoryBarrier.dstAccessMask =
+    VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+    VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+  vkCmdPipelineBarrier(command,
+    VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+    0, 1, &memoryBarrier, 0, nullptr,
+    uint32_t(pending.postBarriers.size()), pending.postBarriers.data());
+
+  pending.preBarriers.clear();
+  pending.bufferCopies.clear();
+  pending.imageCopies.clear();
+  pending.postBarriers.clear();
+}
+
+void VulkanAppBase::uploadBuffer(VkBuffer buffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size)
+{
+  const auto* src = static_cast<const uint8_t*>(data);
+  beginUploadBatch();
+  // 取り込み済みのホストメモリ内なら, そこから直接転送する.
+  for (const auto& v : m_hostMemoryImports)
+  {
+    if (src >= v.data && src + size <= v.data + v.size)
+    {
+      PendingBufferCopy copy{};
+      copy.srcBuffer = v.buffer;
+      copy.buffer = buffer;
+      copy.region.srcOffset = VkDeviceSize(src - v.data);
+      copy.region.dstOffset = dstOffset;
+      copy.region.size = size;
+      m_pendingUploads.bufferCopies.push_back(copy);
+      endUploadBatch();
+      return;
+    }
+  }
+  // リングバッファに収まる大きさに分割して転送する.
+  const auto maxChunk = m_stagingBufferSize / 2;
+  for (VkDeviceSize copied = 0; copied < size; )
+  {
+    auto chunk = (std::min)(maxChunk, size - copied);
+    VkDeviceSize offset;
+    allocateStagingBuffer(chunk, 16, &offset);
+    memcpy(m_stagingMapped + offset, src + copied, size_t(chunk));
+
+    PendingBufferCopy copy{};
+    copy.srcBuffer = m_stagingBuffer;
+    copy.buffer = buffer;
+    copy.region.srcOffset = offset;
+    copy.region.dstOffset = dstOffset + copied;
+    copy.region.size = chunk;
+    m_pendingUploads.bufferCopies.push_back(copy);
+    copied += chunk;
+  }
+  endUploadBatch();
+}
+
+void VulkanAppBase::uploadImage(VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t texelSize, const void* data)
+{
+  if (useHostImageCopy(format))
+  {
+    copyImageFromHost(image, width, height, data);
+    return;
+  }
+  const auto* src = static_cast<const uint8_t*>(data);
+  const VkDeviceSize rowPitch = VkDeviceSize(width) * texelSize;
+  // リングバッファに収まる行数ずつに分割して転送する.
+  const auto maxRows = uint32_t((std::max)(VkDeviceSize(1), m_stagingBufferSize / 2 / rowPitch));
+
+  VkImageMemoryBarrier imb{};
+  imb.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  imb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imb.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+  imb.image = image;
+
+  beginUploadBatch();
+  imb.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  imb.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  imb.srcAccessMask = 0;
+  imb.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  m_pendingUploads.preBarriers.push_back(imb);
+  for (uint32_t y = 0; y < height; )
+  {
+    auto rows = (std::min)(maxRows, height - y);
+    auto size = rowPitch * rows;
+    VkDeviceSize offset;
+    allocateStagingBuffer(size, 16, &offset);
+    memcpy(m_stagingMapped + offset, src + rowPitch * y, size_t(size));
+
+    PendingImageCopy copy{};
+    copy.image = image;
+    copy.region.bufferOffset = offset;
+    copy.region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    copy.region.imageOffset = { 0, int32_t(y), 0 };
+    copy.region.imageExtent = { width, rows, 1 };
+    m_pendingUploads.imageCopies.push_back(copy);
+    y += rows;
+  }
+  imb.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  imb.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  imb.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  imb.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  m_pendingUploads.postBarriers.push_back(imb);
+  endUploadBatch();
+}
+
+VkImageUsageFlags VulkanAppBase::getImageUploadUsage(VkFormat format) const
+{
+#ifdef VK_EXT_host_image_copy
+  if (useHostImageCopy(format))
+  {
+    return VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT;
+  }
+#endif
+  return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+}
+
+bool VulkanAppBase::useHostImageCopy(VkFormat format) const
+{
+#ifdef VK_EXT_host_image_copy
+  if (!m_hostImageCopySupported)
+  {
+    return false;
+  }
+  VkFormatProperties3 props3{};
+  props3.sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_3;
+  VkFormatProperties2 props{};
+  props.sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2;
+  props.pNext = &props3;
+  vkGetPhysicalDeviceFormatProperties2(m_physDev, format, &props);
+  return (props3.optimalTilingFeatures & VK_FORMAT_FEATURE_2_HOST_IMAGE_TRANSFER_BIT_EXT) != 0;
+#else
+  return false;
+#endif
+}
+
+void VulkanAppBase::copyImageFromHost(VkImage image, uint32_t width, uint32_t height, const void* data)
+{
+#ifdef VK_EXT_host_image_copy
+  // レイアウト遷移もコマンドバッファを使わずホスト側で行う.
+  const auto copyLayout = m_hostCopyToShaderReadOnly ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+  VkHostImageLayoutTransitionInfoEXT transition{};
+  transition.sType = VK_STRUCTURE_TYPE_HOST_IMAGE_LAYOUT_TRANSITION_INFO_EXT;
+  transition.image = image;
+  transition.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  transition.newLayout = copyLayout;
+  transition.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+  auto result = m_vkTransitionImageLayoutEXT(m_device, 1, &transition);
+  checkResult(result);
+
+  VkMemoryToImageCopyEXT region{};
+  region.sType = VK_STRUCTURE_TYPE_MEMORY_TO_IMAGE_COPY_EXT;
+  region.pHostPointer = data;
+  region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+  region.imageExtent = { width, height, 1 };
+  VkCopyMemoryToImageInfoEXT copyInfo{};
+  copyInfo.sType = VK_STRUCTURE_TYPE_COPY_MEMORY_TO_IMAGE_INFO_EXT;
+  copyInfo.dstImage = image;
+  copyInfo.dstImageLayout = copyLayout;
+  copyInfo.regionCount = 1;
+  copyInfo.pRegions = &region;
+  result = m_vkCopyMemoryToImageEXT(m_device, &copyInfo);
+  checkResult(result);
+
+  if (copyLayout != VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+  {
+    transition.oldLayout = copyLayout;
+    transition.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    result = m_vkTransitionImageLayoutEXT(m_device, 1, &transition);
+    checkResult(result);
+  }
+#endif
+}
+
+bool VulkanAppBase::importHostMemory(const void* data, VkDeviceSize size)
+{
+  if (!m_externalMemoryHostSupported || data == nullptr || size == 0)
+  {
+    return false;
+  }
+  // 先頭アドレスとサイズは minImportedHostPointerAlignment の倍数である必要がある.
+  // サイズの端数は最後のページ内に収まる場合のみ切り上げてよい.
+  // アラインメントがページより大きいと未マップの領域まで含むため, 取り込まずにステージングを使う.
+  if (reinterpret_cast<uintptr_t>(data) % m_hostPointerAlignment != 0)
+  {
+    return false;
+  }
+  SYSTEM_INFO systemInfo;
+  GetSystemInfo(&systemInfo);
+  const auto importSize = AlignUp(size, m_hostPointerAlignment);
+  if (importSize > AlignUp(size, VkDeviceSize(systemInfo.dwPageSize)))
+  {
+    return false;
+  }
+  const auto handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+
+  VkMemoryHostPointerPropertiesEXT hostPointerProps{};
+  hostPointerProps.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+  auto result = m_vkGetMemoryHostPointerPropertiesEXT(m_device, handleType, data, &hostPointerProps);
+  if (result != VK_SUCCESS)
+  {
+    return false;
+  }
+
+  HostMemoryImport entry{};
+  entry.data = static_cast<const uint8_t*>(data);
+  entry.size = size;
+
+  VkExternalMemoryBufferCreateInfo externalCI{};
+  externalCI.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+  externalCI.handleTypes = handleType;
+  VkBufferCreateInfo ci{};
+  ci.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  ci.pNext = &externalCI;
+  ci.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  ci.size = importSize;
+  result = vkCreateBuffer(m_device, &ci, nullptr, &entry.buffer);
+  if (result != VK_SUCCESS)
+  {
+    return false;
+  }
+
+  VkMemoryRequirements reqs;
+  vkGetBufferMemoryRequirements(m_device, entry.buffer, &reqs);
+  reqs.memoryTypeBits &= hostPointerProps.memoryTypeBits;
+  reqs.size = importSize;
+
+  VkImportMemoryHostPointerInfoEXT importInfo{};
+  importInfo.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+  importInfo.handleType = handleType;
+  importInfo.pHostPointer = const_cast<void*>(data);
+  result = allocateMemory(reqs, MemoryUsage::Upload, MemoryCategory::Staging, &entry.memory, &importInfo);
+  if (result != VK_SUCCESS)
+  {
+    vkDestroyBuffer(m_device, entry.buffer, nullptr);
+    return false;
+  }
+  vkBindBufferMemory(m_device, entry.buffer, entry.memory, 0);
+  m_hostMemoryImports.push_back(entry);
+  return true;
+}
+
+void VulkanAppBase::releaseHostMemory(const void* data)
+{
+  auto itr = find_if(m_hostMemoryImports.begin(), m_hostMemoryImports.end(),
+    [=](const HostMemoryImport& v) { return v.data == data; });
+  if (itr == m_hostMemoryImports.end())
+  {
+    return;
+  }
+  // このメモリを参照する転送をすべて完了させる.
+  waitUpload(m_uploadSerial);
+  vkDestroyBuffer(m_device, itr->buffer, nullptr);
+  freeMemory(itr->memory);
+  m_hostMemoryImports.erase(itr);
+}
+
+void VulkanAppBase::setImageMemoryBarrier(
+  VkCommandBuffer command,
+  VkImage image,
+  VkImageLayout oldLayout, VkImageLayout newLayout)
+{
+  VkImageMemoryBarrier imb{};
+  imb.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  imb.oldLayout = oldLayout;
+  imb.newLayout = newLayout;
+  imb.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imb.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  imb.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+  imb.image = image;
+
+  VkPipelineStageFlags srcStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+  VkPipelineStageFlags dstStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+  switch (oldLayout)
+  {
+  case VK_IMAGE_LAYOUT_UNDEFINED:
+    imb.srcAccessMask = 0;
+    break;
+  case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+    imb.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    srcStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    break;
+  }
+
+  switch (newLayout)
+  {
+  case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+    imb.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    dstStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    break;
+  case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+    imb.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    dstStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    break;
+  case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+    imb.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    dstStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    break;
+  }
+
+  //srcStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;  // パイプライン中でリソースへの書込み最終のステージ.
+  //dstStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;  // パイプライン中で次にリソースに書き込むステージ.
+
+  vkCmdPipelineBarrier(
+    command,
+    srcStage,
+    dstStage,
+    0,
+    0,  // memoryBarrierCount
+    nullptr,
+    0,  // bufferMemoryBarrierCount
+    nullptr,
+    1,  // imageMemoryBarrierCount
+    &imb);
+}
+
+void VulkanAppBase::deferDestroyBuffer(VkBuffer buffer)
+{
+  deferDestroy([=]() { vkDestroyBuffer(m_device, buffer, nullptr); });
+}
+void VulkanAppBase::deferDestroyImage(VkImage image)
+{
+  deferDestroy([=]() { vkDestroyImage(m_device, image, nullptr); });
+}
+void VulkanAppBase::deferDestroyImageView(VkImageView view)
+{
+  deferDestroy([=]() { vkDestroyImageView(m_device, view, nullptr); });
+}
+void VulkanAppBase::deferDestroySampler(VkSampler sampler)
+{
+  deferDestroy([=]() { vkDestroySampler(m_device, sampler, nullptr); });
+}
+void VulkanAppBase::deferDestroyPipeline(VkPipeline pipeline)
+{
+  deferDestroy([=]() { vkDestroyPipeline(m_device, pipeline, nullptr); });
+}
+void VulkanAppBase::deferFreeMemory(VkDeviceMemory memory)
+{
+  deferDestroy([=]() { freeMemory(memory); });
+}
+void VulkanAppBase::deferFreeDescriptorSet(VkDescriptorPool pool, VkDescriptorSet descriptorSet)
+{
+  deferDestroy([=]() { vkFreeDescriptorSets(m_device, pool, 1, &descriptorSet); });
+}
+
+void VulkanAppBase::deferDestroy(std::function<void()> destroyer)
+{
+  // 記録中のフレームと, 送信待ちを含む転送がすべて完了するまで待たせる.
+  DeferredDestroy entry;
+  entry.frame = m_frameNumber;
+  entry.uploadSerial = m_uploadSerial;
+  if (m_uploadBatchDepth > 0)
+  {
+    // バッチ中は送信されるシリアルが未確定のため, endUploadBatch() で確定させる.
+    entry.uploadSerial = PendingUploadSerial;
+  }
+  entry.destroyer = std::move(destroyer);
+  m_deferredDestroys.push_back(std::move(entry));
+}
+
+void VulkanAppBase::processDeferredDestroys(bool flushAll)
+{
+  while (!m_deferredDestroys.empty())
+  {
+    auto& entry = m_deferredDestroys.front();
+    if (!flushAll)
+    {
+      if (entry.frame > m_completedFrame || !isUploadCompleted(entry.uploadSerial))
+      {
+        break;
+      }
+    }
+    entry.destroyer();
+    m_deferredDestroys.pop_front();
+  }
+}
+
+void VulkanAppBase::enableDebugReport()
+{
+  GetInstanceProcAddr(vkCreateDebugReportCallbackEXT);
+  GetInstanceProcAddr(vkDebugReportMessageEXT);
+  GetInstanceProcAddr(vkDestroyDebugReportCallbackEXT);
+
+  VkDebugReportFlagsEXT flags = VK_DEBUG_REPORT_ERROR_BIT_EXT | VK_DEBUG_REPORT_WARNING_BIT_EXT;
+
+  VkDebugReportCallbackCreateInfoEXT drcCI{};
+  drcCI.sType = VK_STRUCTURE_TYPE_DEBUG_REPORT_CALLBACK_CREATE_INFO_EXT;
+  drcCI.flags = flags;
+  drcCI.pfnCallback = &DebugReportCallback;
+  m_vkCreateDebugReportCallbackEXT(m_instance, &drcCI, nullptr, &m_debugReport);
+}
+void VulkanAppBase::disableDebugReport()
+{
+  if (m_vkDestroyDebugReportCallbackEXT)
+  {
+    m_vkDestroyDebugReportCallbackEXT(m_instance, m_debugReport, nullptr);
+  }
+}
+
+void VulkanAppBase::render()
+{
+  uint32_t nextImageIndex = 0;
+  vkAcquireNextImageKHR(m_device, m_swapchain, UINT64_MAX, m_presentCompletedSem, VK_NULL_HANDLE, &nextImageIndex);
+  auto commandFence = m_fences[nextImageIndex];
+  vkWaitForFences(m_device, 1, &commandFence, VK_TRUE, UINT64_MAX);
+  // フェンスの完了はそれ以前に送信したフレームの完了も意味する.
+  m_completedFrame = (std::max)(m_completedFrame, m_fenceFrames[nextImageIndex]);
+  processDeferredDestroys(false);
+
+  // このコマンドバッファで前回計測した GPU 時間 (完了済みなので待たずに読める)
+  const auto timestampIndex = nextImageIndex * 2;
+  if (m_timestampPool != VK_NULL_HANDLE && m_timestampWritten[nextImageIndex])
+  {
+    uint64_t timestamps[2];
+    auto result = vkGetQueryPoolResults(m_device, m_timestampPool, timestampIndex, 2,
+      sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if (result == VK_SUCCESS)
+    {
+      auto ticks = (timestamps[1] - timestamps[0]) & m_timestampMask;
+      m_gpuFrameTime = double(ticks) * m_timestampPeriod * 1.0e-6;
+    }
+  }
+  auto cpuStart = chrono::steady_clock::now();
+
+  // クリア値
+  array<VkClearValue, 2> clearValue;
+  getClearValues(clearValue.data());
+
+  VkRenderPassBeginInfo renderPassBI{};
+  renderPassBI.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+  renderPassBI.renderPass = m_renderPass;
+  renderPassBI.framebuffer = m_framebuffers[nextImageIndex];
+  renderPassBI.renderArea.offset = VkOffset2D{ 0, 0 };
+  renderPassBI.renderArea.extent = m_swapchainExtent;
+  renderPassBI.pClearValues = clearValue.data();
+  renderPassBI.clearValueCount = uint32_t(clearValue.size());
+
+  // コマンドバッファ・レンダーパス開始
+  VkCommandBufferBeginInfo commandBI{};
+  commandBI.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  auto& command = m_commands[nextImageIndex];
+  vkBeginCommandBuffer(command, &commandBI);
+  if (m_timestampPool != VK_NULL_HANDLE)
+  {
+    vkCmdResetQueryPool(command, m_timestampPool, timestampIndex, 2);
+    vkCmdWriteTimestamp(command, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_timestampPool, timestampIndex);
+  }
+
+  m_imageIndex = nextImageIndex;
+  makeCommandBeforeRenderPass(command);
+  vkCmdBeginRenderPass(command, &renderPassBI, VK_SUBPASS_CONTENTS_INLINE);
+
+  makeCommand(command);
+
+  // コマンド・レンダーパス終了
+  vkCmdEndRenderPass(command);
+  if (m_timestampPool != VK_NULL_HANDLE)
+  {
+    vkCmdWriteTimestamp(command, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestampPool, timestampIndex + 1);
+    m_timestampWritten[nextImageIndex] = 1;
+  }
+  vkEndCommandBuffer(command);
+
+  // コマンドを実行（送信)
+  VkSubmitInfo submitInfo{};
+  VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &command;
+  submitInfo.pWaitDstStageMask = &waitStageMask;
+  submitInfo.waitSemaphoreCount = 1;
+  submitInfo.pWaitSemaphores = &m_presentCompletedSem;
+  submitInfo.signalSemaphoreCount = 1;
+  submitInfo.pSignalSemaphores = &m_renderCompletedSem;
+  vkResetFences(m_device, 1, &commandFence);
+  vkQueueSubmit(m_deviceQueue, 1, &submitInfo, commandFence);
+  m_fenceFrames[nextImageIndex] = m_frameNumber++;
+  m_cpuFrameTime = chrono::duration<double, milli>(chrono::steady_clock::now() - cpuStart).count();
+
+  // Present 処理
+  VkPresentInfoKHR presentInfo{};
+  presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+  presentInfo.swapchainCount = 1;
+  presentInfo.pSwapchains = &m_swapchain;
+  presentInfo.pImageIndices = &nextImageIndex;
+  presentInfo.waitSemaphoreCount = 1;
+  presentInfo.pWaitSemaphores = &m_renderCompletedSem;
+  vkQueuePresentKHR(m_deviceQueue, &presentInfo);
 }
\ No newline at end of file
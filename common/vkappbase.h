@@ -1,92 +1,326 @@
-﻿#pragma once
-#define WIN32_LEAN_AND_MEAN
-#include <windows.h>
-
-#define VK_USE_PLATFORM_WIN32_KHR
-#define GLFW_INCLUDE_VULKAN
-#define GLFW_EXPOSE_NATIVE_WIN32
-#include <GLFW/glfw3.h>
-#include <GLFW/glfw3native.h>
-#include <vulkan/vk_layer.h>
-#include <vulkan/vulkan_win32.h>
-
-#include <vector>
-
-class VulkanAppBase
-{
-public:
-  VulkanAppBase();
-  virtual ~VulkanAppBase() { }
-  void initialize(GLFWwindow* window, const char* appName);
-  void terminate();
-
-  virtual void render();
-
-  virtual void prepare() { }
-  virtual void cleanup() { }
-  virtual void makeCommand(VkCommandBuffer command) { }
-protected:
-  static void checkResult(VkResult);
-
-  void initializeInstance(const char* appName);
-  void selectPhysicalDevice();
-  uint32_t searchGraphicsQueueIndex();
-  void createDevice();
-  void prepareCommandPool();
-  void selectSurfaceFormat(VkFormat format);
-  void createSwapchain(GLFWwindow* window);
-  void createDepthBuffer();
-  void createViews();
-
-  void createRenderPass();
-  void createFramebuffer();
-
-  void prepareCommandBuffers();
-  void prepareSemaphores();
-
-  uint32_t getMemoryTypeIndex(uint32_t requestBits, VkMemoryPropertyFlags requestProps)const;
-  
-  void enableDebugReport();
-  void disableDebugReport();
-
-
-  VkInstance  m_instance;
-  VkDevice    m_device;
-  VkPhysicalDevice  m_physDev;
-
-  VkSurfaceKHR        m_surface;
-  VkSurfaceFormatKHR  m_surfaceFormat;
-  VkSurfaceCapabilitiesKHR  m_surfaceCaps;
-
-  VkPhysicalDeviceMemoryProperties m_physMemProps;
-
-  uint32_t m_graphicsQueueIndex;
-  VkQueue m_deviceQueue;
-
-  VkCommandPool m_commandPool;
-  VkPresentModeKHR m_presentMode;
-  VkSwapchainKHR  m_swapchain;
-  VkExtent2D    m_swapchainExtent;
-  std::vector<VkImage> m_swapchainImages;
-  std::vector<VkImageView> m_swapchainViews;
-
-  VkImage         m_depthBuffer;
-  VkDeviceMemory  m_depthBufferMemory;
-  VkImageView     m_depthBufferView;
-
-  VkRenderPass      m_renderPass;
-  std::vector<VkFramebuffer>    m_framebuffers;
-
-  std::vector<VkFence>          m_fences;
-  VkSemaphore   m_renderCompletedSem, m_presentCompletedSem;
-
-  // デバッグレポート関連
-  PFN_vkCreateDebugReportCallbackEXT	m_vkCreateDebugReportCallbackEXT;
-  PFN_vkDebugReportMessageEXT	m_vkDebugReportMessageEXT;
-  PFN_vkDestroyDebugReportCallbackEXT m_vkDestroyDebugReportCallbackEXT;
-  VkDebugReportCallbackEXT  m_debugReport;
-
-  std::vector<VkCommandBuffer> m_commands;
-
-  uint32_t  m_imageIndex;
-};
+﻿#pragma once
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+#define VK_USE_PLATFORM_WIN32_KHR
+#define GLFW_INCLUDE_VULKAN
+#define GLFW_EXPOSE_NATIVE_WIN32
+#include <GLFW/glfw3.h>
+#include <GLFW/glfw3native.h>
+#include <vulkan/vk_layer.h>
+#include <vulkan/vulkan_win32.h>
+
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <functional>
+
+class VulkanAppBase
+{
+public:
+  VulkanAppBase();
+  virtual ~VulkanAppBase() { }
+  void initialize(GLFWwindow* window, const char* appName);
+  void terminate();
+
+  virtual void render();
+
+  virtual void prepare() { }
+  virtual void cleanup() { }
+  virtual void makeCommand(VkCommandBuffer command) { }
+  // レンダーパス開始前に記録するコマンド (コンピュートによるカリング等)
+  virtual void makeCommandBeforeRenderPass(VkCommandBuffer command) { }
+
+  // メモリの用途. 用途に応じて望ましいメモリタイプを選択する.
+  enum class MemoryUsage
+  {
+    GpuOnly,    // GPU からのみ参照する (テクスチャ, デプスバッファ等)
+    Upload,     // CPU で書き込み GPU へ転送する (ステージングバッファ)
+    Readback,   // GPU で書き込み CPU で読み戻す
+    Streaming,  // CPU で頻繁に書き込み GPU が直接参照する (ユニフォームバッファ等)
+    Transient,  // レンダーパス内でのみ使う一時アタッチメント (LAZILY_ALLOCATED を優先)
+  };
+  // メモリ使用量を集計するためのカテゴリ
+  enum class MemoryCategory
+  {
+    Texture,
+    Mesh,
+    Uniform,
+    DepthBuffer,
+    Staging,
+    Other,
+    Count
+  };
+  // アタッチメントのロード/ストア操作
+  struct AttachmentOps
+  {
+    VkAttachmentLoadOp  loadOp;
+    VkAttachmentStoreOp storeOp;
+    VkAttachmentLoadOp  stencilLoadOp;
+    VkAttachmentStoreOp stencilStoreOp;
+  };
+  // アップロード完了の確認に使う値. 送信ごとに増加する.
+  typedef uint64_t UploadTicket;
+
+  // メモリ使用量をカテゴリ別・ヒープ別に出力する.
+  void reportMemoryUsage() const;
+  // false にすると VK_EXT_host_image_copy が使えてもステージング経由で転送する (比較用).
+  // initialize() の前に呼ぶこと.
+  void setPreferHostImageCopy(bool prefer) { m_preferHostImageCopy = prefer; }
+protected:
+  static void checkResult(VkResult);
+
+  void initializeInstance(const char* appName);
+  void selectPhysicalDevice();
+  uint32_t searchGraphicsQueueIndex();
+  void createDevice();
+  void prepareCommandPool();
+  void selectSurfaceFormat(VkFormat format);
+  void createSwapchain(GLFWwindow* window);
+  void selectDepthFormat();
+  void createDepthBuffer();
+  bool isDepthBufferTransient() const;
+  VkImageAspectFlags getDepthAspect() const;
+  // 逆Z の設定に応じた深度比較関数
+  VkCompareOp getDepthCompareOp() const;
+  // レンダーパス開始時のクリア値 (カラー, デプス)
+  void getClearValues(VkClearValue values[2]) const;
+  void createViews();
+
+  void createRenderPass();
+  void createFramebuffer();
+  // 前の内容を読む (LOAD) デプスバッファを, レンダーパスの開始レイアウトへ移しておく.
+  void prepareAttachmentLayouts();
+
+  void prepareCommandBuffers();
+  void prepareSemaphores();
+  void prepareTimestampQueries();
+
+  uint32_t getMemoryTypeIndex(uint32_t requestBits, VkMemoryPropertyFlags requestProps)const;
+  uint32_t getMemoryTypeIndex(uint32_t requestBits, MemoryUsage usage, VkDeviceSize size);
+  std::vector<uint32_t> getMemoryTypeCandidates(uint32_t requestBits, MemoryUsage usage, VkDeviceSize size);
+  VkResult allocateMemory(const VkMemoryRequirements& reqs, MemoryUsage usage, MemoryCategory category, VkDeviceMemory* memory, const void* pNext = nullptr);
+  void freeMemory(VkDeviceMemory memory);
+  void reportMemoryLeaks() const;
+
+  // ステージング用リングバッファを使ったアップロード
+  void prepareStagingBuffer();
+  void destroyStagingBuffer();
+  bool allocateStagingBuffer(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset);
+  void reclaimStagingBuffer(bool waitOldest);
+  VkCommandBuffer beginUploadCommand();
+  void submitUploadCommand();
+  void recordPendingUploads();
+  // beginUploadBatch/endUploadBatch の間の転送はまとめて 1 回で送信される.
+  void beginUploadBatch();
+  UploadTicket endUploadBatch();
+  bool isUploadCompleted(UploadTicket ticket);
+  void waitUpload(UploadTicket ticket);
+  void uploadBuffer(VkBuffer buffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+  void uploadImage(VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t texelSize, const void* data);
+  // テクスチャ転送用のイメージに指定する使用法 (ホストからの直接コピーが使えるかで変わる)
+  VkImageUsageFlags getImageUploadUsage(VkFormat format) const;
+  bool useHostImageCopy(VkFormat format) const;
+  void copyImageFromHost(VkImage image, uint32_t width, uint32_t height, const void* data);
+  void setImageMemoryBarrier(VkCommandBuffer command, VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout);
+  // ホストメモリ (ファイルのマップ領域など) を転送元として取り込む (VK_EXT_external_memory_host).
+  // 取り込んだ範囲を指す uploadBuffer はステージングを経由せずに転送される.
+  // data はページ境界に揃っていること. 取り込めない場合は false を返す.
+  // 取り込む範囲をページ単位より大きく切り上げる必要がある環境でも false を返す (マップ領域を超えるため).
+  bool importHostMemory(const void* data, VkDeviceSize size);
+  // 転送完了を待ってから取り込みを解除する. ホストメモリはこの後に解放すること.
+  // 送信前の転送は待てないため, アップロードバッチの外で呼ぶこと.
+  void releaseHostMemory(const void* data);
+  void updateMemoryBudget();
+  // テクスチャの転送方式と, ステージング/テクスチャのメモリ使用量を出力する (転送方式の比較用).
+  void reportTextureUpload() const;
+
+  // 遅延破棄. 現在のフレームの GPU 処理が完了した後に破棄される.
+  // ディスクリプタセットのプールは VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT 付きで作成しておくこと.
+  void deferDestroyBuffer(VkBuffer buffer);
+  void deferDestroyImage(VkImage image);
+  void deferDestroyImageView(VkImageView view);
+  void deferDestroySampler(VkSampler sampler);
+  void deferDestroyPipeline(VkPipeline pipeline);
+  void deferFreeMemory(VkDeviceMemory memory);
+  void deferFreeDescriptorSet(VkDescriptorPool pool, VkDescriptorSet descriptorSet);
+  void deferDestroy(std::function<void()> destroyer);
+  void processDeferredDestroys(bool flushAll);
+  
+  void enableDebugReport();
+  void disableDebugReport();
+
+
+  VkInstance  m_instance;
+  VkDevice    m_device;
+  VkPhysicalDevice  m_physDev;
+
+  VkSurfaceKHR        m_surface;
+  VkSurfaceFormatKHR  m_surfaceFormat;
+  VkSurfaceCapabilitiesKHR  m_surfaceCaps;
+
+  VkPhysicalDeviceMemoryProperties m_physMemProps;
+  // デバイス作成時に有効にした機能 (対応していれば有効にする)
+  VkPhysicalDeviceFeatures m_enabledFeatures;
+  // VK_KHR_draw_indirect_count. 使えない場合は nullptr.
+  PFN_vkCmdDrawIndexedIndirectCountKHR m_vkCmdDrawIndexedIndirectCount;
+  // VK_EXT_conditional_rendering. 機能が使えない場合は nullptr.
+  PFN_vkCmdBeginConditionalRenderingEXT m_vkCmdBeginConditionalRendering;
+  PFN_vkCmdEndConditionalRenderingEXT m_vkCmdEndConditionalRendering;
+
+  // VK_EXT_external_memory_host
+  bool m_externalMemoryHostSupported;
+  VkDeviceSize m_hostPointerAlignment;
+  PFN_vkGetMemoryHostPointerPropertiesEXT m_vkGetMemoryHostPointerPropertiesEXT;
+  struct HostMemoryImport
+  {
+    const uint8_t* data;
+    VkDeviceSize size;
+    VkBuffer buffer;
+    VkDeviceMemory memory;
+  };
+  std::vector<HostMemoryImport> m_hostMemoryImports;
+
+  // VK_EXT_host_image_copy. 使えるならステージングを使わずに CPU から直接イメージへ書き込む.
+  // m_preferHostImageCopy は setPreferHostImageCopy() で変更する (比較用).
+  bool m_preferHostImageCopy;
+  bool m_hostImageCopySupported;
+  bool m_hostCopyToShaderReadOnly;
+#ifdef VK_EXT_host_image_copy
+  PFN_vkCopyMemoryToImageEXT m_vkCopyMemoryToImageEXT;
+  PFN_vkTransitionImageLayoutEXT m_vkTransitionImageLayoutEXT;
+#endif
+
+  // ヒープごとの予算と使用量 (VK_EXT_memory_budget)
+  bool m_memoryBudgetSupported;
+  VkDeviceSize m_heapBudget[VK_MAX_MEMORY_HEAPS];
+  VkDeviceSize m_heapUsage[VK_MAX_MEMORY_HEAPS];
+
+  // メモリ使用量の集計用
+  struct MemoryCounter
+  {
+    VkDeviceSize live;
+    VkDeviceSize peak;
+    uint32_t count;
+  };
+  struct MemoryAllocation
+  {
+    VkDeviceSize size;
+    uint32_t heapIndex;
+    MemoryCategory category;
+  };
+  std::unordered_map<VkDeviceMemory, MemoryAllocation> m_memoryAllocations;
+  MemoryCounter m_categoryCounters[size_t(MemoryCategory::Count)];
+  MemoryCounter m_heapCounters[VK_MAX_MEMORY_HEAPS];
+
+  uint32_t m_graphicsQueueIndex;
+  VkQueue m_deviceQueue;
+
+  VkCommandPool m_commandPool;
+  VkPresentModeKHR m_presentMode;
+  VkSwapchainKHR  m_swapchain;
+  VkExtent2D    m_swapchainExtent;
+  std::vector<VkImage> m_swapchainImages;
+  std::vector<VkImageView> m_swapchainViews;
+
+  // デプスフォーマットの候補 (優先順). initialize() の前に変更すること.
+  std::vector<VkFormat> m_depthFormatCandidates;
+  VkFormat        m_depthFormat;
+  // 逆Z (手前を 1, 奥を 0 とする) を使うかどうか
+  bool            m_reversedZ;
+  // デプスバッファをシェーダーから読むか (Hi-Z の構築等). initialize() の前に変更すること.
+  bool            m_depthSampled;
+  VkImage         m_depthBuffer;
+  VkDeviceMemory  m_depthBufferMemory;
+  VkImageView     m_depthBufferView;
+  // シェーダーから読むための深度のみのビュー (m_depthSampled の場合のみ)
+  VkImageView     m_depthSampledView;
+
+  // 各アタッチメントのロード/ストア操作. initialize() の前に変更すること.
+  // カラーを LOAD する場合は, 同じフレームの前のパスで PRESENT_SRC_KHR へ移しておくこと.
+  // デプスの LOAD は, 最初に使うときの内容が不定 (レイアウトは prepareAttachmentLayouts() で合わせる).
+  AttachmentOps     m_colorOps;
+  AttachmentOps     m_depthOps;
+
+  VkRenderPass      m_renderPass;
+  std::vector<VkFramebuffer>    m_framebuffers;
+
+  std::vector<VkFence>          m_fences;
+  // 各フェンスで最後に送信したフレーム番号
+  std::vector<uint64_t>         m_fenceFrames;
+  uint64_t  m_frameNumber;
+  uint64_t  m_completedFrame;
+  VkSemaphore   m_renderCompletedSem, m_presentCompletedSem;
+
+  // フレーム時間の計測. GPU はコマンドバッファの先頭/末尾のタイムスタンプ,
+  // CPU はフェンス待ちの後からコマンドの記録と送信までにかかった時間 (いずれもミリ秒).
+  // GPU の値はフェンスの完了後に読むため, 同じスワップチェイン画像の前回のフレームのもの.
+  VkQueryPool m_timestampPool;    // タイムスタンプ非対応のキューでは VK_NULL_HANDLE
+  float     m_timestampPeriod;
+  uint64_t  m_timestampMask;
+  std::vector<uint8_t> m_timestampWritten;
+  double    m_gpuFrameTime;
+  double    m_cpuFrameTime;
+
+  // デバッグレポート関連
+  PFN_vkCreateDebugReportCallbackEXT	m_vkCreateDebugReportCallbackEXT;
+  PFN_vkDebugReportMessageEXT	m_vkDebugReportMessageEXT;
+  PFN_vkDestroyDebugReportCallbackEXT m_vkDestroyDebugReportCallbackEXT;
+  VkDebugReportCallbackEXT  m_debugReport;
+
+  std::vector<VkCommandBuffer> m_commands;
+
+  // ステージング用リングバッファ (常時マップしておく)
+  // 書き込み位置(head)と解放済み位置(tail)は累積バイト数で管理する.
+  struct UploadSubmission
+  {
+    VkFence fence;
+    VkCommandBuffer command;
+    VkDeviceSize stagingEnd;
+    UploadTicket serial;
+  };
+  struct PendingBufferCopy
+  {
+    VkBuffer srcBuffer;
+    VkBuffer buffer;
+    VkBufferCopy region;
+  };
+  struct PendingImageCopy
+  {
+    VkImage image;
+    VkBufferImageCopy region;
+  };
+  // 送信待ちの転送コマンド
+  struct PendingUploads
+  {
+    std::vector<VkImageMemoryBarrier> preBarriers;
+    std::vector<PendingBufferCopy> bufferCopies;
+    std::vector<PendingImageCopy> imageCopies;
+    std::vector<VkImageMemoryBarrier> postBarriers;
+  };
+  VkDeviceSize  m_stagingBufferSize;
+  VkBuffer      m_stagingBuffer;
+  VkDeviceMemory  m_stagingMemory;
+  uint8_t*      m_stagingMapped;
+  VkDeviceSize  m_stagingHead;
+  VkDeviceSize  m_stagingTail;
+  VkDeviceSize  m_stagingPeakUsage;
+  VkCommandBuffer m_uploadCommand;
+  std::deque<UploadSubmission> m_uploadSubmissions;
+  PendingUploads m_pendingUploads;
+  uint32_t      m_uploadBatchDepth;
+  UploadTicket  m_uploadSerial;
+  UploadTicket  m_completedUploadSerial;
+
+  // 遅延破棄の待ち行列 (登録順 = フレーム番号順)
+  struct DeferredDestroy
+  {
+    uint64_t frame;
+    UploadTicket uploadSerial;
+    std::function<void()> destroyer;
+  };
+  std::deque<DeferredDestroy> m_deferredDestroys;
+  static const UploadTicket PendingUploadSerial = ~0ull; // バッチ終了まで未確定
+
+  uint32_t  m_imageIndex;
+};